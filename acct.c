@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "acct.h"
+#include "config.h"
+#include "event.h"
+#include "logger.h"
+#include "sql.h"
+
+// How often the accounting thread drains the queue, in milliseconds.
+#define ACCT_DRAIN_MS 100
+#define ACCT_QUEUE_MAX (1U << 30)
+
+/*
+ * A queue entry is free for the producer claiming position pos while seq
+ * equals pos and holds a delta for the consumer once seq is pos + 1.
+ */
+typedef struct __acct_entry_type {
+	uint32_t seq;
+	uint32_t user_id;
+	uint32_t torrent_id;
+	int64_t up;
+	int64_t down;
+} acct_entry_t;
+
+typedef struct __acct_row_type {
+	uint32_t user_id;
+	uint32_t torrent_id;
+	int64_t up;
+	int64_t down;
+} acct_row_t;
+
+static void *acct_thread (void *);
+static void flush_task (void *);
+static inline int queue_pop (acct_row_t *);
+static inline void pending_add (acct_row_t *);
+static int pending_flush (void);
+static inline uint32_t pending_hash (uint32_t, uint32_t);
+static void pending_reindex (void);
+
+static acct_entry_t *queue = NULL;
+static uint32_t queue_mask = 0;
+// Written by every producer, kept off the consumer's cache line.
+static uint32_t queue_head __attribute__ ((aligned (64))) = 0;
+static uint32_t queue_tail __attribute__ ((aligned (64))) = 0;
+
+// Owned by the accounting thread.
+static acct_row_t *pending = NULL;
+static uint32_t *pending_idx = NULL;
+static uint32_t pending_mask = 0;
+static uint32_t pending_count = 0;
+static MYSQL_BIND *params = NULL;
+
+static pthread_t thrd;
+static uint8_t thrd_valid = 0;
+static int stop = 0;
+static int flush_due = 0;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static acct_stats_t stats;
+
+/*
+ * Stops the accounting thread once it has drained the queue and flushed
+ * what is pending, must run after the last acct_push () and before
+ * sql_fin ().
+ */
+void
+acct_fin (void)
+{
+	acct_stats_t st;
+
+	if (thrd_valid != 0) {
+		pthread_mutex_lock (&wake_lock);
+		__atomic_store_n (&stop, 1, __ATOMIC_RELEASE);
+		pthread_cond_signal (&wake);
+		pthread_mutex_unlock (&wake_lock);
+		pthread_join (thrd, NULL);
+		thrd_valid = 0;
+		acct_stats (&st);
+		logger (LOG_INFO, "INFO: acct: %" PRIu64 " deltas, %" PRIu64
+				" dropped, %" PRIu64 " rows in %" PRIu64
+				" flushes, %" PRIu64 " errors.\n", st.drained,
+				st.dropped, st.rows, st.flushes, st.errors);
+	}
+
+	free (queue);
+	free (pending);
+	free (pending_idx);
+	free (params);
+	queue = NULL;
+	pending = NULL;
+	pending_idx = NULL;
+	params = NULL;
+
+	return;
+}
+
+int
+acct_init (void)
+{
+	uint32_t i, size;
+
+	if ((acct_flush_rows == 0) || (acct_queue_size == 0)
+			|| (acct_queue_size > ACCT_QUEUE_MAX)) {
+		debug (LOG_ERR, "ERROR: bad acct_flush_rows or "
+				"acct_queue_size.\n");
+		return -1;
+	}
+
+	size = 2;
+	while (size < acct_queue_size)
+		size <<= 1;
+
+	queue = (acct_entry_t *) malloc (sizeof (acct_entry_t) * size);
+	pending = (acct_row_t *) malloc (sizeof (acct_row_t)
+			* acct_flush_rows);
+	params = (MYSQL_BIND *) malloc (sizeof (MYSQL_BIND) * SQL_BATCH_ROWS
+			* SQL_TRANSFER_PARAMS);
+	pending_mask = 1;
+	while (pending_mask < 2 * acct_flush_rows)
+		pending_mask <<= 1;
+
+	pending_idx = (uint32_t *) calloc (pending_mask, sizeof (uint32_t));
+	pending_mask--;
+	if ((queue == NULL) || (pending == NULL) || (params == NULL)
+			|| (pending_idx == NULL)) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		acct_fin ();
+		return -1;
+	}
+
+	for (i = 0; i < size; i++)
+		queue[i].seq = i;
+
+	queue_mask = size - 1;
+	queue_head = 0;
+	queue_tail = 0;
+	pending_count = 0;
+	stop = 0;
+	flush_due = 0;
+	if (acct_flush_interval == 0)
+		acct_flush_interval = 1;
+
+	if (event_add ("acct flush", acct_flush_interval, flush_task,
+				NULL) != 0) {
+		acct_fin ();
+		return -1;
+	}
+
+	if (pthread_create (&thrd, NULL, acct_thread, NULL) != 0) {
+		debug (LOG_ERR, "ERROR: unable to start accounting thread.\n");
+		acct_fin ();
+		return -1;
+	}
+
+	thrd_valid = 1;
+
+	return 0;
+}
+
+/*
+ * Queues a transfer delta, never blocks.  Deltas without a known user or
+ * torrent, or with nothing transferred, are ignored.  Returns -1 if the
+ * queue is full and the delta was dropped.
+ */
+int
+acct_push (uint32_t user_id, uint32_t torrent_id, int64_t up, int64_t down)
+{
+	acct_entry_t *e;
+	uint32_t pos, seq;
+	int32_t diff;
+
+	if ((user_id == 0) || (torrent_id == 0) || ((up == 0) && (down == 0)))
+		return 0;
+
+	pos = __atomic_load_n (&queue_head, __ATOMIC_RELAXED);
+	while (1) {
+		e = &queue[pos & queue_mask];
+		seq = __atomic_load_n (&e->seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t) (seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n (&queue_head, &pos,
+						pos + 1, 1, __ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_add_fetch (&stats.dropped, 1,
+					__ATOMIC_RELAXED);
+			return -1;
+		} else {
+			pos = __atomic_load_n (&queue_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	e->user_id = user_id;
+	e->torrent_id = torrent_id;
+	e->up = up;
+	e->down = down;
+	__atomic_store_n (&e->seq, pos + 1, __ATOMIC_RELEASE);
+
+	/*
+	 * Wake the thread early every half queue, a missed wake up only
+	 * delays the drain until its next tick.
+	 */
+	if (((pos + 1) & (queue_mask >> 1)) == 0)
+		pthread_cond_signal (&wake);
+
+	return 0;
+}
+
+void
+acct_stats (acct_stats_t *st)
+{
+	st->drained = __atomic_load_n (&stats.drained, __ATOMIC_RELAXED);
+	st->dropped = __atomic_load_n (&stats.dropped, __ATOMIC_RELAXED);
+	st->flushes = __atomic_load_n (&stats.flushes, __ATOMIC_RELAXED);
+	st->rows = __atomic_load_n (&stats.rows, __ATOMIC_RELAXED);
+	st->errors = __atomic_load_n (&stats.errors, __ATOMIC_RELAXED);
+
+	return;
+}
+
+static void *
+acct_thread (void *arg)
+{
+	struct timespec ts;
+	acct_row_t r;
+	int done;
+
+	(void) arg;
+	while (1) {
+		pthread_mutex_lock (&wake_lock);
+		done = __atomic_load_n (&stop, __ATOMIC_ACQUIRE);
+		if (done == 0) {
+			clock_gettime (CLOCK_REALTIME, &ts);
+			ts.tv_nsec += ACCT_DRAIN_MS * 1000000L;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+
+			pthread_cond_timedwait (&wake, &wake_lock, &ts);
+		}
+
+		pthread_mutex_unlock (&wake_lock);
+
+		// A full table that fails to flush leaves the rest queued.
+		while ((pending_count < acct_flush_rows)
+				&& (queue_pop (&r) == 0)) {
+			pending_add (&r);
+			if (pending_count == acct_flush_rows)
+				pending_flush ();
+		}
+
+		if (done != 0) {
+			pending_flush ();
+			break;
+		}
+
+		if ((__atomic_exchange_n (&flush_due, 0, __ATOMIC_ACQ_REL) != 0)
+				&& (pending_count > 0))
+			pending_flush ();
+	}
+
+	if ((pending_count > 0) || (queue_head != queue_tail))
+		debug (LOG_ERR, "ERROR: acct: lost %" PRIu32 " rows and %"
+				PRIu32 " queued deltas.\n", pending_count,
+				queue_head - queue_tail);
+
+	return NULL;
+}
+
+// Runs on the housekeeping loop every acct_flush_interval seconds.
+static void
+flush_task (void *cls)
+{
+	(void) cls;
+	__atomic_store_n (&flush_due, 1, __ATOMIC_RELEASE);
+	pthread_mutex_lock (&wake_lock);
+	pthread_cond_signal (&wake);
+	pthread_mutex_unlock (&wake_lock);
+
+	return;
+}
+
+static inline int
+queue_pop (acct_row_t *r)
+{
+	acct_entry_t *e;
+
+	e = &queue[queue_tail & queue_mask];
+	if (__atomic_load_n (&e->seq, __ATOMIC_ACQUIRE) != queue_tail + 1)
+		return -1;
+
+	r->user_id = e->user_id;
+	r->torrent_id = e->torrent_id;
+	r->up = e->up;
+	r->down = e->down;
+	__atomic_store_n (&e->seq, queue_tail + queue_mask + 1,
+			__ATOMIC_RELEASE);
+	queue_tail++;
+	__atomic_add_fetch (&stats.drained, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static inline void
+pending_add (acct_row_t *r)
+{
+	acct_row_t *p;
+	uint32_t i;
+
+	i = pending_hash (r->user_id, r->torrent_id) & pending_mask;
+	while (pending_idx[i] != 0) {
+		p = &pending[pending_idx[i] - 1];
+		if ((p->user_id == r->user_id)
+				&& (p->torrent_id == r->torrent_id)) {
+			p->up += r->up;
+			p->down += r->down;
+			return;
+		}
+
+		i = (i + 1) & pending_mask;
+	}
+
+	pending[pending_count++] = *r;
+	pending_idx[i] = pending_count;
+
+	return;
+}
+
+/*
+ * Writes the pending rows from the end of the table in power of two
+ * chunks, so only a handful of batch sizes are ever prepared.  Rows that
+ * fail to write stay at the front of the table.
+ */
+static int
+pending_flush (void)
+{
+	MYSQL_BIND *b;
+	acct_row_t *r;
+	uint32_t i, n;
+	int rc = 0;
+
+	while (pending_count > 0) {
+		n = SQL_BATCH_ROWS;
+		while (n > pending_count)
+			n >>= 1;
+
+		r = &pending[pending_count - n];
+		memset (params, 0, sizeof (MYSQL_BIND) * SQL_TRANSFER_PARAMS
+				* n);
+		for (i = 0; i < n; i++) {
+			b = &params[i * SQL_TRANSFER_PARAMS];
+			b[0].buffer_type = MYSQL_TYPE_LONG;
+			b[0].buffer = &r[i].user_id;
+			b[0].is_unsigned = 1;
+			b[1].buffer_type = MYSQL_TYPE_LONG;
+			b[1].buffer = &r[i].torrent_id;
+			b[1].is_unsigned = 1;
+			b[2].buffer_type = MYSQL_TYPE_LONGLONG;
+			b[2].buffer = &r[i].up;
+			b[3].buffer_type = MYSQL_TYPE_LONGLONG;
+			b[3].buffer = &r[i].down;
+		}
+
+		if (sql_exec_batch (SQL_BATCH_TRANSFER, n, params) < 0) {
+			__atomic_add_fetch (&stats.errors, 1,
+					__ATOMIC_RELAXED);
+			rc = -1;
+			break;
+		}
+
+		pending_count -= n;
+		__atomic_add_fetch (&stats.rows, n, __ATOMIC_RELAXED);
+	}
+
+	__atomic_add_fetch (&stats.flushes, 1, __ATOMIC_RELAXED);
+	pending_reindex ();
+
+	return rc;
+}
+
+static inline uint32_t
+pending_hash (uint32_t user_id, uint32_t torrent_id)
+{
+	uint32_t h;
+
+	h = user_id * 0x9e3779b1U ^ torrent_id * 0x85ebca6bU;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static void
+pending_reindex (void)
+{
+	uint32_t i, j;
+
+	memset (pending_idx, 0, sizeof (uint32_t) * (pending_mask + 1));
+	for (i = 0; i < pending_count; i++) {
+		j = pending_hash (pending[i].user_id, pending[i].torrent_id)
+			& pending_mask;
+		while (pending_idx[j] != 0)
+			j = (j + 1) & pending_mask;
+
+		pending_idx[j] = i + 1;
+	}
+
+	return;
+}
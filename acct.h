@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __ACCT_H__
+#define __ACCT_H__
+
+#include <inttypes.h>
+
+/*
+ * Write-behind transfer accounting.
+ *
+ * Announces push their uploaded and downloaded deltas onto a bounded
+ * lock-free multi-producer queue and never wait on the database.  A
+ * dedicated thread drains the queue, sums the deltas per (user, torrent)
+ * and writes them out as multi-row INSERT ... ON DUPLICATE KEY UPDATE
+ * statements when the housekeeping loop asks for a flush every
+ * acct_flush_interval seconds, or sooner once acct_flush_rows distinct
+ * pairs are pending.  When the queue is full
+ * the delta is dropped and counted.  Rows a flush fails to write stay
+ * pending and are retried with the next flush.
+ */
+
+typedef struct __acct_stats_type {
+	uint64_t drained;
+	uint64_t dropped;
+	uint64_t flushes;
+	uint64_t rows;
+	uint64_t errors;
+} acct_stats_t;
+
+void acct_fin (void);
+int acct_init (void);
+int acct_push (uint32_t, uint32_t, int64_t, int64_t);
+void acct_stats (acct_stats_t *);
+
+#endif /* __ACCT_H__ */
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include "announce.h"
+
+// Longest encoding of a single peer in the dictionary form.
+#define PEER_DCT_MAX (sizeof ("d2:ip15:255.255.255.2557:peer id20:" \
+			"4:porti65535ee") - 1 + PEER_ID_LEN)
+// Longest encoding of everything but the peers.
+#define RESPONSE_MAX (sizeof ("d8:intervali4294967295e5:peers" \
+			"4294967295:e") - 1)
+
+static inline void peer_window (swarm_view_t *, uint32_t *, uint32_t *,
+		int32_t *);
+static inline char *put_be32 (char *, uint32_t);
+static inline char *put_str (char *, const char *, size_t);
+static inline char *put_uint (char *, uint64_t);
+static inline char *write_compact (char *, swarm_view_t *, uint32_t, uint32_t,
+		int32_t);
+static inline char *write_dct (char *, swarm_view_t *, uint32_t, uint32_t,
+		int32_t, uint8_t);
+
+size_t
+announce_size (uint32_t n, uint8_t compact, uint8_t no_peer_id)
+{
+	if (compact != 0)
+		return RESPONSE_MAX + (size_t) n * PEER_ADDR_LEN;
+
+	if (no_peer_id != 0)
+		return RESPONSE_MAX + (size_t) n * (PEER_DCT_MAX - PEER_ID_LEN
+				- sizeof ("7:peer id20:") + 1);
+
+	return RESPONSE_MAX + (size_t) n * PEER_DCT_MAX;
+}
+
+/*
+ * Writes the response for n peers starting at slot start and returns its
+ * length.  The output is not NUL terminated.
+ */
+size_t
+announce_write (char *buf, swarm_view_t *v, uint32_t interval, uint32_t start,
+		uint32_t n, int32_t skip, uint8_t compact, uint8_t no_peer_id)
+{
+	char *p = buf;
+
+	peer_window (v, &start, &n, &skip);
+	p = put_str (p, "d8:intervali", 12);
+	p = put_uint (p, interval);
+	p = put_str (p, "e5:peers", 8);
+	if (compact != 0) {
+		p = put_uint (p, (uint64_t) n * PEER_ADDR_LEN);
+		*p++ = ':';
+		p = write_compact (p, v, start, n, skip);
+	} else {
+		*p++ = 'l';
+		p = write_dct (p, v, start, n, skip, no_peer_id);
+		*p++ = 'e';
+	}
+
+	*p++ = 'e';
+
+	return (size_t) (p - buf);
+}
+
+size_t
+announce_write_udp (char *buf, swarm_view_t *v, uint32_t interval,
+		uint32_t start, uint32_t n, int32_t skip)
+{
+	char *p = buf;
+
+	peer_window (v, &start, &n, &skip);
+	p = put_be32 (p, interval);
+	p = put_be32 (p, v->count - v->seeders);
+	p = put_be32 (p, v->seeders);
+	p = write_compact (p, v, start, n, skip);
+
+	return (size_t) (p - buf);
+}
+
+// Clamps the peer window to the swarm, the announcing peer is not counted.
+static inline void
+peer_window (swarm_view_t *v, uint32_t *start, uint32_t *n, int32_t *skip)
+{
+	uint32_t avail;
+
+	avail = v->count;
+	if ((*skip >= 0) && ((uint32_t) *skip < v->count))
+		avail--;
+	else
+		*skip = -1;
+
+	if (*n > avail)
+		*n = avail;
+
+	if (*start >= v->count)
+		*start = 0;
+
+	return;
+}
+
+static inline char *
+put_be32 (char *p, uint32_t v)
+{
+	v = htonl (v);
+	memcpy (p, &v, sizeof (v));
+
+	return p + sizeof (v);
+}
+
+static inline char *
+put_str (char *p, const char *s, size_t len)
+{
+	memcpy (p, s, len);
+
+	return p + len;
+}
+
+static inline char *
+put_uint (char *p, uint64_t v)
+{
+	char tmp[20];
+	char *t = tmp + sizeof (tmp);
+
+	do {
+		*--t = (char) ('0' + v % 10);
+		v /= 10;
+	} while (v != 0);
+
+	return put_str (p, t, (size_t) (tmp + sizeof (tmp) - t));
+}
+
+/*
+ * Copies the packed addresses in runs of contiguous slots, the runs only
+ * break at the end of the swarm and at the announcing peer's slot.
+ */
+static inline char *
+write_compact (char *p, swarm_view_t *v, uint32_t i, uint32_t n, int32_t skip)
+{
+	uint32_t run;
+
+	while (n > 0) {
+		if (i >= v->count)
+			i = 0;
+
+		if ((int32_t) i == skip) {
+			i++;
+			continue;
+		}
+
+		run = v->count - i;
+		if (skip > (int32_t) i)
+			run = (uint32_t) skip - i;
+
+		if (run > n)
+			run = n;
+
+		memcpy (p, v->addr[i], (size_t) run * PEER_ADDR_LEN);
+		p += (size_t) run * PEER_ADDR_LEN;
+		n -= run;
+		i += run;
+	}
+
+	return p;
+}
+
+static inline char *
+write_dct (char *p, swarm_view_t *v, uint32_t i, uint32_t n, int32_t skip,
+		uint8_t no_peer_id)
+{
+	char ip[INET_ADDRSTRLEN];
+	const uint8_t *addr;
+	char *q;
+	uint16_t port;
+
+	while (n > 0) {
+		if (i >= v->count)
+			i = 0;
+
+		if ((int32_t) i == skip) {
+			i++;
+			continue;
+		}
+
+		addr = v->addr[i];
+		q = put_uint (ip, addr[0]);
+		*q++ = '.';
+		q = put_uint (q, addr[1]);
+		*q++ = '.';
+		q = put_uint (q, addr[2]);
+		*q++ = '.';
+		q = put_uint (q, addr[3]);
+		p = put_str (p, "d2:ip", 5);
+		p = put_uint (p, (uint64_t) (q - ip));
+		*p++ = ':';
+		p = put_str (p, ip, (size_t) (q - ip));
+		if (no_peer_id == 0) {
+			p = put_str (p, "7:peer id20:", 12);
+			p = put_str (p, (const char *) v->peer_id[i],
+					PEER_ID_LEN);
+		}
+
+		memcpy (&port, addr + 4, sizeof (port));
+		p = put_str (p, "4:porti", 7);
+		p = put_uint (p, ntohs (port));
+		p = put_str (p, "ee", 2);
+		n--;
+		i++;
+	}
+
+	return p;
+}
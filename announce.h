@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __ANNOUNCE_H__
+#define __ANNOUNCE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "swarm.h"
+
+/*
+ * Announce response writers.
+ *
+ * The writers emit a complete bencoded announce response in one pass into
+ * a caller supplied buffer of at least announce_size () bytes.  Peers are
+ * taken from the slots [start, start + n) of a swarm_view_t wrapping
+ * around at its end, with the announcing peer's own slot skipped.  The compact
+ * form (BEP 23) copies the packed addresses straight out of the swarm.
+ *
+ * announce_write_udp () writes the body of a UDP announce response
+ * (BEP 15) after the action and transaction_id, the compact size bounds
+ * it.
+ */
+
+size_t announce_size (uint32_t, uint8_t, uint8_t);
+size_t announce_write (char *, swarm_view_t *, uint32_t, uint32_t, uint32_t,
+		int32_t, uint8_t, uint8_t);
+size_t announce_write_udp (char *, swarm_view_t *, uint32_t, uint32_t, uint32_t,
+		int32_t);
+
+#endif /* __ANNOUNCE_H__ */
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "logger.h"
+
+#define ARENA_ALIGN 8
+
+struct __arena_block_type {
+	arena_block_t *next;
+	char data[];
+};
+
+static size_t arena_bytes = 0;
+static arena_t *arenas = NULL;
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread arena_t *thread_arena = NULL;
+
+void *
+arena_alloc (arena_t *a, size_t size)
+{
+	arena_block_t *b;
+	void *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+	if (a->size - a->used >= size) {
+		ptr = a->buf + a->used;
+		a->used += size;
+		return ptr;
+	}
+
+	// Does not fit, spill over into a heap block.
+	b = (arena_block_t *) malloc (sizeof (arena_block_t) + size);
+	if (b == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	b->next = a->blocks;
+	a->blocks = b;
+	a->spilled += size;
+
+	return b->data;
+}
+
+void
+arena_fin (void)
+{
+	arena_t *a;
+
+	pthread_mutex_lock (&arenas_lock);
+	if (arenas != NULL)
+		logger (LOG_INFO, "INFO: arena high-water mark %zu bytes, "
+				"%" PRIu64 " overflows.\n", arena_high_water (),
+				arena_overflows ());
+
+	while (arenas != NULL) {
+		a = arenas;
+		arenas = a->next;
+		arena_reset (a);
+		free (a);
+	}
+
+	pthread_mutex_unlock (&arenas_lock);
+
+	return;
+}
+
+arena_t *
+arena_get (void)
+{
+	arena_t *a;
+
+	if (thread_arena != NULL)
+		return thread_arena;
+
+	a = (arena_t *) malloc (sizeof (arena_t) + arena_bytes);
+	if (a == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	memset (a, 0, sizeof (arena_t));
+	a->buf = (char *) (a + 1);
+	a->size = arena_bytes;
+	pthread_mutex_lock (&arenas_lock);
+	a->next = arenas;
+	__atomic_store_n (&arenas, a, __ATOMIC_RELEASE);
+	pthread_mutex_unlock (&arenas_lock);
+	thread_arena = a;
+
+	return a;
+}
+
+size_t
+arena_high_water (void)
+{
+	arena_t *a;
+	size_t high = 0;
+
+	for (a = __atomic_load_n (&arenas, __ATOMIC_ACQUIRE); a != NULL;
+			a = a->next) {
+		if (a->high > high)
+			high = a->high;
+	}
+
+	return high;
+}
+
+int
+arena_init (size_t size)
+{
+	arena_bytes = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+	return 0;
+}
+
+uint64_t
+arena_overflows (void)
+{
+	arena_t *a;
+	uint64_t overflows = 0;
+
+	for (a = __atomic_load_n (&arenas, __ATOMIC_ACQUIRE); a != NULL;
+			a = a->next)
+		overflows += a->overflows;
+
+	return overflows;
+}
+
+void
+arena_reset (arena_t *a)
+{
+	arena_block_t *b;
+
+	if (a->used + a->spilled > a->high)
+		a->high = a->used + a->spilled;
+
+	if (a->blocks != NULL)
+		a->overflows++;
+
+	while (a->blocks != NULL) {
+		b = a->blocks;
+		a->blocks = b->next;
+		free (b);
+	}
+
+	a->used = 0;
+	a->spilled = 0;
+
+	return;
+}
+
+char *
+arena_strdup (arena_t *a, const char *str)
+{
+	size_t len;
+	char *s;
+
+	len = strlen (str) + 1;
+	s = (char *) arena_alloc (a, len);
+	if (s != NULL)
+		memcpy (s, str, len);
+
+	return s;
+}
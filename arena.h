@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * Per-thread bump allocator for request processing.
+ *
+ * Every thread gets one arena of arena_size bytes the first time it calls
+ * arena_get ().  Allocations bump a pointer and are released all at once
+ * by arena_reset () at the end of the request, so the tracker's own work
+ * on a request that fits in the arena makes no heap calls.  Requests that
+ * do not fit spill into heap blocks which are freed on reset and counted
+ * as overflows.
+ *
+ * libmicrohttpd still allocates for every reply that is not one of the
+ * shared fixed replies: the MHD_Response, the copy of the body taken out
+ * of the arena and, for each of the headers add_headers () sets, the
+ * header entry with copies of its name and value.  The native front end
+ * keeps its output buffer across requests and makes none of these.
+ *
+ * The largest amount any single request needed is kept as the arena's
+ * high-water mark, use it to size arena_size.
+ */
+
+typedef struct __arena_block_type arena_block_t;
+typedef struct __arena_type arena_t;
+
+struct __arena_type {
+	char *buf;
+	size_t size;
+	size_t used;
+	size_t spilled;
+	size_t high;
+	uint64_t overflows;
+	arena_block_t *blocks;
+	arena_t *next;
+};
+
+void *arena_alloc (arena_t *, size_t);
+void arena_fin (void);
+arena_t *arena_get (void);
+size_t arena_high_water (void);
+int arena_init (size_t);
+uint64_t arena_overflows (void);
+void arena_reset (arena_t *);
+char *arena_strdup (arena_t *, const char *);
+
+#endif /* __ARENA_H__ */
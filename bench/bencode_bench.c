@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Compares benc_encode () against the streaming benc_writer_t for the
+ * dictionary form of an announce response with 50, 200 and 1000 peers.
+ * Both encoders must produce identical output.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "../bencode.h"
+
+#define ITERATIONS 2000
+#define MAX_PEERS 1000
+
+static char ips[MAX_PEERS][16];
+static char peer_ids[MAX_PEERS][21];
+
+static benc_data_t *build_tree (uint32_t);
+static inline benc_data_t *new_int (int64_t);
+static inline benc_data_t *new_str (const char *);
+static inline double now (void);
+static size_t write_stream (benc_writer_t *, uint32_t);
+
+int
+main (void)
+{
+	uint32_t counts[] = {50, 200, 1000};
+	benc_data_t *bd;
+	benc_writer_t w;
+	double t_tree, t_buf, t_grow, t;
+	size_t len = 0;
+	char *buf, *str;
+	uint32_t i, j;
+
+	for (i = 0; i < MAX_PEERS; i++) {
+		sprintf (ips[i], "10.%u.%u.%u", (i >> 16) & 0xff,
+				(i >> 8) & 0xff, i & 0xff);
+		sprintf (peer_ids[i], "-TR2920-%012" PRIu32, i);
+	}
+
+	printf ("%8s %14s %14s %14s\n", "peers", "benc_encode", "writer/buf",
+			"writer/grow");
+	for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+		// benc_encode: build the tree, encode it and free both.
+		t = now ();
+		for (j = 0; j < ITERATIONS; j++) {
+			bd = build_tree (counts[i]);
+			str = benc_encode (bd);
+			if (j == 0)
+				len = strlen (str);
+
+			free_benc_data (bd);
+			if (j < ITERATIONS - 1)
+				free (str);
+		}
+
+		t_tree = (now () - t) / ITERATIONS;
+
+		// Writer over a caller owned buffer.
+		buf = (char *) malloc (len);
+		t = now ();
+		for (j = 0; j < ITERATIONS; j++) {
+			benc_writer_init (&w, buf, len);
+			write_stream (&w, counts[i]);
+		}
+
+		t_buf = (now () - t) / ITERATIONS;
+		if ((benc_writer_error (&w) != 0) || (w.len != len)
+				|| (memcmp (buf, str, len) != 0)) {
+			printf ("ERROR: output mismatch for %" PRIu32
+					" peers.\n", counts[i]);
+			return EXIT_FAILURE;
+		}
+
+		// Writer over a growable buffer, freed every time.
+		t = now ();
+		for (j = 0; j < ITERATIONS; j++) {
+			benc_writer_init (&w, NULL, 0);
+			write_stream (&w, counts[i]);
+			benc_writer_fin (&w);
+		}
+
+		t_grow = (now () - t) / ITERATIONS;
+		printf ("%8" PRIu32 " %11.1f us %11.1f us %11.1f us\n",
+				counts[i], t_tree * 1e6, t_buf * 1e6,
+				t_grow * 1e6);
+		free (buf);
+		free (str);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static benc_data_t *
+build_tree (uint32_t n)
+{
+	benc_data_t *bd, *peer, *peers;
+	benc_dict_t *d;
+	uint32_t i;
+
+	peers = new_benc_data (BENC_TYPE_LST);
+	peers->data.l = (benc_data_t **) malloc (sizeof (benc_data_t *)
+			* (n + 1));
+	for (i = 0; i < n; i++) {
+		d = (benc_dict_t *) malloc (sizeof (benc_dict_t) * 4);
+		d[0].key = strdup ("ip");
+		d[0].val = new_str (ips[i]);
+		d[1].key = strdup ("peer id");
+		d[1].val = new_str (peer_ids[i]);
+		d[2].key = strdup ("port");
+		d[2].val = new_int (6881 + i % 1000);
+		d[3].val = NULL;
+		peer = new_benc_data (BENC_TYPE_DCT);
+		peer->data.d = d;
+		peers->data.l[i] = peer;
+	}
+
+	peers->data.l[n] = NULL;
+	d = (benc_dict_t *) malloc (sizeof (benc_dict_t) * 3);
+	d[0].key = strdup ("interval");
+	d[0].val = new_int (1800);
+	d[1].key = strdup ("peers");
+	d[1].val = peers;
+	d[2].val = NULL;
+	bd = new_benc_data (BENC_TYPE_DCT);
+	bd->data.d = d;
+
+	return bd;
+}
+
+static inline benc_data_t *
+new_int (int64_t i)
+{
+	benc_data_t *bd;
+
+	bd = new_benc_data (BENC_TYPE_INT);
+	bd->data.i = i;
+
+	return bd;
+}
+
+static inline benc_data_t *
+new_str (const char *s)
+{
+	benc_data_t *bd;
+
+	bd = new_benc_data (BENC_TYPE_STR);
+	bd->data.s = strdup (s);
+
+	return bd;
+}
+
+static inline double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t
+write_stream (benc_writer_t *w, uint32_t n)
+{
+	uint32_t i;
+
+	benc_write_dict (w);
+	benc_write_str (w, "interval", 8);
+	benc_write_int (w, 1800);
+	benc_write_str (w, "peers", 5);
+	benc_write_list (w);
+	for (i = 0; i < n; i++) {
+		benc_write_dict (w);
+		benc_write_str (w, "ip", 2);
+		benc_write_str (w, ips[i], strlen (ips[i]));
+		benc_write_str (w, "peer id", 7);
+		benc_write_str (w, peer_ids[i], 20);
+		benc_write_str (w, "port", 4);
+		benc_write_int (w, 6881 + i % 1000);
+		benc_write_end (w);
+	}
+
+	benc_write_end (w);
+	benc_write_end (w);
+
+	return w->len;
+}
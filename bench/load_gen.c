@@ -0,0 +1,769 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Closed loop announce load against a running tmst.  Every keep-alive
+ * connection sends an announce, waits for the reply and sends the next.
+ * Torrents are picked by a Zipfian popularity and peers at random among
+ * the peers of a torrent, a quarter of them seeders.  The info_hashes and
+ * passkeys are those of db_backend synthetic, see synth.h, so the tracker
+ * needs no database.
+ *
+ *   -a <ip>        tracker address, 127.0.0.1
+ *   -p <port>      tracker port, 30404
+ *   -c <conns>     connections, 1000
+ *   -j <threads>   client threads, 4
+ *   -w <seconds>   warm up before measuring, 2
+ *   -d <seconds>   measured run, 10
+ *   -t <torrents>  torrents, 10000
+ *   -n <peers>     peers per torrent, 50
+ *   -u <users>     users, 1000
+ *   -z <s>         Zipf exponent, 1.0
+ *   -e <mix>       started:none:completed:stopped weights, 10:80:5:5
+ *   -W <numwant>   peers asked for, 50
+ *   -s <pid>       tmst's pid, to report its resident set size
+ *   -k             instead of the load, send one announce and check that
+ *                  the idle timeout its Keep-Alive header advertises is
+ *                  the one the tracker enforces
+ *
+ * Latencies are kept in log-linear buckets, four to every power of two, so
+ * percentiles are upper bounds at most 25% off.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "../synth.h"
+
+#define LOAD_IN_MAX 16384
+#define LOAD_OUT_MAX 512
+#define LOAD_EVENTS 256
+#define LOAD_SUB_BITS 2
+#define LOAD_SUB (1U << LOAD_SUB_BITS)
+#define LOAD_NS_MAX (1ULL << 34)
+#define LOAD_BUCKETS ((34 - LOAD_SUB_BITS + 1) * LOAD_SUB)
+// How much later than advertised an idle connection may be closed.
+#define LOAD_KEEP_ALIVE_SLACK 2
+
+enum LOAD_EVENT {
+	LOAD_STARTED = 0,
+	LOAD_NONE,
+	LOAD_COMPLETED,
+	LOAD_STOPPED,
+	LOAD_EVENTS_MAX
+};
+
+typedef struct __load_conn_type {
+	int fd;
+	uint64_t sent;
+	size_t in_len;
+	size_t out_len;
+	size_t out_pos;
+	char in[LOAD_IN_MAX];
+	char out[LOAD_OUT_MAX];
+} load_conn_t;
+
+typedef struct __load_thread_type {
+	pthread_t thread;
+	int epfd;
+	uint32_t first;
+	uint32_t count;
+	uint64_t rand;
+	uint64_t requests;
+	uint64_t failures;
+	uint64_t errors;
+	uint64_t bytes;
+	uint64_t buckets[LOAD_BUCKETS];
+} __attribute__ ((aligned (64))) load_thread_t;
+
+static inline uint32_t bucket (uint64_t);
+static inline uint64_t bucket_upper (uint32_t);
+static int conn_open (load_thread_t *, load_conn_t *);
+static int conn_read (load_thread_t *, load_conn_t *);
+static int conn_write (load_thread_t *, load_conn_t *);
+static int keep_alive (void);
+static void next_request (load_thread_t *, load_conn_t *);
+static inline uint64_t now_ns (void);
+static inline uint32_t pick (load_thread_t *);
+static inline uint64_t rand_next (load_thread_t *);
+static void report (double);
+static long rss_kb (const char *);
+static void *worker (void *);
+
+static const char *event_args[LOAD_EVENTS_MAX] = {
+	[LOAD_STARTED] = "&event=started",
+	[LOAD_NONE] = "",
+	[LOAD_COMPLETED] = "&event=completed",
+	[LOAD_STOPPED] = "&event=stopped"
+};
+
+static struct sockaddr_in addr;
+static uint32_t conns = 1000;
+static uint32_t threads = 4;
+static uint32_t warmup = 2;
+static uint32_t duration = 10;
+static uint32_t torrents = 10000;
+static uint32_t peers = 50;
+static uint32_t users = 1000;
+static double zipf = 1.0;
+static uint32_t mix[LOAD_EVENTS_MAX] = {10, 80, 5, 5};
+static uint32_t mix_sum = 100;
+static uint32_t numwant = 50;
+static pid_t server = 0;
+static int check_keep_alive = 0;
+
+static double *cdf = NULL;
+static load_conn_t *conn_list = NULL;
+static load_thread_t *thread_list = NULL;
+static int measuring = 0;
+static int stop = 0;
+
+int
+main (int argc, char *argv[])
+{
+	const char *ip = "127.0.0.1";
+	long rss_before = -1, rss_after, hwm;
+	uint64_t start;
+	double sum = 0, secs;
+	uint32_t i;
+	int c, port = 30404;
+
+	while ((c = getopt (argc, argv, "a:p:c:j:w:d:t:n:u:z:e:W:s:k")) != -1) {
+		switch (c) {
+			case 'a':
+				ip = optarg;
+				break;
+
+			case 'p':
+				port = atoi (optarg);
+				break;
+
+			case 'c':
+				conns = (uint32_t) strtoul (optarg, NULL, 10);
+				break;
+
+			case 'j':
+				threads = (uint32_t) strtoul (optarg, NULL,
+						10);
+				break;
+
+			case 'w':
+				warmup = (uint32_t) strtoul (optarg, NULL, 10);
+				break;
+
+			case 'd':
+				duration = (uint32_t) strtoul (optarg, NULL,
+						10);
+				break;
+
+			case 't':
+				torrents = (uint32_t) strtoul (optarg, NULL,
+						10);
+				break;
+
+			case 'n':
+				peers = (uint32_t) strtoul (optarg, NULL, 10);
+				break;
+
+			case 'u':
+				users = (uint32_t) strtoul (optarg, NULL, 10);
+				break;
+
+			case 'z':
+				zipf = strtod (optarg, NULL);
+				break;
+
+			case 'e':
+				if (sscanf (optarg, "%" SCNu32 ":%" SCNu32
+							":%" SCNu32 ":%" SCNu32,
+							&mix[0], &mix[1],
+							&mix[2], &mix[3]) != 4)
+					goto usage;
+
+				break;
+
+			case 'W':
+				numwant = (uint32_t) strtoul (optarg, NULL,
+						10);
+				break;
+
+			case 's':
+				server = (pid_t) atoi (optarg);
+				break;
+
+			case 'k':
+				check_keep_alive = 1;
+				break;
+
+			default:
+				goto usage;
+		}
+	}
+
+	mix_sum = mix[0] + mix[1] + mix[2] + mix[3];
+	if ((conns == 0) || (threads == 0) || (threads > conns)
+			|| (torrents == 0) || (peers == 0) || (users == 0)
+			|| (duration == 0) || (mix_sum == 0))
+		goto usage;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons ((uint16_t) port);
+	if (inet_pton (AF_INET, ip, &addr.sin_addr) != 1)
+		goto usage;
+
+	signal (SIGPIPE, SIG_IGN);
+	cdf = (double *) malloc (torrents * sizeof (double));
+	conn_list = (load_conn_t *) calloc (conns, sizeof (load_conn_t));
+	thread_list = (load_thread_t *) calloc (threads,
+			sizeof (load_thread_t));
+	if ((cdf == NULL) || (conn_list == NULL) || (thread_list == NULL)) {
+		printf ("ERROR: out-of-memory.\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < torrents; i++) {
+		sum += 1.0 / pow (i + 1, zipf);
+		cdf[i] = sum;
+	}
+
+	for (i = 0; i < torrents; i++)
+		cdf[i] /= sum;
+
+	if (check_keep_alive != 0)
+		return (keep_alive () == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	for (i = 0; i < threads; i++) {
+		thread_list[i].first = (uint32_t) ((uint64_t) conns * i
+				/ threads);
+		thread_list[i].count = (uint32_t) ((uint64_t) conns * (i + 1)
+				/ threads) - thread_list[i].first;
+		thread_list[i].rand = synth_mix (i + 1);
+		if (pthread_create (&thread_list[i].thread, NULL, worker,
+					&thread_list[i]) != 0) {
+			printf ("ERROR: unable to start thread.\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	sleep (warmup);
+	if (server != 0)
+		rss_before = rss_kb ("VmRSS:");
+
+	start = now_ns ();
+	__atomic_store_n (&measuring, 1, __ATOMIC_RELEASE);
+	sleep (duration);
+	__atomic_store_n (&measuring, 0, __ATOMIC_RELEASE);
+	secs = (now_ns () - start) / 1e9;
+	__atomic_store_n (&stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < threads; i++)
+		pthread_join (thread_list[i].thread, NULL);
+
+	printf ("load_gen: %" PRIu32 " connections, %" PRIu32 " threads, %"
+			PRIu32 " torrents x %" PRIu32 " peers, %" PRIu32
+			" users, zipf %.2f, events %" PRIu32 ":%" PRIu32 ":%"
+			PRIu32 ":%" PRIu32 ", numwant %" PRIu32 "\n", conns,
+			threads, torrents, peers, users, zipf, mix[0], mix[1],
+			mix[2], mix[3], numwant);
+	report (secs);
+	if (server != 0) {
+		rss_after = rss_kb ("VmRSS:");
+		hwm = rss_kb ("VmHWM:");
+		printf ("%-12s %ld kB before, %ld kB after, %ld kB peak\n",
+				"server rss", rss_before, rss_after, hwm);
+	}
+
+	for (i = 0; i < conns; i++) {
+		if (conn_list[i].fd >= 0)
+			close (conn_list[i].fd);
+	}
+
+	for (i = 0; i < threads; i++) {
+		if (thread_list[i].errors != 0)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+
+usage:
+	printf ("usage: %s [-a ip] [-p port] [-c conns] [-j threads] "
+			"[-w seconds] [-d seconds] [-t torrents] [-n peers] "
+			"[-u users] [-z s] [-e started:none:completed:stopped]"
+			" [-W numwant] [-s pid] [-k]\n", argv[0]);
+
+	return EXIT_FAILURE;
+}
+
+// Same layout as the tracker's own histograms, see metrics.c.
+static inline uint32_t
+bucket (uint64_t ns)
+{
+	uint32_t shift;
+
+	if (ns >= LOAD_NS_MAX)
+		ns = LOAD_NS_MAX - 1;
+
+	if (ns < LOAD_SUB)
+		return (uint32_t) ns;
+
+	shift = 63 - (uint32_t) __builtin_clzll (ns) - LOAD_SUB_BITS;
+
+	return shift * LOAD_SUB + (uint32_t) (ns >> shift);
+}
+
+static inline uint64_t
+bucket_upper (uint32_t b)
+{
+	uint32_t shift;
+
+	if (b < LOAD_SUB)
+		return b;
+
+	shift = b / LOAD_SUB - 1;
+
+	return ((uint64_t) (b - shift * LOAD_SUB + 1) << shift) - 1;
+}
+
+static int
+conn_open (load_thread_t *lt, load_conn_t *lc)
+{
+	struct epoll_event ev;
+	int on = 1;
+
+	lc->fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			0);
+	if (lc->fd < 0)
+		return -1;
+
+	setsockopt (lc->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on));
+	if ((connect (lc->fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
+			&& (errno != EINPROGRESS)) {
+		close (lc->fd);
+		lc->fd = -1;
+		return -1;
+	}
+
+	lc->in_len = 0;
+	next_request (lt, lc);
+	ev.events = EPOLLOUT;
+	ev.data.ptr = lc;
+	if (epoll_ctl (lt->epfd, EPOLL_CTL_ADD, lc->fd, &ev) != 0) {
+		close (lc->fd);
+		lc->fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Reads what the tracker sent, once a whole reply is in it is checked and
+ * counted and the next request is sent.  Returns -1 if the connection has
+ * to be opened again.
+ */
+static int
+conn_read (load_thread_t *lt, load_conn_t *lc)
+{
+	char *body, *p;
+	size_t head, len;
+	ssize_t n;
+
+	while (1) {
+		n = recv (lc->fd, lc->in + lc->in_len, LOAD_IN_MAX - 1
+				- lc->in_len, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return 0;
+
+			return -1;
+		}
+
+		if (n == 0)
+			return -1;
+
+		lc->in_len += (size_t) n;
+		lc->in[lc->in_len] = '\0';
+		body = strstr (lc->in, "\r\n\r\n");
+		if (body == NULL) {
+			if (lc->in_len == LOAD_IN_MAX - 1)
+				return -1;
+
+			continue;
+		}
+
+		body += 4;
+		head = (size_t) (body - lc->in);
+		p = strcasestr (lc->in, "\r\nContent-Length:");
+		if ((p == NULL) || (p > body))
+			return -1;
+
+		len = strtoul (p + 17, NULL, 10);
+		if (head + len > LOAD_IN_MAX - 1)
+			return -1;
+
+		if (lc->in_len < head + len)
+			continue;
+
+		if (__atomic_load_n (&measuring, __ATOMIC_ACQUIRE) != 0) {
+			lt->buckets[bucket (now_ns () - lc->sent)]++;
+			lt->requests++;
+			lt->bytes += head + len;
+			if (strncmp (lc->in + 8, " 200 ", 5) != 0)
+				lt->errors++;
+			else if (memmem (body, len, "failure reason", 14)
+					!= NULL)
+				lt->failures++;
+		}
+
+		// Nothing else was asked for, anything left over is garbage.
+		if (lc->in_len != head + len)
+			return -1;
+
+		lc->in_len = 0;
+		next_request (lt, lc);
+
+		return conn_write (lt, lc);
+	}
+}
+
+static int
+conn_write (load_thread_t *lt, load_conn_t *lc)
+{
+	struct epoll_event ev;
+	ssize_t n;
+
+	while (lc->out_pos < lc->out_len) {
+		n = send (lc->fd, lc->out + lc->out_pos, lc->out_len
+				- lc->out_pos, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				return -1;
+
+			ev.events = EPOLLOUT;
+			ev.data.ptr = lc;
+
+			return epoll_ctl (lt->epfd, EPOLL_CTL_MOD, lc->fd, &ev);
+		}
+
+		lc->out_pos += (size_t) n;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = lc;
+
+	return epoll_ctl (lt->epfd, EPOLL_CTL_MOD, lc->fd, &ev);
+}
+
+/*
+ * Sends one announce, reads the reply and waits for the tracker to close
+ * the idle connection.  Returns 0 if it did so no sooner than the
+ * Keep-Alive header advertised and at most LOAD_KEEP_ALIVE_SLACK seconds
+ * later.
+ */
+static int
+keep_alive (void)
+{
+	load_conn_t *lc = &conn_list[0];
+	load_thread_t lt;
+	struct timeval tv;
+	unsigned long timeout;
+	uint64_t start;
+	double idle;
+	char *body, *p;
+	ssize_t n;
+
+	memset (&lt, 0, sizeof (lt));
+	lt.rand = synth_mix (1);
+	lc->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((lc->fd < 0) || (connect (lc->fd, (struct sockaddr *) &addr,
+					sizeof (addr)) != 0)) {
+		printf ("ERROR: unable to connect: %s.\n", strerror (errno));
+		return -1;
+	}
+
+	next_request (&lt, lc);
+	if (send (lc->fd, lc->out, lc->out_len, MSG_NOSIGNAL)
+			!= (ssize_t) lc->out_len) {
+		printf ("ERROR: unable to send the announce.\n");
+		return -1;
+	}
+
+	// The whole reply fits, nothing follows its header but the body.
+	lc->in_len = 0;
+	body = NULL;
+	while (body == NULL) {
+		n = recv (lc->fd, lc->in + lc->in_len, LOAD_IN_MAX - 1
+				- lc->in_len, 0);
+		if (n <= 0) {
+			printf ("ERROR: no reply to the announce.\n");
+			return -1;
+		}
+
+		lc->in_len += (size_t) n;
+		lc->in[lc->in_len] = '\0';
+		body = strstr (lc->in, "\r\n\r\n");
+	}
+
+	p = strcasestr (lc->in, "\r\nKeep-Alive:");
+	if ((p == NULL) || (p > body) || (sscanf (p + 13, " timeout=%lu",
+					&timeout) != 1)) {
+		printf ("ERROR: the reply advertises no Keep-Alive "
+				"timeout.\n");
+		return -1;
+	}
+
+	// Drain the body, then wait for the close.
+	start = now_ns ();
+	tv.tv_sec = (time_t) (timeout + LOAD_KEEP_ALIVE_SLACK + 1);
+	tv.tv_usec = 0;
+	setsockopt (lc->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+	do {
+		n = recv (lc->fd, lc->in, LOAD_IN_MAX - 1, 0);
+		if (n > 0)
+			start = now_ns ();
+	} while (n > 0);
+
+	idle = (now_ns () - start) / 1e9;
+	close (lc->fd);
+	lc->fd = -1;
+	printf ("%-12s timeout=%lu advertised, ", "keep-alive", timeout);
+	if (n < 0) {
+		printf ("still open after %.1f s idle\n", idle);
+		return -1;
+	}
+
+	printf ("closed after %.1f s idle\n", idle);
+	if ((idle < timeout) || (idle > timeout + LOAD_KEEP_ALIVE_SLACK))
+		return -1;
+
+	return 0;
+}
+
+// Builds the announce of a random peer of a Zipfian picked torrent.
+static void
+next_request (load_thread_t *lt, load_conn_t *lc)
+{
+	uint8_t info_hash[INFO_HASH_LEN], peer_id[PEER_ID_LEN];
+	char passkey[PASSKEY_LEN + 1], *p;
+	uint64_t h;
+	uint32_t e, i, peer, r, torrent;
+
+	torrent = pick (lt) + 1;
+	peer = (uint32_t) (rand_next (lt) % peers);
+	r = (uint32_t) (rand_next (lt) % mix_sum);
+	for (e = 0; r >= mix[e]; e++)
+		r -= mix[e];
+
+	synth_info_hash (torrent, info_hash);
+	synth_passkey ((uint32_t) (((uint64_t) torrent * peers + peer)
+				% users) + 1, passkey);
+	h = synth_mix ((uint64_t) torrent << 32 | peer);
+	memcpy (peer_id, "-LG0001-", 8);
+	memcpy (peer_id + 8, &h, 8);
+	memcpy (peer_id + 16, &torrent, 4);
+	p = lc->out;
+	p += sprintf (p, "GET /%s/announce?info_hash=", passkey);
+	for (i = 0; i < INFO_HASH_LEN; i++)
+		p += sprintf (p, "%%%02x", info_hash[i]);
+
+	p += sprintf (p, "&peer_id=");
+	for (i = 0; i < PEER_ID_LEN; i++)
+		p += sprintf (p, "%%%02x", peer_id[i]);
+
+	p += sprintf (p, "&port=%" PRIu32 "&uploaded=0&downloaded=0&left=%s"
+			"%s&compact=1&numwant=%" PRIu32 " HTTP/1.1\r\n"
+			"Host: tracker\r\n\r\n", 1024 + peer % 64512,
+			(peer % 4 == 0) ? "0" : "1073741824", event_args[e],
+			numwant);
+	lc->out_len = (size_t) (p - lc->out);
+	lc->out_pos = 0;
+	lc->sent = now_ns ();
+
+	return;
+}
+
+static inline uint64_t
+now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Draws a torrent from the Zipfian distribution.
+static inline uint32_t
+pick (load_thread_t *lt)
+{
+	uint32_t hi = torrents - 1, lo = 0, mid;
+	double u;
+
+	u = (double) (rand_next (lt) >> 11) / (double) (1ULL << 53);
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static inline uint64_t
+rand_next (load_thread_t *lt)
+{
+	uint64_t x = lt->rand;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	lt->rand = x;
+
+	return x;
+}
+
+static void
+report (double secs)
+{
+	double p[] = {0.5, 0.9, 0.99, 0.999};
+	const char *names[] = {"p50", "p90", "p99", "p99.9"};
+	uint64_t buckets[LOAD_BUCKETS], bytes = 0, errors = 0, failures = 0,
+		 n = 0, seen;
+	uint32_t b, i, j;
+
+	memset (buckets, 0, sizeof (buckets));
+	for (i = 0; i < threads; i++) {
+		n += thread_list[i].requests;
+		failures += thread_list[i].failures;
+		errors += thread_list[i].errors;
+		bytes += thread_list[i].bytes;
+		for (b = 0; b < LOAD_BUCKETS; b++)
+			buckets[b] += thread_list[i].buckets[b];
+	}
+
+	printf ("%-12s %" PRIu64 "\n", "requests", n);
+	printf ("%-12s %" PRIu64 " failure replies\n", "failures", failures);
+	printf ("%-12s %" PRIu64 " bad replies or lost connections\n",
+			"errors", errors);
+	printf ("%-12s %.1f req/s, %.1f MB/s in\n", "throughput", n / secs,
+			bytes / secs / 1e6);
+	if (n == 0)
+		return;
+
+	printf ("%-12s", "latency us");
+	for (j = 0; j < 4; j++) {
+		seen = 0;
+		for (b = 0; b < LOAD_BUCKETS; b++) {
+			seen += buckets[b];
+			if (seen >= (uint64_t) ceil (p[j] * n))
+				break;
+		}
+
+		printf (" %s %.1f", names[j], bucket_upper (b) / 1e3);
+	}
+
+	b = LOAD_BUCKETS - 1;
+	while (buckets[b] == 0)
+		b--;
+
+	printf (" max %.1f\n", bucket_upper (b) / 1e3);
+
+	return;
+}
+
+// Returns a kB line of the server's /proc status, -1 if it can't be read.
+static long
+rss_kb (const char *key)
+{
+	char line[256], path[64];
+	long kb = -1;
+	FILE *fp;
+
+	snprintf (path, sizeof (path), "/proc/%d/status", (int) server);
+	fp = fopen (path, "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets (line, sizeof (line), fp) != NULL) {
+		if (strncmp (line, key, strlen (key)) == 0) {
+			kb = strtol (line + strlen (key), NULL, 10);
+			break;
+		}
+	}
+
+	fclose (fp);
+
+	return kb;
+}
+
+static void *
+worker (void *arg)
+{
+	load_thread_t *lt = (load_thread_t *) arg;
+	struct epoll_event events[LOAD_EVENTS];
+	load_conn_t *lc;
+	uint32_t i;
+	int n, rc;
+
+	lt->epfd = epoll_create1 (EPOLL_CLOEXEC);
+	if (lt->epfd < 0) {
+		lt->errors++;
+		return NULL;
+	}
+
+	for (i = 0; i < lt->count; i++) {
+		if (conn_open (lt, &conn_list[lt->first + i]) != 0)
+			lt->errors++;
+	}
+
+	while (__atomic_load_n (&stop, __ATOMIC_ACQUIRE) == 0) {
+		n = epoll_wait (lt->epfd, events, LOAD_EVENTS, 100);
+		for (i = 0; i < (uint32_t) ((n > 0) ? n : 0); i++) {
+			lc = (load_conn_t *) events[i].data.ptr;
+			if ((events[i].events & (EPOLLERR | EPOLLHUP)) != 0)
+				rc = -1;
+			else if ((events[i].events & EPOLLIN) != 0)
+				rc = conn_read (lt, lc);
+			else
+				rc = conn_write (lt, lc);
+
+			if (rc == 0)
+				continue;
+
+			// Count the loss and start over on a new connection.
+			if (__atomic_load_n (&measuring, __ATOMIC_ACQUIRE) != 0)
+				lt->errors++;
+
+			close (lc->fd);
+			lc->fd = -1;
+			if (conn_open (lt, lc) != 0)
+				lt->errors++;
+		}
+	}
+
+	close (lt->epfd);
+
+	return NULL;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Cost of the debug logging on the announce path.  Every iteration parses
+ * an announce query and logs it the way print_announce_info () in http.c
+ * does, with LOG_DBG masked out at run time:
+ *
+ *   eager     arguments evaluated and the level checked in a call, like
+ *             logger () used to
+ *   runtime   debug () with every level compiled in
+ *   compiled  debug () built with LOG_COMPILE_LEVEL=LOG_ERR
+ *   none      no logging at all
+ *
+ * Only the eager path may format the hex dumps.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+#include "../logger.h"
+#include "../query.h"
+
+#define ITERATIONS 1000000
+#define ROUNDS 5
+
+FILE *log_fp = NULL;
+uint8_t log_level = LOG_ERR;
+
+static const char query[] = "info_hash=%12%34%56%78%9a%bc%de%f0%12%34%56"
+	"%78%9a%bc%de%f0%12%34%56%78&peer_id=-TR2940-k8hj0wgej6ch&port=51413"
+	"&uploaded=0&downloaded=0&left=1073741824&corrupt=0&key=1a2b3c4d"
+	"&event=started&numwant=80&compact=1&no_peer_id=1";
+static uint64_t hexed = 0;
+static volatile uint32_t sink;
+
+static inline void eager_logger (uint8_t, char *, ...);
+static const char *hex (const uint8_t *, size_t, char *);
+static inline double now (void);
+static double run (void (*) (void));
+static void path_compiled (void);
+static void path_eager (void);
+static void path_none (void);
+static void path_runtime (void);
+
+#define eager_debug(level, format, args...) do { \
+	eager_logger (level, "%s_%d, %s: " format, __FILE__, __LINE__, \
+			__FUNCTION__, ##args); \
+} while (0)
+
+#define no_debug(level, format, args...) do { \
+} while (0)
+
+#define ANNOUNCE_PATH(log) do { \
+	announce_info_t ai; \
+	char buf[2 * INFO_HASH_LEN + 1], ip[INET_ADDRSTRLEN]; \
+\
+	memset (&ai, 0, sizeof (ai)); \
+	ai.numwant = -1; \
+	announce_parse (&ai, query, sizeof (query) - 1); \
+	log (LOG_DBG, "announce info:\n"); \
+	log (LOG_DBG, "info_hash: %s\n", hex (ai.info_hash, INFO_HASH_LEN, \
+				buf)); \
+	log (LOG_DBG, "peer_id: %.8s %s\n", ai.peer_id, hex (ai.peer_id \
+				+ 8, PEER_ID_LEN - 8, buf)); \
+	log (LOG_DBG, "ip: %s\n", inet_ntop (AF_INET, &ai.ip, ip, \
+				sizeof (ip))); \
+	log (LOG_DBG, "port: %" PRIu16 "\n", ai.port); \
+	log (LOG_DBG, "uploaded: %" PRId64 "\n", ai.uploaded); \
+	log (LOG_DBG, "downloaded: %" PRId64 "\n", ai.downloaded); \
+	log (LOG_DBG, "left: %" PRId64 "\n", ai.left); \
+	log (LOG_DBG, "event: %" PRIu8 "\n", ai.event); \
+	log (LOG_DBG, "numwant: %" PRId32 "\n", ai.numwant); \
+	log (LOG_DBG, "key: %08" PRIx32 "\n", ai.key); \
+	sink = ai.port + ai.key + (uint32_t) ai.left; \
+	(void) buf; \
+	(void) ip; \
+} while (0)
+
+int
+main (void)
+{
+	struct {
+		const char *name;
+		void (*fn) (void);
+	} paths[] = {
+		{"eager", path_eager},
+		{"runtime", path_runtime},
+		{"compiled", path_compiled},
+		{"none", path_none}
+	};
+	double base, ns[4], t;
+	uint32_t i, j;
+
+	log_fp = stderr;
+	for (i = 0; i < 4; i++)
+		ns[i] = -1;
+
+	// Rounds take turns so drift hits every path alike, the best counts.
+	for (j = 0; j < ROUNDS; j++) {
+		for (i = 0; i < 4; i++) {
+			t = run (paths[i].fn);
+			if ((ns[i] < 0) || (t < ns[i]))
+				ns[i] = t;
+		}
+	}
+
+	if (hexed != 2 * (uint64_t) ITERATIONS * ROUNDS) {
+		printf ("ERROR: %" PRIu64 " hex dumps, the eager path alone "
+				"should have made %u.\n", hexed,
+				2 * ITERATIONS * ROUNDS);
+		return EXIT_FAILURE;
+	}
+
+	base = ns[3];
+	printf ("%10s %12s %12s\n", "path", "ns/announce", "logging ns");
+	for (i = 0; i < 4; i++)
+		printf ("%10s %12.1f %12.1f\n", paths[i].name, ns[i],
+				ns[i] - base);
+
+	return EXIT_SUCCESS;
+}
+
+// What logger () did before the level check moved in front of the call.
+static inline void
+eager_logger (uint8_t level, char *args, ...)
+{
+	va_list ap;
+
+	if ((level & log_level) == 0)
+		return;
+
+	va_start (ap, args);
+	vfprintf (log_fp, args, ap);
+	va_end (ap);
+	fflush (log_fp);
+
+	return;
+}
+
+static const char *
+hex (const uint8_t *p, size_t len, char *out)
+{
+	size_t i;
+
+	hexed++;
+	for (i = 0; i < len; i++)
+		sprintf (out + 2 * i, "%02hhx", p[i]);
+
+	out[2 * len] = '\0';
+
+	return out;
+}
+
+static inline double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the nanoseconds per iteration of fn.
+static double
+run (void (*fn) (void))
+{
+	double start;
+	uint32_t i;
+
+	start = now ();
+	for (i = 0; i < ITERATIONS; i++)
+		fn ();
+
+	return (now () - start) * 1e9 / ITERATIONS;
+}
+
+static void
+path_eager (void)
+{
+	ANNOUNCE_PATH (eager_debug);
+
+	return;
+}
+
+static void
+path_none (void)
+{
+	ANNOUNCE_PATH (no_debug);
+
+	return;
+}
+
+static void
+path_runtime (void)
+{
+	ANNOUNCE_PATH (debug);
+
+	return;
+}
+
+// As if built with make LOG_COMPILE_LEVEL=LOG_ERR.
+#undef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_ERR
+
+static void
+path_compiled (void)
+{
+	ANNOUNCE_PATH (debug);
+
+	return;
+}
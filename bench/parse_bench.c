@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Checks benc_parse (), benc_find () and benc_tok_int () against a table
+ * of valid and invalid inputs, every truncation of a nested value and too
+ * few tokens, then compares benc_parse () against bdecode () on the
+ * dictionary form of an announce response with 50, 200 and 1000 peers.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "../bencode.h"
+
+#define ITERATIONS 2000
+#define MAX_PEERS 1000
+// The response dictionary, 2 keys and values, then 7 tokens per peer.
+#define MAX_TOKENS (5 + MAX_PEERS * 7)
+
+typedef struct __parse_case_type {
+	const char *in;
+	int want;
+} parse_case_t;
+
+static const parse_case_t cases[] = {
+	{"i0e", 1},
+	{"i42e", 1},
+	{"i-42e", 1},
+	{"i-9223372036854775808e", 1},
+	{"i9223372036854775807e", 1},
+	{"0:", 1},
+	{"3:abc", 1},
+	{"le", 1},
+	{"de", 1},
+	{"d1:ad1:bli1ei-2ee1:c3:xyzee", 9},
+	{"i-0e", -1},
+	{"i03e", -1},
+	{"i-03e", -1},
+	{"03:abc", -1},
+	{"ie", -1},
+	{"i-e", -1},
+	{"i1", -1},
+	{"i9223372036854775808e", -1},
+	{"i-9223372036854775809e", -1},
+	{"i18446744073709551616e", -1},
+	{"4:abc", -1},
+	{"3abc", -1},
+	{"l", -1},
+	{"d1:ae", -1},
+	{"di1ei2ee", -1},
+	{"e", -1},
+	{"i1ei2e", -1},
+	{"x", -1},
+	{"", -1}
+};
+
+static char ips[MAX_PEERS][16];
+static char peer_ids[MAX_PEERS][21];
+static benc_tok_t toks[MAX_TOKENS];
+
+static int check_cases (void);
+static int check_depth (void);
+static int check_nested (void);
+static inline double now (void);
+static size_t write_response (benc_writer_t *, uint32_t);
+
+int
+main (void)
+{
+	uint32_t counts[] = {50, 200, 1000};
+	double t_parse, t_tree, t;
+	benc_writer_t w;
+	benc_data_t *bd;
+	uint32_t i, j;
+	size_t len;
+	char *str;
+	int n;
+
+	if ((check_cases () != 0) || (check_nested () != 0)
+			|| (check_depth () != 0))
+		return EXIT_FAILURE;
+
+	for (i = 0; i < MAX_PEERS; i++) {
+		sprintf (ips[i], "10.%u.%u.%u", (i >> 16) & 0xff,
+				(i >> 8) & 0xff, i & 0xff);
+		sprintf (peer_ids[i], "-TR2920-%012" PRIu32, i);
+	}
+
+	printf ("%8s %14s %14s\n", "peers", "bdecode", "benc_parse");
+	for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+		benc_writer_init (&w, NULL, 0);
+		write_response (&w, counts[i]);
+		if (benc_writer_error (&w) != 0) {
+			printf ("ERROR: out-of-memory.\n");
+			return EXIT_FAILURE;
+		}
+
+		// bdecode: build the tree and free it.
+		t = now ();
+		for (j = 0; j < ITERATIONS; j++) {
+			str = w.buf;
+			len = w.len;
+			bd = bdecode (&str, &len);
+			if (bd == NULL) {
+				printf ("ERROR: bdecode () failed for %" PRIu32
+						" peers.\n", counts[i]);
+				return EXIT_FAILURE;
+			}
+
+			free_benc_data (bd);
+		}
+
+		t_tree = (now () - t) / ITERATIONS;
+
+		// benc_parse: tokens only, nothing is allocated.
+		t = now ();
+		for (j = 0; j < ITERATIONS; j++)
+			n = benc_parse (w.buf, w.len, toks, MAX_TOKENS);
+
+		t_parse = (now () - t) / ITERATIONS;
+		if (n != (int) (5 + counts[i] * 7)) {
+			printf ("ERROR: benc_parse () returned %d for %" PRIu32
+					" peers.\n", n, counts[i]);
+			return EXIT_FAILURE;
+		}
+
+		printf ("%8" PRIu32 " %11.1f us %11.1f us\n", counts[i],
+				t_tree * 1e6, t_parse * 1e6);
+		benc_writer_fin (&w);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Every case must parse to the number of tokens it wants or fail, the
+ * integers must read back as written.
+ */
+static int
+check_cases (void)
+{
+	char buf[32];
+	int64_t val;
+	uint32_t i;
+	int n;
+
+	for (i = 0; i < sizeof (cases) / sizeof (cases[0]); i++) {
+		n = benc_parse (cases[i].in, strlen (cases[i].in), toks,
+				MAX_TOKENS);
+		if (n != cases[i].want) {
+			printf ("ERROR: \"%s\" parsed to %d, not %d.\n",
+					cases[i].in, n, cases[i].want);
+			return -1;
+		}
+
+		if ((n != 1) || (toks[0].type != BENC_TYPE_INT))
+			continue;
+
+		if (benc_tok_int (cases[i].in, &toks[0], &val) != 0) {
+			printf ("ERROR: \"%s\" does not read back.\n",
+					cases[i].in);
+			return -1;
+		}
+
+		snprintf (buf, sizeof (buf), "i%" PRId64 "e", val);
+		if (strcmp (buf, cases[i].in) != 0) {
+			printf ("ERROR: \"%s\" read back as %" PRId64 ".\n",
+					cases[i].in, val);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// BENC_MAX_DEPTH nested lists parse, one more does not.
+static int
+check_depth (void)
+{
+	char buf[2 * (BENC_MAX_DEPTH + 1)];
+	uint32_t d;
+	int n;
+
+	for (d = BENC_MAX_DEPTH; d <= BENC_MAX_DEPTH + 1; d++) {
+		memset (buf, 'l', d);
+		memset (buf + d, 'e', d);
+		n = benc_parse (buf, 2 * d, toks, MAX_TOKENS);
+		if (n != ((d == BENC_MAX_DEPTH) ? (int) d : -1)) {
+			printf ("ERROR: %" PRIu32 " nested lists parsed to "
+					"%d.\n", d, n);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Walks a nested value with benc_find (), then checks that every
+ * truncation of it fails and that one token too few is reported.
+ */
+static int
+check_nested (void)
+{
+	const char *in = "d1:ad1:bli1ei-2ee1:c3:xyzee";
+	size_t len = strlen (in), i;
+	int a, b, c;
+	int64_t val;
+
+	if (benc_parse (in, len, toks, MAX_TOKENS) != 9) {
+		printf ("ERROR: \"%s\" did not parse.\n", in);
+		return -1;
+	}
+
+	a = benc_find (in, toks, 0, "a", 1);
+	if ((a != 2) || (toks[a].type != BENC_TYPE_DCT)
+			|| (benc_find (in, toks, 0, "c", 1) != -1)) {
+		printf ("ERROR: benc_find () on the top dictionary.\n");
+		return -1;
+	}
+
+	b = benc_find (in, toks, (uint32_t) a, "b", 1);
+	c = benc_find (in, toks, (uint32_t) a, "c", 1);
+	if ((b != 4) || (toks[b].type != BENC_TYPE_LST)
+			|| (toks[b].skip != 7)
+			|| (toks[b].len != strlen ("li1ei-2ee"))
+			|| (benc_find (in, toks, (uint32_t) b, "b", 1) != -1)
+			|| (benc_tok_int (in, &toks[5], &val) != 0)
+			|| (val != 1)
+			|| (benc_tok_int (in, &toks[6], &val) != 0)
+			|| (val != -2)
+			|| (benc_tok_int (in, &toks[b], &val) != -1)
+			|| (c != 8) || (toks[c].len != 3)
+			|| (memcmp (in + toks[c].off, "xyz", 3) != 0)) {
+		printf ("ERROR: walking the nested dictionary.\n");
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (benc_parse (in, i, toks, MAX_TOKENS) != -1) {
+			printf ("ERROR: \"%.*s\" parsed.\n", (int) i, in);
+			return -1;
+		}
+	}
+
+	if ((benc_parse (in, len, toks, 8) != -2)
+			|| (benc_parse (in, len, toks, 0) != -2)) {
+		printf ("ERROR: running out of tokens is not reported.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static inline double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t
+write_response (benc_writer_t *w, uint32_t n)
+{
+	uint32_t i;
+
+	benc_write_dict (w);
+	benc_write_str (w, "interval", 8);
+	benc_write_int (w, 1800);
+	benc_write_str (w, "peers", 5);
+	benc_write_list (w);
+	for (i = 0; i < n; i++) {
+		benc_write_dict (w);
+		benc_write_str (w, "ip", 2);
+		benc_write_str (w, ips[i], strlen (ips[i]));
+		benc_write_str (w, "peer id", 7);
+		benc_write_str (w, peer_ids[i], 20);
+		benc_write_str (w, "port", 4);
+		benc_write_int (w, 6881 + i % 1000);
+		benc_write_end (w);
+	}
+
+	benc_write_end (w);
+	benc_write_end (w);
+
+	return w->len;
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Full scrape of 100000 torrents, streamed from the torrents and served
+ * from a snapshot, read in blocks of 65536 and of 1000 bytes.  Every reply
+ * must decode, hold every torrent with its counters and have its files
+ * sorted by info_hash.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "../bencode.h"
+#include "../epoch.h"
+#include "../event.h"
+#include "../logger.h"
+#include "../scrape.h"
+#include "../torrent.h"
+
+#define TORRENTS 100000
+#define ITERATIONS 10
+// Top dictionary, "files" and its dictionary, then 8 tokens per file.
+#define TOKENS (3 + TORRENTS * 8)
+
+FILE *log_fp = NULL;
+uint8_t log_level = LOG_ERR;
+uint32_t full_scrape_cache = 0;
+
+static benc_tok_t toks[TOKENS];
+
+static int check (const char *, size_t);
+static int check_file (const char *, uint32_t);
+static inline double now (void);
+static char *read_full (size_t, size_t *);
+
+int
+event_add (const char *name, uint32_t interval, event_task_t fn, void *cls)
+{
+	(void) name;
+	(void) interval;
+	(void) fn;
+	(void) cls;
+
+	return 0;
+}
+
+uint32_t
+event_now (void)
+{
+	return 0;
+}
+
+int
+main (void)
+{
+	uint32_t caches[] = {0, 60};
+	size_t blocks[] = {65536, 1000};
+	uint8_t info_hash[INFO_HASH_LEN];
+	size_t len;
+	torrent_t *t;
+	uint32_t i, j, x = 2463534242U;
+	double start;
+	char *buf;
+
+	log_fp = stderr;
+	epoch_init ();
+	if (torrent_init (TORRENTS, 1024) != 0)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < TORRENTS; i++) {
+		for (j = 0; j < INFO_HASH_LEN; j++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			info_hash[j] = (uint8_t) x;
+		}
+
+		t = torrent_insert (info_hash);
+		if (t == NULL)
+			return EXIT_FAILURE;
+
+		t->complete = i;
+		t->incomplete = i * 3;
+		t->downloaded = i * 7;
+	}
+
+	printf ("%8s %8s %10s %12s\n", "cache", "block", "bytes",
+			"ms/scrape");
+	for (i = 0; i < sizeof (caches) / sizeof (caches[0]); i++) {
+		full_scrape_cache = caches[i];
+		for (j = 0; j < sizeof (blocks) / sizeof (blocks[0]); j++) {
+			buf = read_full (blocks[j], &len);
+			if ((buf == NULL) || (check (buf, len) != 0))
+				return EXIT_FAILURE;
+
+			free (buf);
+			start = now ();
+			for (x = 0; x < ITERATIONS; x++) {
+				buf = read_full (blocks[j], &len);
+				if (buf == NULL)
+					return EXIT_FAILURE;
+
+				free (buf);
+			}
+
+			printf ("%8" PRIu32 " %8zu %10zu %12.2f\n",
+					caches[i], blocks[j], len,
+					(now () - start) * 1e3 / ITERATIONS);
+		}
+	}
+
+	scrape_fin ();
+	torrent_fin ();
+	epoch_fin ();
+
+	return EXIT_SUCCESS;
+}
+
+// Decodes a full scrape and checks its files.
+static int
+check (const char *buf, size_t len)
+{
+	int files, n;
+	uint32_t count = 0, i, prev = 0;
+
+	n = benc_parse (buf, len, toks, TOKENS);
+	if (n < 0) {
+		printf ("ERROR: full scrape is not valid bencode (%d).\n", n);
+		return -1;
+	}
+
+	files = benc_find (buf, toks, 0, "files", 5);
+	if ((files < 0) || (toks[files].type != BENC_TYPE_DCT)) {
+		printf ("ERROR: full scrape has no files dictionary.\n");
+		return -1;
+	}
+
+	for (i = (uint32_t) files + 1; i < toks[files].skip;
+			i = toks[i + 1].skip) {
+		if ((toks[i].len != INFO_HASH_LEN) || ((count > 0)
+					&& (memcmp (buf + toks[prev].off,
+							buf + toks[i].off,
+							INFO_HASH_LEN)
+						>= 0))) {
+			printf ("ERROR: file %" PRIu32 " is out of order.\n",
+					count);
+			return -1;
+		}
+
+		if (check_file (buf, i) != 0)
+			return -1;
+
+		prev = i;
+		count++;
+	}
+
+	if (count != TORRENTS) {
+		printf ("ERROR: full scrape has %" PRIu32 " of %u files.\n",
+				count, TORRENTS);
+		return -1;
+	}
+
+	return 0;
+}
+
+// The counters of the file keyed by token key must match its torrent.
+static int
+check_file (const char *buf, uint32_t key)
+{
+	const char *names[] = {"complete", "downloaded", "incomplete"};
+	uint32_t want[3];
+	int64_t val;
+	torrent_t *t;
+	uint32_t i;
+	int v;
+
+	t = torrent_lookup ((const uint8_t *) buf + toks[key].off);
+	if (t == NULL) {
+		printf ("ERROR: full scrape has an unknown info_hash.\n");
+		return -1;
+	}
+
+	torrent_counters (t, &want[0], &want[1], &want[2]);
+	for (i = 0; i < 3; i++) {
+		v = benc_find (buf, toks, key + 1, names[i],
+				strlen (names[i]));
+		if ((v < 0) || (benc_tok_int (buf, &toks[v], &val) != 0)
+				|| (val != want[i])) {
+			printf ("ERROR: %s of a file does not match its "
+					"torrent.\n", names[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static inline double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reads a whole full scrape block bytes at a time.
+static char *
+read_full (size_t block, size_t *len)
+{
+	scrape_full_t *fs;
+	size_t size = 1 << 20;
+	char *buf, *tmp;
+	ssize_t n;
+
+	fs = scrape_full_open ();
+	buf = (char *) malloc (size);
+	if ((fs == NULL) || (buf == NULL)) {
+		if (fs != NULL)
+			scrape_full_close (fs);
+
+		free (buf);
+		printf ("ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	*len = 0;
+	for (;;) {
+		if (size - *len < block) {
+			size *= 2;
+			tmp = (char *) realloc (buf, size);
+			if (tmp == NULL) {
+				scrape_full_close (fs);
+				free (buf);
+				printf ("ERROR: out-of-memory.\n");
+				return NULL;
+			}
+
+			buf = tmp;
+		}
+
+		n = scrape_full_read (fs, *len, buf + *len, block);
+		if (n < 0)
+			break;
+
+		*len += (size_t) n;
+	}
+
+	if ((scrape_full_size (fs) != UINT64_MAX)
+			&& (scrape_full_size (fs) != *len)) {
+		printf ("ERROR: full scrape is not the size it claims.\n");
+		scrape_full_close (fs);
+		free (buf);
+		return NULL;
+	}
+
+	scrape_full_close (fs);
+
+	return buf;
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Contention on the swarm store.  1 to 64 threads announce to and scrape
+ * torrents picked by a Zipfian popularity (s = 1), so a handful of torrents
+ * take most of the traffic, once with a single shard lock and once with
+ * the default 1024.  Announces update the swarm under the shard's lock
+ * and build a 50 peer compact list the way the tracker does, without it.
+ * Every torrent's counters must agree with its swarm afterwards.
+ */
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "../announce.h"
+#include "../epoch.h"
+#include "../event.h"
+#include "../logger.h"
+#include "../torrent.h"
+
+#define TORRENTS 100000
+#define PEERS 2000
+#define NUMWANT 50
+#define SAMPLE_TRIES 4
+#define MAX_THREADS 64
+#define RUN_SECONDS 0.5
+
+typedef struct __bench_thread_type {
+	pthread_t thread;
+	uint32_t rand;
+	uint64_t ops;
+	uint64_t locked;
+} __attribute__ ((aligned (64))) bench_thread_t;
+
+FILE *log_fp = NULL;
+uint8_t log_level = LOG_ERR;
+
+static torrent_t *torrents[TORRENTS];
+static double cdf[TORRENTS];
+static bench_thread_t threads[MAX_THREADS];
+static event_task_t reclaim = NULL;
+static volatile int stop = 0;
+
+static void announce (bench_thread_t *, torrent_t *, char *);
+static int check (void);
+static inline double now (void);
+static inline uint32_t pick (bench_thread_t *);
+static inline uint32_t rand_next (bench_thread_t *);
+static double run (uint32_t, uint32_t, uint64_t *);
+static void *worker (void *);
+
+// The reclaim task is run by hand instead of by the event loop.
+int
+event_add (const char *name, uint32_t interval, event_task_t fn, void *cls)
+{
+	(void) name;
+	(void) interval;
+	(void) cls;
+	reclaim = fn;
+
+	return 0;
+}
+
+uint32_t
+event_now (void)
+{
+	return 0;
+}
+
+int
+main (void)
+{
+	uint32_t counts[] = {1, 2, 4, 8, 16, 32, 64};
+	uint32_t shards[] = {1, 1024};
+	uint64_t locked;
+	double ops[2], sum = 0;
+	uint32_t i, j;
+
+	log_fp = stderr;
+	for (i = 0; i < TORRENTS; i++) {
+		sum += 1.0 / (i + 1);
+		cdf[i] = sum;
+	}
+
+	for (i = 0; i < TORRENTS; i++)
+		cdf[i] /= sum;
+
+	epoch_init ();
+	printf ("%8s %16s %16s %10s\n", "threads", "1 shard",
+			"1024 shards", "locked");
+	for (i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+		locked = 0;
+		for (j = 0; j < 2; j++) {
+			ops[j] = run (counts[i], shards[j], &locked);
+			if (ops[j] < 0)
+				return EXIT_FAILURE;
+		}
+
+		printf ("%8" PRIu32 " %10.2f Mop/s %10.2f Mop/s %10" PRIu64
+				"\n", counts[i], ops[0] / 1e6, ops[1] / 1e6,
+				locked);
+	}
+
+	epoch_fin ();
+
+	return EXIT_SUCCESS;
+}
+
+static void
+announce (bench_thread_t *bt, torrent_t *t, char *buf)
+{
+	announce_info_t ai;
+	swarm_view_t v;
+	int64_t down, up;
+	uint32_t p, seq, tries;
+	int32_t skip, slot;
+
+	p = rand_next (bt) % PEERS;
+	memset (&ai, 0, sizeof (ai));
+	snprintf ((char *) ai.peer_id, PEER_ID_LEN, "-BM0001-%011" PRIu32, p);
+	ai.ip.s_addr = htonl (0x0a000000 | p);
+	ai.port = (uint16_t) (6881 + p);
+	ai.left = (p % 4 == 0) ? 0 : 1000;
+	ai.event = (rand_next (bt) % 16 == 0) ? EVENT_STOPPED : EVENT_NONE;
+
+	pthread_mutex_lock (t->lock);
+	torrent_write_begin (t);
+	if (ai.event == EVENT_STOPPED) {
+		slot = swarm_find (&t->swarm, ai.peer_id);
+		if (slot >= 0)
+			swarm_remove (&t->swarm, (uint32_t) slot);
+
+		slot = -1;
+	} else {
+		slot = swarm_update (&t->swarm, &ai, 0, &up, &down);
+	}
+
+	torrent_update_counters (t);
+	torrent_write_end (t);
+	pthread_mutex_unlock (t->lock);
+	if (ai.event == EVENT_STOPPED)
+		return;
+
+	tries = SAMPLE_TRIES;
+	if (epoch_enter () == 0) {
+		for (tries = 0; tries < SAMPLE_TRIES; tries++) {
+			seq = torrent_read_begin (t);
+			swarm_view (&t->swarm, &v);
+			skip = ((slot >= 0) && ((uint32_t) slot < v.count))
+				? slot : -1;
+			announce_write_udp (buf, &v, 1800, rand_next (bt)
+					% (v.count + 1), NUMWANT, skip);
+			if (torrent_read_retry (t, seq) == 0)
+				break;
+		}
+
+		epoch_exit ();
+	}
+
+	if (tries == SAMPLE_TRIES) {
+		pthread_mutex_lock (t->lock);
+		swarm_view (&t->swarm, &v);
+		announce_write_udp (buf, &v, 1800, 0, NUMWANT, -1);
+		pthread_mutex_unlock (t->lock);
+		bt->locked++;
+	}
+
+	return;
+}
+
+// Every torrent's counters must match its swarm once the threads stopped.
+static int
+check (void)
+{
+	uint32_t complete, downloaded, i, incomplete;
+	torrent_t *t;
+
+	for (i = 0; i < TORRENTS; i++) {
+		t = torrents[i];
+		torrent_counters (t, &complete, &downloaded, &incomplete);
+		if ((complete != t->swarm.seeders) || (complete + incomplete
+					!= t->swarm.count)) {
+			printf ("ERROR: counters of torrent %" PRIu32
+					" do not match its swarm.\n", i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static inline double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Draws a torrent from the Zipfian distribution.
+static inline uint32_t
+pick (bench_thread_t *bt)
+{
+	uint32_t hi = TORRENTS - 1, lo = 0, mid;
+	double u;
+
+	u = (double) rand_next (bt) / UINT32_MAX;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static inline uint32_t
+rand_next (bench_thread_t *bt)
+{
+	uint32_t x = bt->rand;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	bt->rand = x;
+
+	return x;
+}
+
+/*
+ * Runs n threads against a fresh index with the given number of shards,
+ * returns the operations per second or -1.
+ */
+static double
+run (uint32_t n, uint32_t shards, uint64_t *locked)
+{
+	uint8_t info_hash[INFO_HASH_LEN];
+	uint64_t ops = 0;
+	double start, t;
+	uint32_t i, j;
+
+	if (torrent_init (TORRENTS, shards) != 0)
+		return -1;
+
+	for (i = 0; i < TORRENTS; i++) {
+		for (j = 0; j < INFO_HASH_LEN; j++)
+			info_hash[j] = (uint8_t) ((i * 2654435761U) >> (j % 4
+						* 8) ^ j);
+
+		memcpy (info_hash, &i, sizeof (i));
+		torrents[i] = torrent_insert (info_hash);
+		if (torrents[i] == NULL)
+			return -1;
+	}
+
+	stop = 0;
+	for (i = 0; i < n; i++) {
+		threads[i].rand = 2463534242U + i * 7919;
+		threads[i].ops = 0;
+		threads[i].locked = 0;
+		pthread_create (&threads[i].thread, NULL, worker, &threads[i]);
+	}
+
+	start = now ();
+	while (now () - start < RUN_SECONDS) {
+		usleep (10000);
+		reclaim (NULL);
+	}
+
+	stop = 1;
+	t = now () - start;
+	for (i = 0; i < n; i++) {
+		pthread_join (threads[i].thread, NULL);
+		ops += threads[i].ops;
+		*locked += threads[i].locked;
+	}
+
+	if (check () != 0)
+		return -1;
+
+	torrent_fin ();
+	reclaim (NULL);
+
+	return ops / t;
+}
+
+// Nine announces to every scrape.
+static void *
+worker (void *arg)
+{
+	bench_thread_t *bt = (bench_thread_t *) arg;
+	uint32_t complete, downloaded, incomplete;
+	char buf[PEER_ADDR_LEN * NUMWANT + 12];
+	torrent_t *t;
+
+	while (stop == 0) {
+		t = torrents[pick (bt)];
+		if (bt->ops % 10 == 9)
+			torrent_counters (t, &complete, &downloaded,
+					&incomplete);
+		else
+			announce (bt, t, buf);
+
+		bt->ops++;
+	}
+
+	return NULL;
+}
@@ -28,6 +28,8 @@ enum BENC_TYPE {
 typedef struct __benc_data_type benc_data_t;
 typedef struct __benc_dict_type benc_dict_t;
 typedef struct __benc_list_type benc_list_t;
+typedef struct __benc_tok_type benc_tok_t;
+typedef struct __benc_writer_type benc_writer_t;
 
 struct __benc_data_type {
 	enum BENC_TYPE type;
@@ -44,6 +46,46 @@ struct __benc_dict_type {
 	benc_data_t *val;
 };
 
+/*
+ * Zero-copy bencode tokens.
+ *
+ * benc_parse () turns a buffer into a flat array of tokens in document
+ * order without copying or allocating anything.  For a string off and len
+ * give its payload, for an integer its digits and for a dictionary or list
+ * the whole encoded value.  skip is the index of the first token after the
+ * value, so a container's children are the tokens in (i, skip) and a
+ * dictionary's children alternate between key and value.
+ */
+struct __benc_tok_type {
+	enum BENC_TYPE type;
+	uint32_t off;
+	uint32_t len;
+	uint32_t skip;
+};
+
+#define BENC_MAX_DEPTH 64
+
+/*
+ * Streaming bencode writer.
+ *
+ * The writer appends straight to its output buffer, strings are written
+ * with an explicit length so binary data is encoded as is.  With a caller
+ * supplied buffer nothing is ever allocated and running out of room marks
+ * the writer as failed.  With a NULL buffer the writer owns a buffer that
+ * grows by doubling, free it with benc_writer_fin ().  After a failure all
+ * further writes are ignored and benc_writer_error () is non-zero.
+ *
+ * Dictionary keys are written in the order they are given, like
+ * benc_encode () callers are expected to supply them sorted.
+ */
+struct __benc_writer_type {
+	char *buf;
+	size_t len;
+	size_t size;
+	uint8_t own;
+	uint8_t error;
+};
+
 static inline benc_data_t *bdecode (char **, size_t *);
 static inline benc_dict_t *bdecode_dct (char **, size_t *);
 static inline int64_t bdecode_int (char **, size_t *);
@@ -55,6 +97,8 @@ static inline char *bencode_lst (benc_data_t **);
 static inline char *bencode_str (char *);
 static inline char *lltostr (int64_t, int);
 static inline benc_data_t *new_benc_data (enum BENC_TYPE);
+static inline int benc_reserve (benc_writer_t *, size_t);
+static inline int benc_scan_uint (const char *, size_t, size_t *, uint64_t *);
 
 static inline benc_data_t *
 benc_decode (char *benc_str)
@@ -536,4 +580,356 @@ new_benc_data (enum BENC_TYPE type)
 
 	return bd;
 }
+
+static inline void
+benc_writer_init (benc_writer_t *w, char *buf, size_t size)
+{
+	w->buf = buf;
+	w->len = 0;
+	w->size = (buf == NULL) ? 0 : size;
+	w->own = (buf == NULL) ? 1 : 0;
+	w->error = 0;
+
+	return;
+}
+
+static inline void
+benc_writer_fin (benc_writer_t *w)
+{
+	if ((w->own != 0) && (w->buf != NULL))
+		free (w->buf);
+
+	w->buf = NULL;
+	w->len = 0;
+	w->size = 0;
+
+	return;
+}
+
+static inline int
+benc_writer_error (benc_writer_t *w)
+{
+	return w->error;
+}
+
+static inline int
+benc_write_dict (benc_writer_t *w)
+{
+	if (benc_reserve (w, 1) != 0)
+		return -1;
+
+	w->buf[w->len++] = 'd';
+
+	return 0;
+}
+
+static inline int
+benc_write_list (benc_writer_t *w)
+{
+	if (benc_reserve (w, 1) != 0)
+		return -1;
+
+	w->buf[w->len++] = 'l';
+
+	return 0;
+}
+
+static inline int
+benc_write_end (benc_writer_t *w)
+{
+	if (benc_reserve (w, 1) != 0)
+		return -1;
+
+	w->buf[w->len++] = 'e';
+
+	return 0;
+}
+
+static inline int
+benc_write_int (benc_writer_t *w, int64_t i)
+{
+	char tmp[22];
+	char *c = tmp + sizeof (tmp);
+	uint64_t u;
+	size_t len;
+
+	u = (i < 0) ? -(uint64_t) i : (uint64_t) i;
+	*--c = 'e';
+	do {
+		*--c = (char) ('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+
+	if (i < 0)
+		*--c = '-';
+
+	*--c = 'i';
+	len = (size_t) (tmp + sizeof (tmp) - c);
+	if (benc_reserve (w, len) != 0)
+		return -1;
+
+	memcpy (w->buf + w->len, c, len);
+	w->len += len;
+
+	return 0;
+}
+
+static inline int
+benc_write_str (benc_writer_t *w, const void *s, size_t slen)
+{
+	char tmp[21];
+	char *c = tmp + sizeof (tmp);
+	size_t len, u = slen;
+
+	*--c = ':';
+	do {
+		*--c = (char) ('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+
+	len = (size_t) (tmp + sizeof (tmp) - c);
+	if (benc_reserve (w, len + slen) != 0)
+		return -1;
+
+	memcpy (w->buf + w->len, c, len);
+	memcpy (w->buf + w->len + len, s, slen);
+	w->len += len + slen;
+
+	return 0;
+}
+
+static inline int
+benc_reserve (benc_writer_t *w, size_t len)
+{
+	size_t size;
+	char *buf;
+
+	if (w->error != 0)
+		return -1;
+
+	if (w->size - w->len >= len)
+		return 0;
+
+	if (w->own == 0) {
+		w->error = 1;
+		return -1;
+	}
+
+	size = (w->size == 0) ? 256 : w->size;
+	while (size - w->len < len)
+		size *= 2;
+
+	buf = (char *) realloc (w->buf, sizeof (char) * size);
+	if (buf == NULL) {
+		w->error = 1;
+		return -1;
+	}
+
+	w->buf = buf;
+	w->size = size;
+
+	return 0;
+}
+
+/*
+ * Parses exactly one bencoded value from buf into toks, returns the number
+ * of tokens used, -1 if the input is not valid bencode and -2 if ntoks
+ * tokens are not enough.  Input is fully binary safe.
+ */
+static inline int
+benc_parse (const char *buf, size_t len, benc_tok_t *toks, uint32_t ntoks)
+{
+	uint32_t kids[BENC_MAX_DEPTH], stack[BENC_MAX_DEPTH];
+	uint32_t depth = 0, n = 0;
+	size_t digits, pos = 0, start;
+	uint64_t val;
+	benc_tok_t *t;
+
+	if (len > UINT32_MAX)
+		return -1;
+
+	do {
+		if (pos >= len)
+			return -1;
+
+		// Closing a container.
+		if (buf[pos] == 'e') {
+			if (depth == 0)
+				return -1;
+
+			t = &toks[stack[--depth]];
+
+			// Every key needs a value.
+			if ((t->type == BENC_TYPE_DCT)
+					&& ((kids[depth] & 1) != 0))
+				return -1;
+
+			t->len = (uint32_t) (pos + 1 - t->off);
+			t->skip = n;
+			pos++;
+			continue;
+		}
+
+		if (n >= ntoks)
+			return -2;
+
+		// Dictionary keys must be strings.
+		if (depth > 0) {
+			if ((toks[stack[depth - 1]].type == BENC_TYPE_DCT)
+					&& ((kids[depth - 1] & 1) == 0)
+					&& ((buf[pos] < '0') || (buf[pos] > '9')))
+				return -1;
+
+			kids[depth - 1]++;
+		}
+
+		t = &toks[n];
+		start = pos;
+		switch (buf[pos]) {
+			case 'd': // dictionary
+			case 'l': // list
+				if (depth == BENC_MAX_DEPTH)
+					return -1;
+
+				t->type = (buf[pos] == 'd') ? BENC_TYPE_DCT
+					: BENC_TYPE_LST;
+				t->off = (uint32_t) pos;
+				kids[depth] = 0;
+				stack[depth++] = n++;
+				pos++;
+				continue;
+
+			case 'i': // integer
+				pos++;
+				if ((pos < len) && (buf[pos] == '-'))
+					pos++;
+
+				if (benc_scan_uint (buf + pos, len - pos,
+							&digits, &val) != 0)
+					return -1;
+
+				// "-0" is not a valid integer.
+				if ((buf[pos - 1] == '-') && (val == 0))
+					return -1;
+
+				if ((val > (uint64_t) INT64_MAX + 1)
+						|| ((val > INT64_MAX)
+							&& (buf[pos - 1] != '-')))
+					return -1;
+
+				pos += digits;
+				if ((pos >= len) || (buf[pos] != 'e'))
+					return -1;
+
+				t->type = BENC_TYPE_INT;
+				t->off = (uint32_t) (start + 1);
+				t->len = (uint32_t) (pos - start - 1);
+				pos++;
+				break;
+
+			case '0'...'9': // string
+				if (benc_scan_uint (buf + pos, len - pos,
+							&digits, &val) != 0)
+					return -1;
+
+				pos += digits;
+				if ((pos >= len) || (buf[pos] != ':'))
+					return -1;
+
+				pos++;
+				if (val > len - pos)
+					return -1;
+
+				t->type = BENC_TYPE_STR;
+				t->off = (uint32_t) pos;
+				t->len = (uint32_t) val;
+				pos += (size_t) val;
+				break;
+
+			default: // invalid
+				return -1;
+		}
+
+		t->skip = ++n;
+	} while (depth > 0);
+
+	if (pos != len)
+		return -1;
+
+	return (int) n;
+}
+
+/*
+ * Returns the index of the value stored under key in the dictionary token
+ * dct, or -1 if there is none.
+ */
+static inline int
+benc_find (const char *buf, const benc_tok_t *toks, uint32_t dct,
+		const char *key, size_t klen)
+{
+	uint32_t i;
+
+	if (toks[dct].type != BENC_TYPE_DCT)
+		return -1;
+
+	for (i = dct + 1; i < toks[dct].skip; i = toks[i + 1].skip) {
+		if ((toks[i].len == klen)
+				&& (memcmp (buf + toks[i].off, key, klen) == 0))
+			return (int) (i + 1);
+	}
+
+	return -1;
+}
+
+static inline int
+benc_tok_int (const char *buf, const benc_tok_t *tok, int64_t *i)
+{
+	size_t digits;
+	uint64_t val;
+	const char *c = buf + tok->off;
+	size_t len = tok->len;
+	int neg = 0;
+
+	if (tok->type != BENC_TYPE_INT)
+		return -1;
+
+	if (*c == '-') {
+		neg = 1;
+		c++;
+		len--;
+	}
+
+	if (benc_scan_uint (c, len, &digits, &val) != 0)
+		return -1;
+
+	*i = (neg != 0) ? (int64_t) -val : (int64_t) val;
+
+	return 0;
+}
+
+/*
+ * Reads a run of decimal digits without a leading zero (other than "0"
+ * itself), failing on overflow.
+ */
+static inline int
+benc_scan_uint (const char *c, size_t len, size_t *digits, uint64_t *val)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	for (i = 0; (i < len) && (c[i] >= '0') && (c[i] <= '9'); i++) {
+		if (v > (UINT64_MAX - (uint64_t) (c[i] - '0')) / 10)
+			return -1;
+
+		v = v * 10 + (uint64_t) (c[i] - '0');
+	}
+
+	if ((i == 0) || ((c[0] == '0') && (i > 1)))
+		return -1;
+
+	*digits = i;
+	*val = v;
+
+	return 0;
+}
 #endif /* __BENCODE_H__ */
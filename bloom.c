@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bloom.h"
+#include "logger.h"
+
+static inline uint64_t *bloom_block (bloom_t *, const uint8_t *, uint32_t *,
+		uint32_t *);
+
+void
+bloom_add (bloom_t *b, const uint8_t *key)
+{
+	uint64_t *block;
+	uint32_t bit, i, step;
+
+	block = bloom_block (b, key, &bit, &step);
+	for (i = 0; i < b->k; i++) {
+		__atomic_fetch_or (&block[bit / 64], (uint64_t) 1 << (bit % 64),
+				__ATOMIC_RELAXED);
+		bit = (bit + step) % BLOOM_BLOCK_BITS;
+	}
+
+	return;
+}
+
+void
+bloom_fin (bloom_t *b)
+{
+	free (b->blocks);
+	memset (b, 0, sizeof (bloom_t));
+
+	return;
+}
+
+/*
+ * Sets up a filter of at least size bytes, rounded up to a power of two
+ * number of blocks, setting k bits per key.
+ */
+int
+bloom_init (bloom_t *b, size_t size, uint32_t k)
+{
+	uint64_t n = 1;
+	void *ptr;
+
+	while (n * (BLOOM_BLOCK_BITS / 8) < size)
+		n <<= 1;
+
+	if ((n > ((uint64_t) 1 << 31)) || (k == 0)) {
+		debug (LOG_ERR, "ERROR: bad bloom filter size or k.\n");
+		return -1;
+	}
+
+	if (posix_memalign (&ptr, 64, n * (BLOOM_BLOCK_BITS / 8)) != 0) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	memset (ptr, 0, n * (BLOOM_BLOCK_BITS / 8));
+	b->blocks = ptr;
+	b->mask = (uint32_t) (n - 1);
+	b->k = k;
+
+	return 0;
+}
+
+size_t
+bloom_bytes (bloom_t *b)
+{
+	return ((size_t) b->mask + 1) * (BLOOM_BLOCK_BITS / 8);
+}
+
+int
+bloom_test (bloom_t *b, const uint8_t *key)
+{
+	uint64_t *block;
+	uint32_t bit, i, step;
+
+	block = bloom_block (b, key, &bit, &step);
+	for (i = 0; i < b->k; i++) {
+		if ((__atomic_load_n (&block[bit / 64], __ATOMIC_RELAXED)
+					& ((uint64_t) 1 << (bit % 64))) == 0)
+			return 0;
+
+		bit = (bit + step) % BLOOM_BLOCK_BITS;
+	}
+
+	return 1;
+}
+
+/*
+ * The torrent index hashes the first eight bytes of the info_hash, the
+ * filter uses the last twelve so the two stay independent.  An odd step
+ * visits k distinct bits of the block.
+ */
+static inline uint64_t *
+bloom_block (bloom_t *b, const uint8_t *key, uint32_t *bit, uint32_t *step)
+{
+	uint64_t h;
+	uint32_t g;
+
+	memcpy (&h, key + 8, sizeof (h));
+	memcpy (&g, key + 16, sizeof (g));
+	*bit = g % BLOOM_BLOCK_BITS;
+	*step = ((g >> 9) % BLOOM_BLOCK_BITS) | 1;
+
+	return b->blocks[(uint32_t) (h ^ (h >> 32)) & b->mask];
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __BLOOM_H__
+#define __BLOOM_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define BLOOM_BLOCK_BITS 512
+
+/*
+ * Blocked Bloom filter over info_hashes.
+ *
+ * Every key sets all of its k bits inside a single 64-byte block, so a
+ * test touches one cache line.  Keys are SHA-1 digests and are used as
+ * their own hash: eight bytes pick the block and the bit positions are
+ * derived from another four by double hashing.
+ *
+ * bloom_add () may run concurrently with bloom_test (), a key being added
+ * simply tests negative until its last bit is set.
+ */
+
+typedef struct __bloom_type {
+	uint64_t (*blocks)[BLOOM_BLOCK_BITS / 64];
+	uint32_t mask;
+	uint32_t k;
+} bloom_t;
+
+void bloom_add (bloom_t *, const uint8_t *);
+void bloom_fin (bloom_t *);
+int bloom_init (bloom_t *, size_t, uint32_t);
+size_t bloom_bytes (bloom_t *);
+int bloom_test (bloom_t *, const uint8_t *);
+
+#endif /* __BLOOM_H__ */
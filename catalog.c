@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "bloom.h"
+#include "catalog.h"
+#include "config.h"
+#include "event.h"
+#include "logger.h"
+#include "sql.h"
+
+#define BLOOM_K_MAX 16
+
+// Row of one refresh, filled in by sql_exec ().
+typedef struct __catalog_fetch_type {
+	MYSQL_BIND results[2];
+	uint8_t info_hash[INFO_HASH_LEN];
+	unsigned long len;
+	uint32_t id;
+	uint32_t last;
+	uint32_t added;
+} catalog_fetch_t;
+
+static int fetch_row (void *);
+static int refresh (void);
+static void refresh_task (void *);
+
+static bloom_t filter;
+static uint32_t last_id = 0;
+static uint64_t rejected = 0;
+static uint64_t false_pos = 0;
+
+void
+catalog_fin (void)
+{
+	catalog_stats_t st;
+
+	if (filter.blocks != NULL) {
+		catalog_stats (&st);
+		logger (LOG_INFO, "INFO: catalog: %" PRIu32 " torrents, %"
+				PRIu64 " rejected, %" PRIu64 " false positives"
+				", false positive rate %.4f observed, %.4f "
+				"expected.\n", st.torrents, st.rejected,
+				st.false_pos, st.observed_fp_rate,
+				st.expected_fp_rate);
+	}
+
+	bloom_fin (&filter);
+	last_id = 0;
+
+	return;
+}
+
+int
+catalog_init (void)
+{
+	double bits;
+	size_t size;
+	uint32_t k;
+
+	if ((bloom_fp_rate <= 0.0) || (bloom_fp_rate >= 1.0)) {
+		debug (LOG_ERR, "ERROR: bloom_fp_rate must be between 0 and "
+				"1.\n");
+		return -1;
+	}
+
+	// Bits per key of an optimal filter at the configured rate.
+	size = bloom_size;
+	if (size == 0) {
+		bits = -log (bloom_fp_rate) / (M_LN2 * M_LN2);
+		size = (size_t) ceil (bits * max_torrents / 8);
+	}
+
+	bits = (double) size * 8 / max_torrents;
+	k = (uint32_t) lround (bits * M_LN2);
+	if (k < 1)
+		k = 1;
+
+	if (k > BLOOM_K_MAX)
+		k = BLOOM_K_MAX;
+
+	if (bloom_init (&filter, size, k) != 0)
+		return -1;
+
+	debug (LOG_DBG, "bloom filter: %zu bytes, k %" PRIu32 ".\n",
+			bloom_bytes (&filter), k);
+	if (refresh () != 0) {
+		catalog_fin ();
+		return -1;
+	}
+
+	if (event_add_worker ("catalog refresh", torrent_refresh,
+				refresh_task, NULL) != 0) {
+		catalog_fin ();
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the torrent of a registered info_hash or NULL if it is not
+ * registered.
+ */
+torrent_t *
+catalog_lookup (const uint8_t *info_hash)
+{
+	torrent_t *t;
+
+	if (bloom_test (&filter, info_hash) == 0) {
+		__atomic_add_fetch (&rejected, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	t = torrent_lookup (info_hash);
+	if (t == NULL)
+		__atomic_add_fetch (&false_pos, 1, __ATOMIC_RELAXED);
+
+	return t;
+}
+
+void
+catalog_stats (catalog_stats_t *st)
+{
+	double m, n;
+
+	st->torrents = torrent_count ();
+	st->rejected = __atomic_load_n (&rejected, __ATOMIC_RELAXED);
+	st->false_pos = __atomic_load_n (&false_pos, __ATOMIC_RELAXED);
+	st->observed_fp_rate = 0.0;
+	if (st->rejected + st->false_pos != 0)
+		st->observed_fp_rate = (double) st->false_pos
+			/ (st->rejected + st->false_pos);
+
+	m = (double) bloom_bytes (&filter) * 8;
+	n = st->torrents;
+	st->expected_fp_rate = pow (1.0 - exp (-(double) filter.k * n / m),
+			filter.k);
+
+	return;
+}
+
+static int
+fetch_row (void *cls)
+{
+	catalog_fetch_t *f = (catalog_fetch_t *) cls;
+	torrent_t *t;
+
+	if (f->id > f->last)
+		f->last = f->id;
+
+	if ((f->len != INFO_HASH_LEN) || (f->id == 0))
+		return 0;
+
+	t = torrent_insert (f->info_hash);
+	if (t == NULL)
+		return 0;
+
+	// The index entry goes in first, a filter hit always finds it.
+	__atomic_store_n (&t->id, f->id, __ATOMIC_RELAXED);
+	bloom_add (&filter, f->info_hash);
+	f->added++;
+
+	return 0;
+}
+
+/*
+ * Adds the torrents registered since the last refresh, torrent ids only
+ * grow so the highest id seen is the sync point.  Torrents deleted from
+ * the table stay tracked until restart.
+ */
+static int
+refresh (void)
+{
+	catalog_fetch_t f;
+	MYSQL_BIND param;
+	int rows;
+
+	memset (&f, 0, sizeof (catalog_fetch_t));
+	f.results[0].buffer_type = MYSQL_TYPE_LONG;
+	f.results[0].buffer = &f.id;
+	f.results[0].is_unsigned = 1;
+	f.results[1].buffer_type = MYSQL_TYPE_BLOB;
+	f.results[1].buffer = f.info_hash;
+	f.results[1].buffer_length = sizeof (f.info_hash);
+	f.results[1].length = &f.len;
+	f.last = last_id;
+	memset (&param, 0, sizeof (MYSQL_BIND));
+	param.buffer_type = MYSQL_TYPE_LONG;
+	param.buffer = &last_id;
+	param.is_unsigned = 1;
+	rows = sql_exec (SQL_STMT_TORRENTS_SINCE, &param, f.results,
+			fetch_row, &f);
+	if (rows < 0) {
+		debug (LOG_ERR, "ERROR: unable to refresh torrents.\n");
+		return -1;
+	}
+
+	if (f.added != 0)
+		debug (LOG_DBG, "catalog: %" PRIu32 " torrents added.\n",
+				f.added);
+
+	if ((uint32_t) rows != f.added)
+		debug (LOG_ERR, "ERROR: %" PRIu32 " torrents not indexed.\n",
+				(uint32_t) rows - f.added);
+
+	last_id = f.last;
+
+	return 0;
+}
+
+static void
+refresh_task (void *cls)
+{
+	(void) cls;
+	refresh ();
+
+	return;
+}
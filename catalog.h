@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __CATALOG_H__
+#define __CATALOG_H__
+
+#include <inttypes.h>
+#include "torrent.h"
+
+/*
+ * Registered torrents.
+ *
+ * Only torrents in the torrents table are tracked.  They are loaded into
+ * the torrent index together with their database ids at start up, and a
+ * task on the event worker adds the torrents registered since every
+ * torrent_refresh seconds.  Every registered info_hash is also added to a
+ * blocked Bloom filter that is checked before the index, so announces for
+ * unknown torrents are turned away after touching a single cache line.
+ *
+ * The filter is sized for max_torrents at bloom_fp_rate, or to bloom_size
+ * bytes if given.  Announces that pass the filter but miss the index are
+ * its false positives, the observed rate is their share of all announces
+ * for unregistered torrents.
+ */
+
+typedef struct __catalog_stats_type {
+	uint32_t torrents;
+	uint64_t rejected;
+	uint64_t false_pos;
+	double expected_fp_rate;
+	double observed_fp_rate;
+} catalog_stats_t;
+
+void catalog_fin (void);
+int catalog_init (void);
+torrent_t *catalog_lookup (const uint8_t *);
+void catalog_stats (catalog_stats_t *);
+
+#endif /* __CATALOG_H__ */
@@ -6,12 +6,52 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+#include <inttypes.h>
+#include <stddef.h>
+
 extern unsigned int max_thrds;
+extern uint32_t max_torrents;
+extern uint32_t swarm_shards;
+extern uint32_t announce_interval;
+extern uint32_t peer_grace;
+extern size_t arena_size;
+extern uint32_t db_connections;
+extern uint32_t db_statements;
+extern uint32_t db_reconnects;
+extern uint32_t db_synthetic_torrents;
+extern uint32_t db_synthetic_users;
+extern uint32_t acct_flush_interval;
+extern uint32_t acct_flush_rows;
+extern uint32_t acct_queue_size;
+extern uint32_t passkey_refresh;
+extern uint32_t passkey_negative_ttl;
+extern uint32_t passkey_negative_size;
+extern uint32_t torrent_refresh;
+extern double bloom_fp_rate;
+extern size_t bloom_size;
+extern uint32_t full_scrape_cache;
+extern uint32_t udp_threads;
+extern uint32_t udp_scrape;
+extern uint32_t http_connection_limit;
+extern uint32_t http_connection_timeout;
+extern size_t http_connection_memory_limit;
+extern uint32_t http_per_ip_connection_limit;
+extern uint32_t http_frontend_threads;
+extern uint32_t stats_interval;
+extern char *db_backend;
 extern char *host;
 extern char *name;
 extern char *passwd;
 extern char *user;
 extern char *ip;
 extern char *port;
+extern char *udp_listen_ip;
+extern char *udp_listen_port;
+extern char *metrics_listen_ip;
+extern char *metrics_listen_port;
+extern char *http_backend;
+extern char *http_frontend;
+extern uint32_t trace_buffer;
+extern char *trace_file;
 
 #endif /* __CONFIG_H__ */
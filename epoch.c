@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "epoch.h"
+#include "event.h"
+#include "logger.h"
+
+// Epoch a thread is reading in, 0 while it is outside.
+typedef struct __epoch_thread_type epoch_thread_t;
+
+struct __epoch_thread_type {
+	uint64_t active;
+	epoch_thread_t *next;
+} __attribute__ ((aligned (64)));
+
+static void reclaim (void *);
+
+static uint64_t global_epoch = 1;
+static epoch_thread_t *threads = NULL;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread epoch_thread_t *thread_rec = NULL;
+static epoch_node_t *retired = NULL;
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int
+epoch_enter (void)
+{
+	epoch_thread_t *rec = thread_rec;
+	void *ptr;
+
+	if (rec == NULL) {
+		if (posix_memalign (&ptr, 64, sizeof (epoch_thread_t)) != 0) {
+			debug (LOG_ERR, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+
+		rec = (epoch_thread_t *) ptr;
+		rec->active = 0;
+		pthread_mutex_lock (&threads_lock);
+		rec->next = threads;
+		__atomic_store_n (&threads, rec, __ATOMIC_RELEASE);
+		pthread_mutex_unlock (&threads_lock);
+		thread_rec = rec;
+	}
+
+	// The reads that follow must not be seen before the epoch is.
+	__atomic_store_n (&rec->active, __atomic_load_n (&global_epoch,
+				__ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+void
+epoch_exit (void)
+{
+	__atomic_store_n (&thread_rec->active, 0, __ATOMIC_RELEASE);
+
+	return;
+}
+
+// Frees everything, no reader may be left.
+void
+epoch_fin (void)
+{
+	epoch_thread_t *rec;
+	epoch_node_t *n;
+
+	while (retired != NULL) {
+		n = retired;
+		retired = n->next;
+		free (n);
+	}
+
+	while (threads != NULL) {
+		rec = threads;
+		threads = rec->next;
+		free (rec);
+	}
+
+	return;
+}
+
+int
+epoch_init (void)
+{
+	return event_add ("epoch reclaim", 1, reclaim, NULL);
+}
+
+void
+epoch_retire (epoch_node_t *n)
+{
+	pthread_mutex_lock (&retired_lock);
+	n->epoch = __atomic_load_n (&global_epoch, __ATOMIC_RELAXED);
+	n->next = retired;
+	retired = n;
+	pthread_mutex_unlock (&retired_lock);
+
+	return;
+}
+
+/*
+ * Starts a new epoch and frees the blocks retired before the oldest epoch
+ * a reader is still in.  The epoch moves with the retired list locked, so
+ * every block on it was unpublished before the scan and a reader the scan
+ * missed can only find the blocks that replaced them.
+ */
+static void
+reclaim (void *cls)
+{
+	epoch_node_t **pn, *n;
+	epoch_thread_t *rec;
+	uint64_t active, min;
+	uint32_t count = 0;
+
+	(void) cls;
+	pthread_mutex_lock (&retired_lock);
+	min = __atomic_add_fetch (&global_epoch, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+	for (rec = __atomic_load_n (&threads, __ATOMIC_ACQUIRE); rec != NULL;
+			rec = rec->next) {
+		active = __atomic_load_n (&rec->active, __ATOMIC_ACQUIRE);
+		if ((active != 0) && (active < min))
+			min = active;
+	}
+
+	pn = &retired;
+	while (*pn != NULL) {
+		n = *pn;
+		if (n->epoch < min) {
+			*pn = n->next;
+			free (n);
+			count++;
+		} else {
+			pn = &n->next;
+		}
+	}
+
+	pthread_mutex_unlock (&retired_lock);
+	if (count != 0)
+		debug (LOG_DBG, "epoch: %" PRIu32 " blocks freed.\n", count);
+
+	return;
+}
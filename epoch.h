@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <inttypes.h>
+
+/*
+ * Epoch-based reclamation.
+ *
+ * Lock-free readers bracket their reads with epoch_enter () and
+ * epoch_exit ().  A writer that unpublishes a block hands it to
+ * epoch_retire () instead of freeing it, and a housekeeping task frees
+ * the retired blocks once every reader that was inside at the time has
+ * left.  The global epoch is advanced by that task once a second, a
+ * block is freed one or two ticks after it was retired.
+ *
+ * Retired blocks start with an epoch_node_t and are released with free ().
+ * Reader sections must not nest, epoch_enter () fails only if the thread
+ * could not be registered and the reader must then take the lock.
+ */
+
+typedef struct __epoch_node_type epoch_node_t;
+
+struct __epoch_node_type {
+	epoch_node_t *next;
+	uint64_t epoch;
+};
+
+int epoch_enter (void);
+void epoch_exit (void);
+void epoch_fin (void);
+int epoch_init (void);
+void epoch_retire (epoch_node_t *);
+
+#endif /* __EPOCH_H__ */
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "event.h"
+#include "logger.h"
+
+#define EVENT_TASK_MAX 16
+
+// due and running of a worker task are guarded by worker_lock.
+typedef struct __event_task_type {
+	const char *name;
+	uint32_t interval;
+	uint64_t next;
+	event_task_t fn;
+	void *cls;
+	uint8_t worker;
+	uint8_t due;
+	uint8_t running;
+} event_task_entry_t;
+
+static inline uint64_t monotonic_now (void);
+static int handle_signal (void);
+static int loop (void);
+static void run_tasks (void);
+static int task_add (const char *, uint32_t, event_task_t, void *, uint8_t);
+static void *worker_thread (void *);
+
+static event_task_entry_t tasks[EVENT_TASK_MAX];
+static event_task_entry_t usr_tasks[2];
+static uint32_t task_count = 0;
+static int sig_fd = -1;
+static int timer_fd = -1;
+static uint32_t clock_now = 0;
+
+static pthread_t worker;
+static uint8_t worker_valid = 0;
+static int worker_stop = 0;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wake = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Registers fn to run every interval seconds, the first run is one
+ * interval from now.
+ */
+int
+event_add (const char *name, uint32_t interval, event_task_t fn, void *cls)
+{
+	return task_add (name, interval, fn, cls, 0);
+}
+
+// Like event_add (), fn runs on the worker thread.
+int
+event_add_worker (const char *name, uint32_t interval, event_task_t fn,
+		void *cls)
+{
+	return task_add (name, interval, fn, cls, 1);
+}
+
+void
+event_fin (void)
+{
+	if (timer_fd >= 0)
+		close (timer_fd);
+
+	if (sig_fd >= 0)
+		close (sig_fd);
+
+	timer_fd = -1;
+	sig_fd = -1;
+	task_count = 0;
+	memset (usr_tasks, 0, sizeof (usr_tasks));
+
+	return;
+}
+
+int
+event_init (void)
+{
+	struct itimerspec its;
+	sigset_t mask;
+
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGHUP);
+	sigaddset (&mask, SIGINT);
+	sigaddset (&mask, SIGQUIT);
+	sigaddset (&mask, SIGTERM);
+	sigaddset (&mask, SIGUSR1);
+	sigaddset (&mask, SIGUSR2);
+	if (pthread_sigmask (SIG_BLOCK, &mask, NULL) != 0) {
+		debug (LOG_ERR, "ERROR: unable to block signals.\n");
+		return -1;
+	}
+
+	sig_fd = signalfd (-1, &mask, SFD_CLOEXEC);
+	if (sig_fd < 0) {
+		debug (LOG_ERR, "ERROR: unable to create signalfd: %s.\n",
+				strerror (errno));
+		return -1;
+	}
+
+	timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (timer_fd < 0) {
+		debug (LOG_ERR, "ERROR: unable to create timerfd: %s.\n",
+				strerror (errno));
+		event_fin ();
+		return -1;
+	}
+
+	clock_now = (uint32_t) monotonic_now ();
+	memset (&its, 0, sizeof (struct itimerspec));
+	its.it_value.tv_sec = 1;
+	its.it_interval.tv_sec = 1;
+	if (timerfd_settime (timer_fd, 0, &its, NULL) != 0) {
+		debug (LOG_ERR, "ERROR: unable to arm timerfd: %s.\n",
+				strerror (errno));
+		event_fin ();
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Runs the housekeeping loop, returns 0 once told to terminate and -1 if
+ * the loop itself failed.  The worker is stopped before it returns, once
+ * the task it is running, if any, is done.
+ */
+int
+event_loop (void)
+{
+	uint32_t i;
+	int rc;
+
+	for (i = 0; i < task_count; i++) {
+		if (tasks[i].worker != 0)
+			break;
+	}
+
+	if (i < task_count) {
+		worker_stop = 0;
+		if (pthread_create (&worker, NULL, worker_thread, NULL) != 0) {
+			debug (LOG_ERR, "ERROR: unable to start event "
+					"worker.\n");
+			return -1;
+		}
+
+		worker_valid = 1;
+	}
+
+	rc = loop ();
+	if (worker_valid != 0) {
+		pthread_mutex_lock (&worker_lock);
+		worker_stop = 1;
+		pthread_cond_signal (&worker_wake);
+		pthread_mutex_unlock (&worker_lock);
+		pthread_join (worker, NULL);
+		worker_valid = 0;
+	}
+
+	return rc;
+}
+
+uint32_t
+event_now (void)
+{
+	return __atomic_load_n (&clock_now, __ATOMIC_RELAXED);
+}
+
+/*
+ * Registers fn to run on the main thread every time signo arrives, which
+ * must be SIGUSR1 or SIGUSR2.
+ */
+int
+event_signal (int signo, event_task_t fn, void *cls)
+{
+	event_task_entry_t *t;
+
+	if ((signo != SIGUSR1) && (signo != SIGUSR2)) {
+		debug (LOG_ERR, "ERROR: %s can not be handled.\n",
+				strsignal (signo));
+		return -1;
+	}
+
+	t = &usr_tasks[signo == SIGUSR2];
+	t->name = strsignal (signo);
+	t->fn = fn;
+	t->cls = cls;
+
+	return 0;
+}
+
+static inline uint64_t
+monotonic_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec;
+}
+
+// Returns 1 if the signal read asks tmst to terminate.
+static int
+handle_signal (void)
+{
+	struct signalfd_siginfo si;
+	event_task_entry_t *t;
+
+	if (read (sig_fd, &si, sizeof (si)) != sizeof (si))
+		return 0;
+
+	switch (si.ssi_signo) {
+		case SIGHUP:
+		case SIGQUIT:
+			logger (LOG_DBG, "INFO: received %s, ignoring.\n",
+					strsignal (si.ssi_signo));
+			break;
+
+		case SIGINT:
+		case SIGTERM:
+			logger (LOG_DBG, "INFO: received %s, terminating.\n",
+					strsignal (si.ssi_signo));
+			return 1;
+
+		case SIGUSR1:
+		case SIGUSR2:
+			t = &usr_tasks[si.ssi_signo == SIGUSR2];
+			if (t->fn != NULL)
+				t->fn (t->cls);
+			else
+				logger (LOG_DBG, "INFO: received %s, "
+						"ignoring.\n",
+						strsignal (si.ssi_signo));
+
+			break;
+
+		default:
+			logger (LOG_ERR, "ERROR: received %s, unhandled.\n",
+					strsignal (si.ssi_signo));
+	}
+
+	return 0;
+}
+
+// Returns 0 once told to terminate and -1 if poll () failed.
+static int
+loop (void)
+{
+	struct pollfd fds[2];
+	uint64_t ticks;
+	int rc;
+
+	fds[0].fd = sig_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = timer_fd;
+	fds[1].events = POLLIN;
+	while (1) {
+		rc = poll (fds, 2, -1);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			debug (LOG_ERR, "ERROR: poll failed: %s.\n",
+					strerror (errno));
+			return -1;
+		}
+
+		if ((fds[0].revents & POLLIN) != 0) {
+			if (handle_signal () != 0)
+				return 0;
+		}
+
+		if ((fds[1].revents & POLLIN) != 0) {
+			if (read (timer_fd, &ticks, sizeof (ticks)) < 0)
+				continue;
+
+			__atomic_store_n (&clock_now,
+					(uint32_t) monotonic_now (),
+					__ATOMIC_RELAXED);
+			run_tasks ();
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Runs every task that is due, worker tasks are handed to the worker.  A
+ * task that overran its interval runs once and is rescheduled from now,
+ * missed runs are not made up.
+ */
+static void
+run_tasks (void)
+{
+	event_task_entry_t *t;
+	uint64_t now;
+	uint32_t i;
+
+	for (i = 0; i < task_count; i++) {
+		t = &tasks[i];
+		now = monotonic_now ();
+		if (now < t->next)
+			continue;
+
+		if (t->worker != 0) {
+			pthread_mutex_lock (&worker_lock);
+			if ((t->due != 0) || (t->running != 0))
+				logger (LOG_WARN, "WARNING: task %s still "
+						"running, run skipped.\n",
+						t->name);
+			else
+				t->due = 1;
+
+			pthread_cond_signal (&worker_wake);
+			pthread_mutex_unlock (&worker_lock);
+			t->next = now + t->interval;
+			continue;
+		}
+
+		t->fn (t->cls);
+		t->next = monotonic_now () + t->interval;
+		if (t->next - now > 2 * (uint64_t) t->interval)
+			logger (LOG_WARN, "WARNING: task %s took %" PRIu64
+					" seconds.\n", t->name,
+					t->next - now - t->interval);
+	}
+
+	return;
+}
+
+static int
+task_add (const char *name, uint32_t interval, event_task_t fn, void *cls,
+		uint8_t on_worker)
+{
+	event_task_entry_t *t;
+
+	if (interval == 0)
+		return 0;
+
+	if (task_count == EVENT_TASK_MAX) {
+		debug (LOG_ERR, "ERROR: too many tasks, %s not added.\n", name);
+		return -1;
+	}
+
+	t = &tasks[task_count++];
+	t->name = name;
+	t->interval = interval;
+	t->next = monotonic_now () + interval;
+	t->fn = fn;
+	t->cls = cls;
+	t->worker = on_worker;
+	t->due = 0;
+	t->running = 0;
+
+	return 0;
+}
+
+// Runs the worker tasks the loop marked due, one at a time.
+static void *
+worker_thread (void *arg)
+{
+	event_task_entry_t *t;
+	uint32_t i;
+
+	(void) arg;
+	pthread_mutex_lock (&worker_lock);
+	while (worker_stop == 0) {
+		for (i = 0; i < task_count; i++) {
+			if (tasks[i].due != 0)
+				break;
+		}
+
+		if (i == task_count) {
+			pthread_cond_wait (&worker_wake, &worker_lock);
+			continue;
+		}
+
+		t = &tasks[i];
+		t->due = 0;
+		t->running = 1;
+		pthread_mutex_unlock (&worker_lock);
+		t->fn (t->cls);
+		pthread_mutex_lock (&worker_lock);
+		t->running = 0;
+	}
+
+	pthread_mutex_unlock (&worker_lock);
+
+	return NULL;
+}
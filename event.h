@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include <inttypes.h>
+
+/*
+ * Housekeeping loop of the main thread.
+ *
+ * event_init () blocks the signals tmst handles, it must run before any
+ * other thread is started so that every thread inherits the mask.  They
+ * are then read from a signalfd by event_loop (), outside of any signal
+ * handler.  A timerfd wakes the loop once a second to run the periodic
+ * tasks registered with event_add (), one after the other on the main
+ * thread, until SIGINT or SIGTERM arrives.  SIGUSR1 and SIGUSR2 run the
+ * task registered for them with event_signal (), if any.
+ *
+ * Tasks that may block, such as database refreshes, are registered with
+ * event_add_worker () instead.  The loop only marks them due and a worker
+ * thread runs them, so signals and the other tasks are never held up.  A
+ * worker task still running when it is due again skips that run.  The
+ * worker lives as long as event_loop () runs.
+ *
+ * event_now () is a coarse monotonic clock in seconds, read by every
+ * request instead of asking the kernel.  It is advanced once per tick,
+ * before the tasks run, so a task added with event_add () must not block:
+ * the clock stands still until it returns.
+ */
+
+typedef void (*event_task_t) (void *);
+
+int event_add (const char *, uint32_t, event_task_t, void *);
+int event_add_worker (const char *, uint32_t, event_task_t, void *);
+void event_fin (void);
+int event_init (void);
+int event_loop (void);
+uint32_t event_now (void);
+int event_signal (int, event_task_t, void *);
+
+#endif /* __EVENT_H__ */
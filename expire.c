@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "config.h"
+#include "event.h"
+#include "expire.h"
+#include "logger.h"
+#include "wheel.h"
+
+// Handles are allocated this many at a time.
+#define EXPIRE_CHUNK 1024
+
+typedef struct __expire_chunk_type expire_chunk_t;
+
+struct __expire_chunk_type {
+	expire_chunk_t *next;
+	peer_timer_t timers[EXPIRE_CHUNK];
+};
+
+typedef struct __expire_shard_type {
+	pthread_mutex_t lock;
+	wheel_t wheel;
+	peer_timer_t *free;
+	expire_chunk_t *chunks;
+} expire_shard_t;
+
+static void expire_task (void *);
+static inline expire_shard_t *shard_of (torrent_t *);
+static inline peer_timer_t *timer_alloc (expire_shard_t *);
+static inline void timer_free (expire_shard_t *, peer_timer_t *);
+
+static expire_shard_t *shards = NULL;
+static uint32_t timeout = 0;
+static uint64_t expired = 0;
+
+void
+expire_fin (void)
+{
+	expire_chunk_t *c;
+	uint32_t i;
+
+	if (shards == NULL)
+		return;
+
+	logger (LOG_INFO, "INFO: expire: %" PRIu64 " peers expired.\n",
+			expired);
+	for (i = 0; i < EXPIRE_SHARDS; i++) {
+		while (shards[i].chunks != NULL) {
+			c = shards[i].chunks;
+			shards[i].chunks = c->next;
+			free (c);
+		}
+
+		pthread_mutex_destroy (&shards[i].lock);
+	}
+
+	free (shards);
+	shards = NULL;
+	expired = 0;
+
+	return;
+}
+
+int
+expire_init (void)
+{
+	uint32_t i;
+
+	shards = (expire_shard_t *) calloc (EXPIRE_SHARDS,
+			sizeof (expire_shard_t));
+	if (shards == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	for (i = 0; i < EXPIRE_SHARDS; i++) {
+		pthread_mutex_init (&shards[i].lock, NULL);
+		wheel_init (&shards[i].wheel, event_now ());
+	}
+
+	timeout = announce_interval + peer_grace;
+	if (event_add ("peer expiry", 1, expire_task, NULL) != 0) {
+		expire_fin ();
+		return -1;
+	}
+
+	return 0;
+}
+
+// Removes the peer in slot from the swarm together with its handle.
+void
+expire_remove (torrent_t *t, uint32_t slot)
+{
+	expire_shard_t *shard;
+	peer_timer_t *pt;
+
+	pt = t->swarm.timer[slot];
+	if (pt != NULL) {
+		shard = shard_of (t);
+		pthread_mutex_lock (&shard->lock);
+		wheel_del (&pt->node);
+		timer_free (shard, pt);
+		pthread_mutex_unlock (&shard->lock);
+		t->swarm.timer[slot] = NULL;
+	}
+
+	swarm_remove (&t->swarm, slot);
+
+	return;
+}
+
+/*
+ * Schedules the expiry of the peer in slot, which just announced.  Returns
+ * -1 if no handle could be had, the peer then stays until it stops.
+ */
+int
+expire_touch (torrent_t *t, uint32_t slot)
+{
+	expire_shard_t *shard;
+	peer_timer_t *pt;
+
+	shard = shard_of (t);
+	pthread_mutex_lock (&shard->lock);
+	pt = t->swarm.timer[slot];
+	if (pt == NULL) {
+		pt = timer_alloc (shard);
+		if (pt == NULL) {
+			pthread_mutex_unlock (&shard->lock);
+			debug (LOG_ERR, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+
+		pt->torrent = t;
+		pt->slot = slot;
+		t->swarm.timer[slot] = pt;
+	}
+
+	wheel_add (&shard->wheel, &pt->node, event_now () + timeout);
+	pthread_mutex_unlock (&shard->lock);
+
+	return 0;
+}
+
+static void
+expire_task (void *cls)
+{
+	expire_shard_t *shard;
+	wheel_node_t due, *n;
+	peer_timer_t *pt;
+	torrent_t *t;
+	uint32_t count = 0, i, now;
+
+	(void) cls;
+	now = event_now ();
+	for (i = 0; i < EXPIRE_SHARDS; i++) {
+		shard = &shards[i];
+		wheel_list_init (&due);
+		pthread_mutex_lock (&shard->lock);
+		wheel_advance (&shard->wheel, now, &due);
+		while (due.next != &due) {
+			n = due.next;
+			pt = (peer_timer_t *) n;
+			t = pt->torrent;
+			if (pthread_mutex_trylock (t->lock) != 0) {
+				wheel_add (&shard->wheel, n, now + 1);
+				continue;
+			}
+
+			wheel_del (n);
+			torrent_write_begin (t);
+			t->swarm.timer[pt->slot] = NULL;
+			swarm_remove (&t->swarm, pt->slot);
+			torrent_update_counters (t);
+			torrent_write_end (t);
+			pthread_mutex_unlock (t->lock);
+			timer_free (shard, pt);
+			count++;
+		}
+
+		pthread_mutex_unlock (&shard->lock);
+	}
+
+	if (count != 0) {
+		expired += count;
+		debug (LOG_DBG, "expire: %" PRIu32 " peers expired.\n", count);
+	}
+
+	return;
+}
+
+static inline expire_shard_t *
+shard_of (torrent_t *t)
+{
+	return &shards[t->info_hash[8] % EXPIRE_SHARDS];
+}
+
+// Called with the shard's lock held.
+static inline peer_timer_t *
+timer_alloc (expire_shard_t *shard)
+{
+	expire_chunk_t *c;
+	peer_timer_t *pt;
+	uint32_t i;
+
+	if (shard->free == NULL) {
+		c = (expire_chunk_t *) malloc (sizeof (expire_chunk_t));
+		if (c == NULL)
+			return NULL;
+
+		c->next = shard->chunks;
+		shard->chunks = c;
+		for (i = 0; i < EXPIRE_CHUNK; i++)
+			timer_free (shard, &c->timers[i]);
+	}
+
+	pt = shard->free;
+	shard->free = (peer_timer_t *) pt->node.next;
+	pt->node.next = NULL;
+	pt->node.prev = NULL;
+
+	return pt;
+}
+
+// Called with the shard's lock held, free handles are chained on next.
+static inline void
+timer_free (expire_shard_t *shard, peer_timer_t *pt)
+{
+	pt->node.next = (wheel_node_t *) shard->free;
+	shard->free = pt;
+
+	return;
+}
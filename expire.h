@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __EXPIRE_H__
+#define __EXPIRE_H__
+
+#include <inttypes.h>
+#include "torrent.h"
+
+/*
+ * Peer expiry.
+ *
+ * A peer that does not announce again within announce_interval plus
+ * peer_grace seconds is removed from its swarm.  Every peer has a handle
+ * on a hierarchical timing wheel which each announce moves to the new
+ * expiry time in O(1), so no swarm is ever scanned.  A housekeeping task
+ * advances the wheels every second and removes the expired peers in one
+ * batch per wheel, updating the torrents' counters.
+ *
+ * Torrents are spread over EXPIRE_SHARDS wheels by info_hash, each with
+ * its own lock and pool of handles, so announces for different torrents
+ * seldom meet on the same lock.  Announces take a wheel's lock while
+ * holding the torrent's, the expiry task only tries the torrent's lock
+ * and retries a busy torrent on the next tick.
+ *
+ * expire_touch () and expire_remove () are called with the torrent's lock
+ * held and, for expire_remove (), inside torrent_write_begin ().
+ */
+
+#define EXPIRE_SHARDS 64
+
+void expire_fin (void);
+int expire_init (void);
+void expire_remove (torrent_t *, uint32_t);
+int expire_touch (torrent_t *, uint32_t);
+
+#endif /* __EXPIRE_H__ */
@@ -11,48 +11,115 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <microhttpd.h>
+#include "arena.h"
 #include "config.h"
 #include "http.h"
 #include "logger.h"
+#include "metrics.h"
+#include "query.h"
+#include "scrape.h"
+#include "trace.h"
 #include "tracker.h"
 
+// Largest piece of a full scrape handed to MHD at once.
+#define FULL_SCRAPE_BLOCK 65536
+#define HTTP_OPTIONS_MAX 8
+
 static int process_request (void *, struct MHD_Connection *, const char *,
 		const char *, const char *, const char *, size_t *, void **);
-static inline announce_info_t *get_announce_info (struct MHD_Connection *);
-static inline uint8_t parse_event (const char *);
+static int add_headers (struct MHD_Response *);
+static inline int backend_flags (const char *, unsigned int *);
+static inline uint32_t connection_options (struct MHD_OptionItem *);
+static ssize_t full_scrape_reader (void *, uint64_t, char *, size_t);
+static void full_scrape_free (void *);
+static inline announce_info_t *get_announce_info (arena_t *,
+		struct MHD_Connection *);
+static inline scrape_info_t *get_scrape_info (arena_t *,
+		struct MHD_Connection *);
+static int announce_arg_iterator (void *, enum MHD_ValueKind, const char *,
+		const char *);
+static int scrape_arg_iterator (void *, enum MHD_ValueKind, const char *,
+		const char *);
+static size_t unescape_none (void *, struct MHD_Connection *, char *);
 #ifdef DEBUG
 static int key_val_iterator (void *, enum MHD_ValueKind, const char *,
 		const char *);
 static inline void print_announce_info (announce_info_t *);
-static inline void print_hex (char *str);
+static inline void print_hex (const uint8_t *, size_t);
 #endif /* DEBUG */
 
 static struct MHD_Daemon *daemon = NULL;
+static struct MHD_Response *replies[TRACKER_REPLY_MAX];
+static char keep_alive[sizeof ("timeout=4294967295")];
 
 void
 http_fin (void)
 {
+	uint32_t i;
+
 	if (daemon != NULL)
 		MHD_stop_daemon (daemon);
 
+	daemon = NULL;
+	for (i = 0; i < TRACKER_REPLY_MAX; i++) {
+		if (replies[i] != NULL)
+			MHD_destroy_response (replies[i]);
+
+		replies[i] = NULL;
+	}
+
 	return;
 }
 
 int
 http_init (void)
 {
+	struct MHD_OptionItem opts[HTTP_OPTIONS_MAX];
 	struct sockaddr_in sock_addr;
+	const char *str;
+	size_t len;
+	unsigned int flags;
 	uint16_t tcp_port;
+	uint32_t i;
+
+	if (backend_flags (http_backend, &flags) != 0) {
+		debug (LOG_ERR, "ERROR: unknown http_backend %s.\n",
+				http_backend);
+		return -1;
+	}
+
+	// Advertise the idle timeout the daemon enforces, if any.
+	keep_alive[0] = '\0';
+	if (http_connection_timeout != 0)
+		snprintf (keep_alive, sizeof (keep_alive), "timeout=%" PRIu32,
+				http_connection_timeout);
+
+	for (i = 0; i < TRACKER_REPLY_MAX; i++) {
+		str = tracker_reply ((enum TRACKER_REPLY) i, &len);
+		replies[i] = MHD_create_response_from_data (len, (void *) str,
+				MHD_NO, MHD_NO);
+		if (replies[i] == NULL) {
+			debug (LOG_ERR, "ERROR: Unable to create MHD "
+					"response.\n");
+			return -1;
+		}
+
+		if (add_headers (replies[i]) != 0)
+			return -1;
+	}
 
 	tcp_port = (uint16_t) atoi ((const char *) port);
 	memset (&sock_addr, 0, sizeof (struct sockaddr_in));
 	sock_addr.sin_family = AF_INET;
 	sock_addr.sin_addr.s_addr = inet_addr (ip);
 	sock_addr.sin_port = htons (tcp_port);
-	daemon = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY, tcp_port, NULL,
-			NULL, &process_request, NULL,
+	connection_options (opts);
+	daemon = MHD_start_daemon (flags, tcp_port, NULL, NULL,
+			&process_request, NULL,
 			MHD_OPTION_SOCK_ADDR, (struct sockaddr *) &sock_addr,
 			MHD_OPTION_THREAD_POOL_SIZE, max_thrds,
+			MHD_OPTION_UNESCAPE_CALLBACK, &unescape_none, NULL,
+			MHD_OPTION_ARRAY, opts,
 			MHD_OPTION_END);
 	if (daemon == NULL) {
 		debug (LOG_ERR, "ERROR: unable to start http daemon.\n");
@@ -68,203 +135,360 @@ process_request (void *cls, struct MHD_Connection *conn, const char *url,
 		size_t *data_size, void **con_cls)
 {
 	announce_info_t *ai = NULL;
-	const char *buf;
-	char *info_hash = NULL;
-	char *pkey, *req, *ret, *str, *tmp;
-	struct MHD_Response *response;
-	int ret_val = MHD_YES;
-
+	scrape_info_t *si = NULL;
+	scrape_full_t *fs;
+	arena_t *arena;
+	char *pkey, *req, *ret, *save, *str;
+	struct MHD_Response *response = NULL;
+	size_t ret_len = 0;
+	uint64_t start, t;
+	int reply = TRACKER_REPLY_ERROR, ret_val = MHD_NO;
+
+	start = metrics_clock ();
+	trace_begin (TRACE_MHD);
 #ifdef DEBUG
-	debug (LOG_DBG, "url: %s\n", url);
-	MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND, 
-			key_val_iterator, NULL);
+	// Don't walk the arguments unless they are going to be logged.
+	if (LOG_ENABLED (LOG_DBG)) {
+		debug (LOG_DBG, "url: %s\n", url);
+		MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND,
+				key_val_iterator, NULL);
+	}
 #endif /* DEBUG */
-	str = strdup (url);
+	arena = arena_get ();
+	if (arena == NULL)
+		goto out;
+
+	str = arena_strdup (arena, url);
 	if (str == NULL) {
 		debug (LOG_ERR, "ERROR: out-of-memory.\n");
-		return MHD_NO;
+		goto out;
 	}
 
-	tmp = str;
-	pkey = strtok (tmp, "/");
-	req = strtok (NULL, "");
+	pkey = strtok_r (str, "/", &save);
+	req = strtok_r (NULL, "", &save);
 	ret = NULL;
+	trace_mark (TRACE_SPLIT);
 	if (req == NULL) {
-		ret = tracker_handle_request (pkey, req, ai, info_hash);
+		reply = tracker_handle_request (pkey, req, ai, si, &ret,
+				&ret_len);
 	} else if (strcmp (req, "announce") == 0) {
-		ai = get_announce_info (conn);
-		ret = tracker_handle_request (pkey, req, ai, info_hash);
+		t = metrics_clock ();
+		ai = get_announce_info (arena, conn);
+		metrics_time (METRICS_PARSE, t);
+		trace_mark (TRACE_PARSE);
+		reply = tracker_handle_request (pkey, req, ai, si, &ret,
+				&ret_len);
 	} else if (strcmp (req, "scrape") == 0) {
-		buf = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-				"info_hash");
-		if (buf != NULL)
-			info_hash = strdup (buf);
-
-		ret = tracker_handle_request (pkey, req, ai, info_hash);
+		t = metrics_clock ();
+		si = get_scrape_info (arena, conn);
+		metrics_time (METRICS_PARSE, t);
+		trace_mark (TRACE_PARSE);
+		if (si == NULL)
+			reply = TRACKER_REPLY_BAD_REQUEST;
+		else
+			reply = tracker_handle_request (pkey, req, ai, si,
+					&ret, &ret_len);
 	} else {
-		ret = tracker_handle_request (pkey, req, ai, info_hash);
+		reply = tracker_handle_request (pkey, req, ai, si, &ret,
+				&ret_len);
 		debug (LOG_DBG, "pkey: %s, req: %s\n", pkey, req);
 	}
 
-	free (str);
-	response = MHD_create_response_from_data (strlen (ret), (void *) ret,
-			MHD_YES, MHD_NO);
+	if (reply == TRACKER_REPLY_ERROR)
+		goto out;
+
+	// Fixed replies are shared and stay alive until http_fin ().
+	if (reply >= 0) {
+		tracker_reply (reply, &ret_len);
+		metrics_add (METRICS_FAILURES + reply, 1);
+		metrics_add (METRICS_REPLY_BYTES, ret_len);
+		ret_val = MHD_queue_response (conn, MHD_HTTP_OK,
+				replies[reply]);
+		trace_mark (TRACE_QUEUE);
+		goto out;
+	}
+
+	if (reply == TRACKER_REPLY_FULL_SCRAPE) {
+		fs = scrape_full_open ();
+		if (fs == NULL)
+			goto out;
+
+		response = MHD_create_response_from_callback (
+				scrape_full_size (fs), FULL_SCRAPE_BLOCK,
+				&full_scrape_reader, fs, &full_scrape_free);
+		if (response == NULL)
+			scrape_full_close (fs);
+	} else {
+		/*
+		 * The reply lives in the arena, which is reset before MHD
+		 * sends it, so MHD takes its own copy: a heap allocation
+		 * and a copy per reply on top of the response itself.
+		 */
+		response = MHD_create_response_from_data (ret_len,
+				(void *) ret, MHD_NO, MHD_YES);
+	}
+
 	if (response == NULL) {
-		free (ret);
 		debug (LOG_ERR, "ERROR: Unable to create MHD response.\n");
-		return MHD_NO;
+		goto out;
 	}
 
+	if (add_headers (response) != 0)
+		goto out;
+
+#ifdef DEBUG
+	if (LOG_ENABLED (LOG_DBG)) {
+		debug (LOG_DBG, "ret: %.*s\n", (int) ret_len, ret);
+		MHD_get_response_headers (response, key_val_iterator, NULL);
+	}
+#endif /* DEBUG */
+	ret_val = MHD_queue_response (conn, MHD_HTTP_OK, response);
+	trace_mark (TRACE_QUEUE);
+	if ((ret_val == MHD_YES) && (reply != TRACKER_REPLY_FULL_SCRAPE))
+		metrics_add (METRICS_REPLY_BYTES, ret_len);
+
+out:
+	if (response != NULL)
+		MHD_destroy_response (response);
+
+	if (arena != NULL)
+		arena_reset (arena);
+
+	if (ret_val == MHD_NO)
+		metrics_add (METRICS_ERRORS, 1);
+
+	metrics_time (METRICS_TOTAL, start);
+	trace_end ((ret_val == MHD_YES) ? reply : TRACKER_REPLY_ERROR);
+
+	return ret_val;
+}
+
+static int
+add_headers (struct MHD_Response *response)
+{
 	if (MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE,
 				"text/plain") == MHD_NO) {
 		debug (LOG_ERR, "ERROR: Unable to set Conntent-Type "
 				"text/plain.");
-		MHD_destroy_response (response);
-		free (ret);
-		return MHD_NO;
+		return -1;
 	}
 
 	if (MHD_add_response_header (response, MHD_HTTP_HEADER_PRAGMA,
 				"no-cache") == MHD_NO) {
 		debug (LOG_ERR, "ERROR: Unable to set Pragma no-cache.");
-		MHD_destroy_response (response);
-		free (ret);
-		return MHD_NO;
+		return -1;
 	}
 
-	if (MHD_add_response_header (response, "Keep-Alive", "timeout=15, "
-				"max=100") == MHD_NO) {
-		debug (LOG_ERR, "ERROR: Unable to set Keep-Alive timeout=15 "
-				"max=100.");
-		MHD_destroy_response (response);
-		free (ret);
-		return MHD_NO;
+	if ((keep_alive[0] != '\0') && (MHD_add_response_header (response,
+					"Keep-Alive", keep_alive) == MHD_NO)) {
+		debug (LOG_ERR, "ERROR: Unable to set Keep-Alive %s.",
+				keep_alive);
+		return -1;
 	}
 
 	if (MHD_add_response_header (response, MHD_HTTP_HEADER_CONNECTION,
 				"Keep-Alive") == MHD_NO) {
 		debug (LOG_ERR, "ERROR: Unable to set Connection Keep-Alive.");
-		MHD_destroy_response (response);
-		free (ret);
-		return MHD_NO;
+		return -1;
 	}
 
-#ifdef DEBUG
-	debug (LOG_DBG, "ret: %s\n", ret);
-	MHD_get_response_headers (response, key_val_iterator, NULL);
-#endif /* DEBUG */
-	ret_val = MHD_queue_response (conn, MHD_HTTP_OK, response);
-	MHD_destroy_response (response);
+	return 0;
+}
 
-	return ret_val;
+/*
+ * Every backend runs the daemon's own threads, select is limited to
+ * descriptors below FD_SETSIZE.
+ */
+static inline int
+backend_flags (const char *name, unsigned int *flags)
+{
+	*flags = MHD_USE_SELECT_INTERNALLY;
+	if (strcmp (name, "select") == 0)
+		return 0;
+
+	if (strcmp (name, "poll") == 0) {
+		*flags |= MHD_USE_POLL;
+		return 0;
+	}
+
+	if (strcmp (name, "epoll") == 0) {
+		*flags |= MHD_USE_EPOLL_LINUX_ONLY;
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Fills in the connection limits that are configured, a limit of 0 keeps
+ * the libmicrohttpd default.  The list ends with MHD_OPTION_END.
+ */
+static inline uint32_t
+connection_options (struct MHD_OptionItem *opts)
+{
+	uint32_t n = 0;
+
+	if (http_connection_limit != 0) {
+		opts[n].option = MHD_OPTION_CONNECTION_LIMIT;
+		opts[n].value = http_connection_limit;
+		opts[n++].ptr_value = NULL;
+	}
+
+	opts[n].option = MHD_OPTION_CONNECTION_TIMEOUT;
+	opts[n].value = http_connection_timeout;
+	opts[n++].ptr_value = NULL;
+	if (http_connection_memory_limit != 0) {
+		opts[n].option = MHD_OPTION_CONNECTION_MEMORY_LIMIT;
+		opts[n].value = (intptr_t) http_connection_memory_limit;
+		opts[n++].ptr_value = NULL;
+	}
+
+	if (http_per_ip_connection_limit != 0) {
+		opts[n].option = MHD_OPTION_PER_IP_CONNECTION_LIMIT;
+		opts[n].value = http_per_ip_connection_limit;
+		opts[n++].ptr_value = NULL;
+	}
+
+	opts[n].option = MHD_OPTION_END;
+	opts[n].value = 0;
+	opts[n].ptr_value = NULL;
+
+	return n;
+}
+
+static ssize_t
+full_scrape_reader (void *cls, uint64_t pos, char *buf, size_t max)
+{
+	ssize_t n;
+
+	n = scrape_full_read ((scrape_full_t *) cls, pos, buf, max);
+	if (n < 0)
+		return MHD_CONTENT_READER_END_OF_STREAM;
+
+	metrics_add (METRICS_REPLY_BYTES, (uint64_t) n);
+
+	return n;
 }
 
+static void
+full_scrape_free (void *cls)
+{
+	scrape_full_close ((scrape_full_t *) cls);
+
+	return;
+}
+
+/*
+ * Announce arguments arrive still percent encoded, see unescape_none (),
+ * and are parsed in a single walk over the argument list.
+ */
 static inline announce_info_t *
-get_announce_info (struct MHD_Connection *conn)
+get_announce_info (arena_t *arena, struct MHD_Connection *conn)
 {
 	announce_info_t *ai;
 	const union MHD_ConnectionInfo *ci;
-	const char *tmp;
 
-	ai = (announce_info_t *) malloc (sizeof (announce_info_t));
+	ai = (announce_info_t *) arena_alloc (arena, sizeof (announce_info_t));
 	if (ai == NULL) {
 		debug (LOG_ERR, "ERROR: out-of-memory.\n");
 		return NULL;
 	}
 
 	memset (ai, 0, sizeof (announce_info_t));
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"info_hash");
-	if (tmp != NULL)
-		ai->info_hash = strdup (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"peer_id");
-	if (tmp != NULL)
-		ai->peer_id = strdup (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"ip");
-	if (tmp != NULL)
-		ai->ip = strdup (tmp);
-
-	if (ai->ip == NULL) {
+	ai->numwant = -1;
+	MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND,
+			announce_arg_iterator, ai);
+	if ((ai->fields & ANNOUNCE_IP) == 0) {
 		ci = MHD_get_connection_info (conn,
 				MHD_CONNECTION_INFO_CLIENT_ADDRESS);
-		ai->ip = strdup (inet_ntoa (ci->client_addr->sin_addr));
+		ai->ip = ci->client_addr->sin_addr;
 	}
 
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"port");
-	if (tmp != NULL)
-		ai->port = (uint16_t) atoi (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"uploaded");
-	if (tmp != NULL)
-		ai->uploaded = (int64_t) atoll (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"downloaded");
-	if (tmp != NULL)
-		ai->downloaded = (int64_t) atoll (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"uploaded");
-	if (tmp != NULL)
-		ai->left = (int64_t) atoll (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"corrupt");
-	if (tmp != NULL)
-		ai->corrupt = (int64_t) atoll (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"compact");
-	if (tmp != NULL)
-		ai->compact = (uint8_t) atoi (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"no_peer_id");
-	if (tmp != NULL)
-		ai->no_peer_id = (uint8_t) atoi (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"event");
-	if (tmp != NULL)
-		ai->event = parse_event (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"numwant");
-	if (tmp != NULL)
-		ai->numwant = (int32_t) atoi (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"key");
-	if (tmp != NULL)
-		ai->key = strdup (tmp);
-
-	tmp = MHD_lookup_connection_value (conn, MHD_GET_ARGUMENT_KIND,
-			"tracker_id");
-	if (tmp != NULL)
-		ai->tracker_id = strdup (tmp);
+#ifdef DEBUG
+	if (LOG_ENABLED (LOG_DBG))
+		print_announce_info (ai);
+#endif /* DEBUG */
 
 	return ai;
 }
 
-	static inline uint8_t
-parse_event (const char *event)
+/*
+ * Collects every info_hash argument of a scrape, returns NULL if one of
+ * them is malformed.
+ */
+static inline scrape_info_t *
+get_scrape_info (arena_t *arena, struct MHD_Connection *conn)
 {
-	if (strcmp (event, "completed") == 0)
-		return 1;
+	scrape_info_t *si;
 
-	if (strcmp (event, "started") == 0)
-		return 2;
+	si = (scrape_info_t *) arena_alloc (arena, sizeof (scrape_info_t));
+	if (si != NULL)
+		si->info_hash = arena_alloc (arena, SCRAPE_MAX * INFO_HASH_LEN);
 
-	if (strcmp (event, "stopped") == 0)
-		return 3;
+	if ((si == NULL) || (si->info_hash == NULL)) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
 
-	return 0;
+	si->count = 0;
+	si->size = SCRAPE_MAX;
+	MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND,
+			scrape_arg_iterator, si);
+
+	// A malformed info_hash clears si->size and stops the walk.
+	if (si->size == 0)
+		return NULL;
+
+	return si;
+}
+
+/*
+ * A malformed argument clears ai->fields, which makes the tracker reject
+ * the announce for missing its required arguments.
+ */
+static int
+announce_arg_iterator (void *cls, enum MHD_ValueKind kind, const char *key,
+		const char *value)
+{
+	announce_info_t *ai = (announce_info_t *) cls;
+
+	(void) kind;
+	if (announce_parse_arg (ai, key, strlen (key), value,
+				(value == NULL) ? 0 : strlen (value)) != 0) {
+		ai->fields = 0;
+		return MHD_NO;
+	}
+
+	return MHD_YES;
+}
+
+static int
+scrape_arg_iterator (void *cls, enum MHD_ValueKind kind, const char *key,
+		const char *value)
+{
+	scrape_info_t *si = (scrape_info_t *) cls;
+
+	(void) kind;
+	if (scrape_parse_arg (si, key, strlen (key), value,
+				(value == NULL) ? 0 : strlen (value)) != 0) {
+		si->size = 0;
+		return MHD_NO;
+	}
+
+	return MHD_YES;
+}
+
+/*
+ * Leaves the URL and its arguments percent encoded, binary arguments are
+ * decoded by announce_parse_arg () which keeps embedded NUL bytes.
+ */
+static size_t
+unescape_none (void *cls, struct MHD_Connection *conn, char *s)
+{
+	(void) cls;
+	(void) conn;
+
+	return strlen (s);
 }
 
 #ifdef DEBUG
@@ -279,15 +503,18 @@ key_val_iterator (void *cls, enum MHD_ValueKind kind, const char *key,
 static inline void
 print_announce_info (announce_info_t *ai)
 {
+	char ip[INET_ADDRSTRLEN];
+
 	debug (LOG_DBG, "announce info:\n");
 	debug (LOG_DBG, "info_hash:\n");
-	print_hex (ai->info_hash);
+	print_hex (ai->info_hash, INFO_HASH_LEN);
 	debug (LOG_DBG, "peer_id: %c%c%c%c%c%c%c%c\n", ai->peer_id[0],
 			ai->peer_id[1], ai->peer_id[2], ai->peer_id[3],
 			ai->peer_id[4], ai->peer_id[5], ai->peer_id[6],
 			ai->peer_id[7]);
-	print_hex (ai->peer_id + 8);
-	debug (LOG_DBG, "ip: %s\n", ai->ip);
+	print_hex (ai->peer_id + 8, PEER_ID_LEN - 8);
+	debug (LOG_DBG, "ip: %s\n", inet_ntop (AF_INET, &ai->ip, ip,
+				sizeof (ip)));
 	debug (LOG_DBG, "port: %" PRIu16" \n", ai->port);
 	debug (LOG_DBG, "uploaded: %" PRId64 "\n", ai->uploaded);
 	debug (LOG_DBG, "downloaded: %" PRId64 "\n", ai->downloaded);
@@ -297,31 +524,27 @@ print_announce_info (announce_info_t *ai)
 	debug (LOG_DBG, "no_peer_id: %" PRIu8 "\n", ai->no_peer_id);
 	debug (LOG_DBG, "event: %" PRIu8 "\n", ai->event);
 	debug (LOG_DBG, "numwant: %" PRId32 "\n", ai->numwant);
-	debug (LOG_DBG, "key: %s\n", ai->key);
-	debug (LOG_DBG, "tracker_id: %s\n", ai->tracker_id);
+	debug (LOG_DBG, "key: %08" PRIx32 "\n", ai->key);
+	debug (LOG_DBG, "tracker_id: %.*s\n", (int) ai->tracker_id_len,
+			ai->tracker_id);
 
 	return;
 }
 
 static void
-print_hex (char *str)
+print_hex (const uint8_t *buf, size_t len)
 {
-	char *out, *tmp;
+	char out[2 * INFO_HASH_LEN + 1];
 	size_t i;
 
-	if (strlen (str) != 20)
-		debug (LOG_DBG, "strlen: %zu\n", strlen (str));
+	if (len > INFO_HASH_LEN)
+		len = INFO_HASH_LEN;
 
-	out = (char *) malloc (sizeof (char) * (2 * strlen (str) + 1));
-	memset (out, 0, sizeof (char) * (2 * strlen (str) + 1));
-	tmp = out;
-	for (i = 0; i < strlen (str); i++) {
-		sprintf (tmp, "%0hhx", str[i]);
-		tmp += 2;
-	}
+	for (i = 0; i < len; i++)
+		sprintf (out + 2 * i, "%02hhx", buf[i]);
 
+	out[2 * len] = '\0';
 	debug (LOG_DBG, "%s\n", out);
-	free (out);
 
 	return;
 }
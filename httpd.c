@@ -0,0 +1,775 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "arena.h"
+#include "config.h"
+#include "event.h"
+#include "httpd.h"
+#include "logger.h"
+#include "metrics.h"
+#include "query.h"
+#include "scrape.h"
+#include "trace.h"
+#include "tracker.h"
+#include "wheel.h"
+
+#define HTTPD_BACKLOG 1024
+#define HTTPD_EVENTS 256
+// Pipelined requests wait while this much output is queued.
+#define HTTPD_OUT_HIGH 65536
+#define HTTPD_OUT_MIN 4096
+// Longest response head.
+#define HTTPD_HEAD_MAX 256
+// Largest piece of a full scrape read at once and its chunk framing.
+#define HTTPD_SCRAPE_BLOCK 65536
+#define HTTPD_CHUNK_HEAD (sizeof ("00000000\r\n") - 1)
+#define HTTPD_CHUNK_END (sizeof ("\r\n0\r\n\r\n") - 1)
+
+/*
+ * in holds the bytes received and not yet answered from in_pos on, out the
+ * bytes not yet sent from out_pos on.  A connection streaming a full
+ * scrape has fs set and refills out from it whenever out runs dry.
+ */
+typedef struct __httpd_conn_type httpd_conn_t;
+
+struct __httpd_conn_type {
+	wheel_node_t node;
+	httpd_conn_t *next;
+	httpd_conn_t *prev;
+	int fd;
+	struct in_addr ip;
+	uint8_t close;
+	uint8_t http11;
+	uint8_t chunked;
+	scrape_full_t *fs;
+	uint64_t fs_pos;
+	char *out;
+	size_t out_pos;
+	size_t out_len;
+	size_t out_size;
+	size_t in_pos;
+	size_t in_len;
+	char in[HTTPD_REQUEST_MAX];
+};
+
+typedef struct __httpd_worker_type {
+	pthread_t thrd;
+	uint8_t thrd_valid;
+	int fd;
+	int epfd;
+	wheel_t wheel;
+	httpd_conn_t *conns;
+} httpd_worker_t;
+
+static void accept_conns (httpd_worker_t *);
+static void conn_close (httpd_worker_t *, httpd_conn_t *);
+static int conn_flush (httpd_conn_t *);
+static int conn_process (httpd_conn_t *);
+static int conn_run (httpd_worker_t *, httpd_conn_t *);
+static int handle_request (httpd_conn_t *, char *, size_t);
+static void *httpd_thread (void *);
+static int out_head (httpd_conn_t *, uint64_t);
+static inline int out_reserve (httpd_conn_t *, size_t);
+static int reply_body (httpd_conn_t *, const char *, size_t);
+static int reply_fixed (httpd_conn_t *, enum TRACKER_REPLY);
+static int scrape_fill (httpd_conn_t *);
+
+static httpd_worker_t *workers = NULL;
+static uint32_t worker_count = 0;
+static uint32_t conn_count = 0;
+static char keep_alive[sizeof ("Connection: Keep-Alive\r\nKeep-Alive: "
+		"timeout=4294967295\r\n")];
+static int stop = 0;
+
+void
+httpd_fin (void)
+{
+	uint32_t i;
+
+	__atomic_store_n (&stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < worker_count; i++) {
+		if (workers[i].thrd_valid != 0)
+			pthread_join (workers[i].thrd, NULL);
+
+		if (workers[i].epfd >= 0)
+			close (workers[i].epfd);
+
+		if (workers[i].fd >= 0)
+			close (workers[i].fd);
+	}
+
+	free (workers);
+	workers = NULL;
+	worker_count = 0;
+
+	return;
+}
+
+int
+httpd_init (void)
+{
+	struct sockaddr_in sock_addr;
+	struct epoll_event ev;
+	httpd_worker_t *w;
+	uint16_t tcp_port;
+	uint32_t i;
+	long cpus;
+	int on = 1;
+
+	if (http_frontend_threads == 0) {
+		cpus = sysconf (_SC_NPROCESSORS_ONLN);
+		http_frontend_threads = (cpus > 0) ? (uint32_t) cpus : 1;
+	}
+
+	workers = (httpd_worker_t *) calloc (http_frontend_threads,
+			sizeof (httpd_worker_t));
+	if (workers == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	for (i = 0; i < http_frontend_threads; i++) {
+		workers[i].fd = -1;
+		workers[i].epfd = -1;
+	}
+
+	worker_count = http_frontend_threads;
+	stop = 0;
+	snprintf (keep_alive, sizeof (keep_alive), "Connection: "
+			"Keep-Alive\r\n");
+	if (http_connection_timeout != 0)
+		snprintf (keep_alive, sizeof (keep_alive), "Connection: "
+				"Keep-Alive\r\nKeep-Alive: timeout=%" PRIu32
+				"\r\n", http_connection_timeout);
+
+	tcp_port = (uint16_t) atoi ((const char *) port);
+	memset (&sock_addr, 0, sizeof (struct sockaddr_in));
+	sock_addr.sin_family = AF_INET;
+	sock_addr.sin_addr.s_addr = inet_addr (ip);
+	sock_addr.sin_port = htons (tcp_port);
+	for (i = 0; i < worker_count; i++) {
+		w = &workers[i];
+		w->fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK
+				| SOCK_CLOEXEC, 0);
+		if (w->fd < 0) {
+			debug (LOG_ERR, "ERROR: unable to create http socket: "
+					"%s.\n", strerror (errno));
+			httpd_fin ();
+			return -1;
+		}
+
+		if ((setsockopt (w->fd, SOL_SOCKET, SO_REUSEADDR, &on,
+						sizeof (on)) != 0)
+				|| (setsockopt (w->fd, SOL_SOCKET,
+						SO_REUSEPORT, &on,
+						sizeof (on)) != 0)) {
+			debug (LOG_ERR, "ERROR: unable to set http socket "
+					"options: %s.\n", strerror (errno));
+			httpd_fin ();
+			return -1;
+		}
+
+		if ((bind (w->fd, (struct sockaddr *) &sock_addr,
+						sizeof (sock_addr)) != 0)
+				|| (listen (w->fd, HTTPD_BACKLOG) != 0)) {
+			debug (LOG_ERR, "ERROR: unable to listen on http "
+					"socket: %s.\n", strerror (errno));
+			httpd_fin ();
+			return -1;
+		}
+
+		// The listening socket is the only one without a connection.
+		w->epfd = epoll_create1 (EPOLL_CLOEXEC);
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = NULL;
+		if ((w->epfd < 0) || (epoll_ctl (w->epfd, EPOLL_CTL_ADD,
+						w->fd, &ev) != 0)) {
+			debug (LOG_ERR, "ERROR: unable to set up epoll: %s.\n",
+					strerror (errno));
+			httpd_fin ();
+			return -1;
+		}
+	}
+
+	for (i = 0; i < worker_count; i++) {
+		if (pthread_create (&workers[i].thrd, NULL, httpd_thread,
+					&workers[i]) != 0) {
+			debug (LOG_ERR, "ERROR: unable to start http "
+					"thread.\n");
+			httpd_fin ();
+			return -1;
+		}
+
+		workers[i].thrd_valid = 1;
+	}
+
+	return 0;
+}
+
+static void
+accept_conns (httpd_worker_t *w)
+{
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	httpd_conn_t *c;
+	socklen_t len;
+	uint32_t n;
+	int fd, on = 1;
+
+	while (1) {
+		len = sizeof (addr);
+		fd = accept4 (w->fd, (struct sockaddr *) &addr, &len,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if ((errno == EINTR) || (errno == ECONNABORTED))
+				continue;
+
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				debug (LOG_ERR, "ERROR: http accept failed: "
+						"%s.\n", strerror (errno));
+
+			return;
+		}
+
+		n = __atomic_add_fetch (&conn_count, 1, __ATOMIC_RELAXED);
+		if ((http_connection_limit != 0)
+				&& (n > http_connection_limit)) {
+			__atomic_sub_fetch (&conn_count, 1, __ATOMIC_RELAXED);
+			close (fd);
+			continue;
+		}
+
+		c = (httpd_conn_t *) malloc (sizeof (httpd_conn_t));
+		if (c == NULL) {
+			__atomic_sub_fetch (&conn_count, 1, __ATOMIC_RELAXED);
+			close (fd);
+			debug (LOG_ERR, "ERROR: out-of-memory.\n");
+			continue;
+		}
+
+		memset (c, 0, offsetof (httpd_conn_t, in));
+		c->fd = fd;
+		c->ip = addr.sin_addr;
+		setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on));
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.ptr = c;
+		if (epoll_ctl (w->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			__atomic_sub_fetch (&conn_count, 1, __ATOMIC_RELAXED);
+			close (fd);
+			free (c);
+			debug (LOG_ERR, "ERROR: unable to watch http "
+					"connection: %s.\n", strerror (errno));
+			continue;
+		}
+
+		c->next = w->conns;
+		if (w->conns != NULL)
+			w->conns->prev = c;
+
+		w->conns = c;
+		if (http_connection_timeout != 0)
+			wheel_add (&w->wheel, &c->node, event_now ()
+					+ http_connection_timeout);
+	}
+
+	return;
+}
+
+static void
+conn_close (httpd_worker_t *w, httpd_conn_t *c)
+{
+	wheel_del (&c->node);
+	if (c->prev != NULL)
+		c->prev->next = c->next;
+	else
+		w->conns = c->next;
+
+	if (c->next != NULL)
+		c->next->prev = c->prev;
+
+	if (c->fs != NULL)
+		scrape_full_close (c->fs);
+
+	close (c->fd);
+	free (c->out);
+	free (c);
+	__atomic_sub_fetch (&conn_count, 1, __ATOMIC_RELAXED);
+
+	return;
+}
+
+/*
+ * Sends what is queued, refilling from a full scrape in progress.  Returns
+ * 0 once everything is sent, 1 if the socket is full and -1 on error.
+ */
+static int
+conn_flush (httpd_conn_t *c)
+{
+	ssize_t n;
+
+	while (1) {
+		if (c->out_pos == c->out_len) {
+			c->out_pos = 0;
+			c->out_len = 0;
+			if (c->fs == NULL)
+				break;
+
+			if (scrape_fill (c) != 0)
+				return -1;
+
+			continue;
+		}
+
+		n = send (c->fd, c->out + c->out_pos, c->out_len - c->out_pos,
+				MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return 1;
+
+			return -1;
+		}
+
+		c->out_pos += (size_t) n;
+	}
+
+	// Give back what a full scrape made the buffer grow to.
+	if (c->out_size > HTTPD_OUT_HIGH) {
+		free (c->out);
+		c->out = NULL;
+		c->out_size = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Answers the complete requests received so far, in order, until one of
+ * them closes the connection or starts a full scrape or enough output is
+ * queued.
+ */
+static int
+conn_process (httpd_conn_t *c)
+{
+	char *end, *head;
+	size_t len;
+
+	while ((c->close == 0) && (c->fs == NULL)
+			&& (c->out_len - c->out_pos < HTTPD_OUT_HIGH)) {
+		head = c->in + c->in_pos;
+		len = c->in_len - c->in_pos;
+		end = (char *) memmem (head, len, "\r\n\r\n", 4);
+		if (end == NULL) {
+			if ((c->in_pos > 0) || (c->in_len < HTTPD_REQUEST_MAX))
+				break;
+
+			// A request head that does not fit is refused.
+			c->close = 1;
+			return reply_fixed (c, TRACKER_REPLY_BAD_REQUEST);
+		}
+
+		c->in_pos += (size_t) (end - head) + 4;
+		if (handle_request (c, head, (size_t) (end - head)) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Handles an event on a connection: answers, sends and reads until the
+ * socket has nothing more to give or take.  Returns -1 if the connection
+ * is to be closed.
+ */
+static int
+conn_run (httpd_worker_t *w, httpd_conn_t *c)
+{
+	ssize_t n;
+	int eof = 0, rc;
+
+	if (http_connection_timeout != 0)
+		wheel_add (&w->wheel, &c->node, event_now ()
+				+ http_connection_timeout);
+
+	while (1) {
+		if (conn_process (c) != 0)
+			return -1;
+
+		rc = conn_flush (c);
+		if (rc != 0)
+			return (rc < 0) ? -1 : 0;
+
+		if ((c->close != 0) || (eof != 0))
+			return -1;
+
+		if (c->in_pos > 0) {
+			memmove (c->in, c->in + c->in_pos, c->in_len
+					- c->in_pos);
+			c->in_len -= c->in_pos;
+			c->in_pos = 0;
+		}
+
+		// A full buffer was refused by conn_process () already.
+		if (c->in_len == HTTPD_REQUEST_MAX)
+			return 0;
+
+		n = recv (c->fd, c->in + c->in_len, HTTPD_REQUEST_MAX
+				- c->in_len, 0);
+		if (n > 0) {
+			c->in_len += (size_t) n;
+			continue;
+		}
+
+		// Answer what was pipelined before the client hung up.
+		if (n == 0) {
+			eof = 1;
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			return 0;
+
+		return -1;
+	}
+}
+
+/*
+ * Answers one request, head is the request line and headers without the
+ * blank line and is NUL terminated in place.  The passkey and request are
+ * split off the path the way the libmicrohttpd front end does.
+ */
+static int
+handle_request (httpd_conn_t *c, char *head, size_t len)
+{
+	announce_info_t *ai = NULL;
+	scrape_info_t *si = NULL;
+	scrape_full_t *fs;
+	arena_t *arena;
+	char *line, *p, *path, *pkey, *query = NULL, *req = NULL, *ret = NULL;
+	size_t qlen = 0, ret_len = 0;
+	uint64_t start, t;
+	int rc, reply;
+
+	start = metrics_clock ();
+	head[len] = '\0';
+	while ((*head == '\r') || (*head == '\n'))
+		head++;
+
+	line = strstr (head, "\r\n");
+	if (line != NULL) {
+		*line = '\0';
+		line += 2;
+	}
+
+	p = NULL;
+	if (strncmp (head, "GET /", 5) == 0)
+		p = strchr (head + 4, ' ');
+
+	if (p == NULL) {
+		c->close = 1;
+		return reply_fixed (c, TRACKER_REPLY_BAD_REQUEST);
+	}
+
+	trace_begin (TRACE_NATIVE);
+	*p++ = '\0';
+	c->http11 = (strcmp (p, "HTTP/1.1") == 0);
+	c->close = (c->http11 == 0);
+	while (line != NULL) {
+		p = strstr (line, "\r\n");
+		if (p != NULL)
+			*p = '\0';
+
+		if (strncasecmp (line, "Connection:", 11) == 0) {
+			if (strcasestr (line + 11, "close") != NULL)
+				c->close = 1;
+			else if (strcasestr (line + 11, "keep-alive") != NULL)
+				c->close = 0;
+		}
+
+		line = (p != NULL) ? p + 2 : NULL;
+	}
+
+	path = head + 4;
+	p = strchr (path, '?');
+	if (p != NULL) {
+		*p = '\0';
+		query = p + 1;
+		qlen = strlen (query);
+	}
+
+	while (*path == '/')
+		path++;
+
+	pkey = (*path != '\0') ? path : NULL;
+	p = strchr (path, '/');
+	if (p != NULL) {
+		*p = '\0';
+		if (*(p + 1) != '\0')
+			req = p + 1;
+	}
+
+	trace_mark (TRACE_SPLIT);
+	arena = arena_get ();
+	if (arena == NULL) {
+		metrics_add (METRICS_ERRORS, 1);
+		metrics_time (METRICS_TOTAL, start);
+		trace_end (TRACKER_REPLY_ERROR);
+		return -1;
+	}
+
+	if ((req != NULL) && (strcmp (req, "announce") == 0)) {
+		ai = (announce_info_t *) arena_alloc (arena,
+				sizeof (announce_info_t));
+		if (ai != NULL) {
+			memset (ai, 0, sizeof (announce_info_t));
+			ai->numwant = -1;
+			// Malformed arguments fail the required fields check.
+			t = metrics_clock ();
+			if (announce_parse (ai, query, qlen) != 0)
+				ai->fields = 0;
+
+			metrics_time (METRICS_PARSE, t);
+			trace_mark (TRACE_PARSE);
+
+			if ((ai->fields & ANNOUNCE_IP) == 0)
+				ai->ip = c->ip;
+		}
+
+		reply = tracker_handle_request (pkey, req, ai, si, &ret,
+				&ret_len);
+	} else if ((req != NULL) && (strcmp (req, "scrape") == 0)) {
+		si = (scrape_info_t *) arena_alloc (arena,
+				sizeof (scrape_info_t));
+		if (si != NULL)
+			si->info_hash = arena_alloc (arena, SCRAPE_MAX
+					* INFO_HASH_LEN);
+
+		reply = TRACKER_REPLY_BAD_REQUEST;
+		if ((si != NULL) && (si->info_hash != NULL)) {
+			si->count = 0;
+			si->size = SCRAPE_MAX;
+			t = metrics_clock ();
+			rc = scrape_parse (si, query, qlen);
+			metrics_time (METRICS_PARSE, t);
+			trace_mark (TRACE_PARSE);
+			if (rc == 0)
+				reply = tracker_handle_request (pkey, req, ai,
+						si, &ret, &ret_len);
+		}
+	} else {
+		reply = tracker_handle_request (pkey, req, ai, si, &ret,
+				&ret_len);
+	}
+
+	rc = -1;
+	if (reply >= 0) {
+		rc = reply_fixed (c, (enum TRACKER_REPLY) reply);
+	} else if (reply == TRACKER_REPLY_OK) {
+		rc = reply_body (c, ret, ret_len);
+	} else if (reply == TRACKER_REPLY_FULL_SCRAPE) {
+		fs = scrape_full_open ();
+		if (fs != NULL) {
+			c->fs = fs;
+			c->fs_pos = 0;
+			rc = out_head (c, scrape_full_size (fs));
+		}
+	}
+
+	trace_mark (TRACE_QUEUE);
+	arena_reset (arena);
+	if (rc != 0)
+		metrics_add (METRICS_ERRORS, 1);
+
+	metrics_time (METRICS_TOTAL, start);
+	trace_end ((rc == 0) ? reply : TRACKER_REPLY_ERROR);
+
+	return rc;
+}
+
+static void *
+httpd_thread (void *arg)
+{
+	httpd_worker_t *w = (httpd_worker_t *) arg;
+	struct epoll_event events[HTTPD_EVENTS];
+	wheel_node_t due;
+	httpd_conn_t *c;
+	int i, n;
+
+	wheel_init (&w->wheel, event_now ());
+	while (__atomic_load_n (&stop, __ATOMIC_ACQUIRE) == 0) {
+		// Wake up every second to notice httpd_fin () and idle peers.
+		n = epoll_wait (w->epfd, events, HTTPD_EVENTS, 1000);
+		if ((n < 0) && (errno != EINTR))
+			debug (LOG_ERR, "ERROR: epoll_wait failed: %s.\n",
+					strerror (errno));
+
+		for (i = 0; i < n; i++) {
+			c = (httpd_conn_t *) events[i].data.ptr;
+			if (c == NULL)
+				accept_conns (w);
+			else if (conn_run (w, c) != 0)
+				conn_close (w, c);
+		}
+
+		if (http_connection_timeout == 0)
+			continue;
+
+		wheel_list_init (&due);
+		wheel_advance (&w->wheel, event_now (), &due);
+		while (due.next != &due)
+			conn_close (w, (httpd_conn_t *) due.next);
+	}
+
+	while (w->conns != NULL)
+		conn_close (w, w->conns);
+
+	return NULL;
+}
+
+/*
+ * Queues the response head for a body of len bytes.  A body of unknown
+ * length, UINT64_MAX, is sent chunked to HTTP/1.1 clients and ends the
+ * connection for the others.
+ */
+static int
+out_head (httpd_conn_t *c, uint64_t len)
+{
+	char *p;
+	int n;
+
+	if (out_reserve (c, HTTPD_HEAD_MAX) != 0)
+		return -1;
+
+	c->chunked = 0;
+	if ((len == UINT64_MAX) && (c->http11 != 0))
+		c->chunked = 1;
+	else if (len == UINT64_MAX)
+		c->close = 1;
+
+	p = c->out + c->out_len;
+	n = snprintf (p, HTTPD_HEAD_MAX, "HTTP/1.1 200 OK\r\nContent-Type: "
+			"text/plain\r\nPragma: no-cache\r\n");
+	if (c->chunked != 0)
+		n += snprintf (p + n, HTTPD_HEAD_MAX - n, "Transfer-Encoding: "
+				"chunked\r\n");
+	else if (len != UINT64_MAX)
+		n += snprintf (p + n, HTTPD_HEAD_MAX - n, "Content-Length: %"
+				PRIu64 "\r\n", len);
+
+	n += snprintf (p + n, HTTPD_HEAD_MAX - n, "%s\r\n", (c->close != 0)
+			? "Connection: close\r\n" : keep_alive);
+	c->out_len += (size_t) n;
+
+	return 0;
+}
+
+static inline int
+out_reserve (httpd_conn_t *c, size_t len)
+{
+	size_t size;
+	char *p;
+
+	if (c->out_len + len <= c->out_size)
+		return 0;
+
+	size = (c->out_size == 0) ? HTTPD_OUT_MIN : c->out_size;
+	while (size < c->out_len + len)
+		size <<= 1;
+
+	p = (char *) realloc (c->out, size);
+	if (p == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	c->out = p;
+	c->out_size = size;
+
+	return 0;
+}
+
+static int
+reply_body (httpd_conn_t *c, const char *body, size_t len)
+{
+	if ((out_head (c, len) != 0) || (out_reserve (c, len) != 0))
+		return -1;
+
+	memcpy (c->out + c->out_len, body, len);
+	c->out_len += len;
+	metrics_add (METRICS_REPLY_BYTES, len);
+
+	return 0;
+}
+
+static int
+reply_fixed (httpd_conn_t *c, enum TRACKER_REPLY reply)
+{
+	const char *str;
+	size_t len;
+
+	str = tracker_reply (reply, &len);
+	metrics_add (METRICS_FAILURES + reply, 1);
+
+	return reply_body (c, str, len);
+}
+
+// Appends the next piece of the full scrape, or its end, to out.
+static int
+scrape_fill (httpd_conn_t *c)
+{
+	char head[sizeof ("ffffffffffffffff\r\n")];
+	size_t skip = 0;
+	ssize_t n;
+	char *p;
+
+	if (out_reserve (c, HTTPD_SCRAPE_BLOCK + HTTPD_CHUNK_HEAD
+				+ HTTPD_CHUNK_END) != 0)
+		return -1;
+
+	if (c->chunked != 0)
+		skip = HTTPD_CHUNK_HEAD;
+
+	p = c->out + c->out_len;
+	n = scrape_full_read (c->fs, c->fs_pos, p + skip, HTTPD_SCRAPE_BLOCK);
+	if (n <= 0) {
+		scrape_full_close (c->fs);
+		c->fs = NULL;
+		if (c->chunked != 0) {
+			memcpy (p, "0\r\n\r\n", 5);
+			c->out_len += 5;
+		}
+
+		return 0;
+	}
+
+	c->fs_pos += (uint64_t) n;
+	metrics_add (METRICS_REPLY_BYTES, (uint64_t) n);
+	if (c->chunked != 0) {
+		snprintf (head, sizeof (head), "%08zx\r\n", (size_t) n);
+		memcpy (p, head, HTTPD_CHUNK_HEAD);
+		memcpy (p + skip + n, "\r\n", 2);
+		c->out_len += 2;
+	}
+
+	c->out_len += skip + (size_t) n;
+
+	return 0;
+}
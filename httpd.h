@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __HTTPD_H__
+#define __HTTPD_H__
+
+/*
+ * Native HTTP/1.1 front end, used instead of libmicrohttpd when
+ * http_frontend is native.
+ *
+ * http_frontend_threads listening sockets share the port with SO_REUSEPORT,
+ * one per core by default, each with its own thread and edge-triggered
+ * epoll set.  Only the request line and the Connection header are looked
+ * at: GET /<passkey>/announce and /<passkey>/scrape are parsed with
+ * announce_parse () and scrape_parse () and answered by
+ * tracker_handle_request () like the libmicrohttpd front end does.
+ *
+ * Connections are kept alive unless the client asks otherwise and
+ * pipelined requests are answered in order.  Idle connections are closed
+ * after http_connection_timeout seconds by a timing wheel per thread.  A
+ * request head may be at most HTTPD_REQUEST_MAX bytes.
+ * http_connection_limit caps the connections of all threads together, the
+ * other libmicrohttpd limits do not apply.
+ */
+
+#define HTTPD_REQUEST_MAX 8192
+
+void httpd_fin (void);
+int httpd_init (void);
+
+#endif /* __HTTPD_H__ */
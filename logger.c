@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "logger.h"
+
+#define LOG_LINE_MAX 1024
+#define LOG_FLUSH_MS 100
+#define LOG_BATCH_MAX 32
+
+/*
+ * A thread's ring, written only by that thread and read only by the
+ * writer.  Positions grow without wrapping, the bytes between head and
+ * tail are whole lines.
+ */
+typedef struct __log_ring_type log_ring_t;
+
+struct __log_ring_type {
+	uint64_t tail;
+	uint64_t head __attribute__ ((aligned (64)));
+	char *buf;
+	log_ring_t *next;
+} __attribute__ ((aligned (64)));
+
+static void drain (void);
+static void put (log_ring_t *, const char *, size_t);
+static log_ring_t *ring_new (void);
+static void wake (void);
+static void write_all (struct iovec *, int);
+static void *writer (void *);
+
+uint8_t log_queued = 0;
+
+static int block = 0;
+static uint64_t dropped = 0;
+static int fd = -1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+static int pending = 0;
+static log_ring_t *rings = NULL;
+static size_t ring_size = 0;
+static int running = 0;
+static __thread log_ring_t *thread_ring = NULL;
+static pthread_t thread;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Stops the writer once it has written out every ring and goes back to
+ * writing synchronously.  No other thread may be logging.
+ */
+void
+logger_async_fin (void)
+{
+	log_ring_t *r;
+
+	if (log_queued == 0)
+		return;
+
+	pthread_mutex_lock (&lock);
+	running = 0;
+	pthread_cond_signal (&wakeup);
+	pthread_mutex_unlock (&lock);
+	pthread_join (thread, NULL);
+	log_queued = 0;
+	while (rings != NULL) {
+		r = rings;
+		rings = r->next;
+		free (r->buf);
+		free (r);
+	}
+
+	if (dropped != 0)
+		logger (LOG_INFO, "INFO: logger dropped %" PRIu64 " lines.\n",
+				dropped);
+
+	return;
+}
+
+/*
+ * Switches logger () to queueing.  Every thread gets a ring of size bytes
+ * the first time it logs, when it is full a line is dropped and counted
+ * or, with block set, the thread waits for the writer.
+ */
+int
+logger_async_init (size_t size, int wait)
+{
+	size_t n = 4 * LOG_LINE_MAX;
+
+	while (n < size)
+		n <<= 1;
+
+	ring_size = n;
+	block = wait;
+	fflush (log_fp);
+	fd = fileno (log_fp);
+	running = 1;
+	if (pthread_create (&thread, NULL, writer, NULL) != 0) {
+		debug (LOG_ERR, "ERROR: unable to start the log writer.\n");
+		running = 0;
+		return -1;
+	}
+
+	__atomic_store_n (&log_queued, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+uint64_t
+logger_dropped (void)
+{
+	return __atomic_load_n (&dropped, __ATOMIC_RELAXED);
+}
+
+// Formats a line and queues it on the calling thread's ring.
+void
+logger_queue (const char *format, va_list ap)
+{
+	log_ring_t *r = thread_ring;
+	char line[LOG_LINE_MAX];
+	int len;
+
+	len = vsnprintf (line, sizeof (line), format, ap);
+	if (len <= 0)
+		return;
+
+	// Cut short lines still end the line.
+	if ((size_t) len >= sizeof (line)) {
+		len = sizeof (line) - 1;
+		line[len - 1] = '\n';
+	}
+
+	if (r == NULL) {
+		r = ring_new ();
+		if (r == NULL) {
+			if (write (fd, line, len) < 0)
+				__atomic_fetch_add (&dropped, 1,
+						__ATOMIC_RELAXED);
+
+			return;
+		}
+
+		thread_ring = r;
+	}
+
+	put (r, line, (size_t) len);
+
+	return;
+}
+
+/*
+ * Writes out what every ring holds, at most LOG_BATCH_MAX rings to a
+ * writev ().  Lines that could not be written are thrown away rather than
+ * left to fill the rings.
+ */
+static void
+drain (void)
+{
+	struct iovec iov[2 * LOG_BATCH_MAX];
+	log_ring_t *batch[LOG_BATCH_MAX], *r;
+	uint64_t head, tail, tails[LOG_BATCH_MAX];
+	size_t len, off;
+	int i, count = 0, n = 0;
+
+	r = __atomic_load_n (&rings, __ATOMIC_ACQUIRE);
+	while (1) {
+		if ((r == NULL) || (count == LOG_BATCH_MAX)) {
+			if (count == 0)
+				break;
+
+			write_all (iov, n);
+			for (i = 0; i < count; i++)
+				__atomic_store_n (&batch[i]->head, tails[i],
+						__ATOMIC_RELEASE);
+
+			count = 0;
+			n = 0;
+			if (r == NULL)
+				break;
+		}
+
+		head = r->head;
+		tail = __atomic_load_n (&r->tail, __ATOMIC_ACQUIRE);
+		if (tail != head) {
+			off = head & (ring_size - 1);
+			len = tail - head;
+			iov[n].iov_base = r->buf + off;
+			if (off + len > ring_size) {
+				iov[n++].iov_len = ring_size - off;
+				iov[n].iov_base = r->buf;
+				len -= ring_size - off;
+			}
+
+			iov[n++].iov_len = len;
+			batch[count] = r;
+			tails[count++] = tail;
+		}
+
+		r = r->next;
+	}
+
+	return;
+}
+
+static void
+put (log_ring_t *r, const char *line, size_t len)
+{
+	uint64_t head, tail = r->tail;
+	size_t off;
+
+	while (1) {
+		head = __atomic_load_n (&r->head, __ATOMIC_ACQUIRE);
+		if (tail + len - head <= ring_size)
+			break;
+
+		if (block == 0) {
+			__atomic_fetch_add (&dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		// The writer moves head before it broadcasts, under the lock.
+		pthread_mutex_lock (&lock);
+		pending = 1;
+		pthread_cond_signal (&wakeup);
+		if (__atomic_load_n (&r->head, __ATOMIC_ACQUIRE) == head)
+			pthread_cond_wait (&drained, &lock);
+
+		pthread_mutex_unlock (&lock);
+	}
+
+	off = tail & (ring_size - 1);
+	if (off + len > ring_size) {
+		memcpy (r->buf + off, line, ring_size - off);
+		memcpy (r->buf, line + ring_size - off, len - (ring_size
+					- off));
+	} else {
+		memcpy (r->buf + off, line, len);
+	}
+
+	__atomic_store_n (&r->tail, tail + len, __ATOMIC_RELEASE);
+
+	// Don't wait for the writer's next round once half the ring is used.
+	if ((tail - head <= ring_size / 2) && (tail + len - head > ring_size
+				/ 2))
+		wake ();
+
+	return;
+}
+
+static log_ring_t *
+ring_new (void)
+{
+	log_ring_t *r;
+	void *ptr;
+
+	if (posix_memalign (&ptr, 64, sizeof (log_ring_t)) != 0)
+		return NULL;
+
+	r = (log_ring_t *) ptr;
+	r->buf = (char *) malloc (ring_size);
+	if (r->buf == NULL) {
+		free (r);
+		return NULL;
+	}
+
+	r->head = 0;
+	r->tail = 0;
+	pthread_mutex_lock (&lock);
+	r->next = rings;
+	__atomic_store_n (&rings, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock (&lock);
+
+	return r;
+}
+
+static void
+wake (void)
+{
+	pthread_mutex_lock (&lock);
+	pending = 1;
+	pthread_cond_signal (&wakeup);
+	pthread_mutex_unlock (&lock);
+
+	return;
+}
+
+static void
+write_all (struct iovec *iov, int n)
+{
+	ssize_t ret;
+
+	while (n > 0) {
+		ret = writev (fd, iov, n);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		while ((n > 0) && ((size_t) ret >= iov->iov_len)) {
+			ret -= iov->iov_len;
+			iov++;
+			n--;
+		}
+
+		if (n > 0) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return;
+}
+
+/*
+ * Drains the rings every LOG_FLUSH_MS milliseconds, or sooner when a ring
+ * gets half full or a blocked thread is waiting, and once more on the way
+ * out.
+ */
+static void *
+writer (void *arg)
+{
+	struct timespec deadline;
+
+	(void) arg;
+	pthread_mutex_lock (&lock);
+	while (1) {
+		pending = 0;
+		pthread_mutex_unlock (&lock);
+		drain ();
+		pthread_mutex_lock (&lock);
+		pthread_cond_broadcast (&drained);
+		if (running == 0)
+			break;
+
+		if (pending != 0)
+			continue;
+
+		clock_gettime (CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += LOG_FLUSH_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		pthread_cond_timedwait (&wakeup, &lock, &deadline);
+	}
+
+	pthread_mutex_unlock (&lock);
+	drain ();
+
+	return NULL;
+}
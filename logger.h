@@ -19,34 +19,72 @@ enum LOG_LEVELS {
 	LOG_WARN = 1 << 3
 };
 
+/*
+ * Lines go straight to log_fp and are flushed one by one until
+ * logger_async_init () is called.  From then on logger () formats a line
+ * of at most 1024 bytes into a ring of the calling thread and a background
+ * thread writes the rings out with writev (), see logger.c.
+ */
+
+/*
+ * Levels less severe than LOG_COMPILE_LEVEL are compiled out, set it with
+ * make LOG_COMPILE_LEVEL=LOG_WARN for example.  Severity goes LOG_DBG,
+ * LOG_INFO, LOG_WARN, LOG_ERR and by default everything is compiled in.
+ * The levels that are left are checked against log_level before any
+ * argument is evaluated.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DBG
+#endif /* LOG_COMPILE_LEVEL */
+
+#define LOG_COMPILE_MASK ((LOG_COMPILE_LEVEL == LOG_ERR) ? LOG_ERR \
+		: (LOG_ERR | (~(LOG_COMPILE_LEVEL - 1) & (LOG_DBG | LOG_INFO \
+				| LOG_WARN))))
+#define LOG_ENABLED(level) ((((level) & LOG_COMPILE_MASK) != 0) \
+		&& __builtin_expect (((level) & log_level) != 0, 0))
+
 extern FILE *log_fp;
 extern uint8_t log_level;
+extern uint8_t log_queued;
+
+#define logger(level, format, args...) do { \
+	if (LOG_ENABLED (level)) \
+		logger_print (format, ##args); \
+} while (0)
 
 #define debug(level, format, args...) do { \
 	logger (level, "%s_%d, %s: " format, __FILE__, __LINE__, \
 			__FUNCTION__, ##args); \
-} while (0);
+} while (0)
 
 #define debug_unimplemented() do { \
 	logger (LOG_ERR, "UNIMPLEMENTED: %s_%d, %s\n", __FILE__, __LINE__, \
 			__FUNCTION__); \
 } while (0)
 
+void logger_async_fin (void);
+int logger_async_init (size_t, int);
+uint64_t logger_dropped (void);
+void logger_queue (const char *, va_list);
+
+// Writes a line whose level was checked by logger ().
 static inline void
-logger (uint8_t level, char *args, ...)
+logger_print (const char *args, ...)
 {
 	va_list ap;
 
 	if (log_fp == NULL)
 		return;
 
-	if ((level & log_level) == 0)
-		return;
-
 	va_start (ap, args);
-	vfprintf (log_fp, args, ap);
+	if (log_queued != 0) {
+		logger_queue (args, ap);
+	} else {
+		vfprintf (log_fp, args, ap);
+		fflush (log_fp);
+	}
+
 	va_end (ap);
-	fflush (log_fp);
 
 	return;
 }
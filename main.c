@@ -10,14 +10,29 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "acct.h"
+#include "arena.h"
+#include "catalog.h"
+#include "epoch.h"
+#include "event.h"
+#include "expire.h"
 #include "http.h"
+#include "httpd.h"
 #include "logger.h"
+#include "metrics.h"
+#include "passkey.h"
+#include "scrape.h"
 #include "sql.h"
+#include "torrent.h"
+#include "trace.h"
+#include "tracker.h"
+#include "udp.h"
 
 #define CONF_LINE_LEN 512
 
+static void log_fsync_task (void *);
 static int parse_config_file (char *);
-static void signal_handler (int);
+static void stats_task (void *);
 static void usage (char *);
 static inline int check_valid_config (void);
 static inline int set_defaults (void);
@@ -30,15 +45,55 @@ static void print_config (void);
 FILE *log_fp = NULL;
 uint8_t log_level = 1;
 unsigned int max_thrds = 32;
+uint32_t max_torrents = 1048576;
+uint32_t swarm_shards = 1024;
+uint32_t announce_interval = 1800;
+uint32_t peer_grace = 300;
+size_t arena_size = 65536;
+uint32_t db_connections = 0;
+uint32_t db_statements = 1024;
+uint32_t db_reconnects = 3;
+uint32_t db_synthetic_torrents = 10000;
+uint32_t db_synthetic_users = 1000;
+uint32_t acct_flush_interval = 30;
+uint32_t acct_flush_rows = 4096;
+uint32_t acct_queue_size = 65536;
+uint32_t passkey_refresh = 60;
+uint32_t passkey_negative_ttl = 300;
+uint32_t passkey_negative_size = 65536;
+uint32_t torrent_refresh = 30;
+double bloom_fp_rate = 0.01;
+size_t bloom_size = 0;
+uint32_t full_scrape_cache = 0;
+uint32_t udp_threads = 1;
+uint32_t udp_scrape = 0;
+uint32_t http_connection_limit = 0;
+uint32_t http_connection_timeout = 15;
+size_t http_connection_memory_limit = 0;
+uint32_t http_per_ip_connection_limit = 0;
+uint32_t http_frontend_threads = 0;
+uint32_t stats_interval = 300;
+uint32_t log_async = 0;
+size_t log_buffer_size = 65536;
+uint32_t log_fsync_interval = 0;
+uint32_t trace_sample_rate = 0;
+uint32_t trace_buffer = 4096;
+char *db_backend = NULL;
 char *host = NULL;
 char *name = NULL;
 char *passwd = NULL;
 char *user = NULL;
 char *ip = NULL;
 char *port = NULL;
+char *udp_listen_ip = NULL;
+char *udp_listen_port = NULL;
+char *metrics_listen_ip = NULL;
+char *metrics_listen_port = NULL;
+char *http_backend = NULL;
+char *http_frontend = NULL;
 char *levels = NULL;
-
-static volatile int terminate = 0;
+char *log_overflow = NULL;
+char *trace_file = NULL;
 
 int
 main (int argc, char *argv[])
@@ -104,10 +159,6 @@ main (int argc, char *argv[])
 		fclose (stderr);
 		signal (SIGCHLD, SIG_IGN);
 		signal (SIGPIPE, SIG_IGN);
-		signal (SIGHUP, signal_handler);
-		signal (SIGINT, signal_handler);
-		signal (SIGQUIT, signal_handler);
-		signal (SIGTERM, signal_handler);
 		if (logfile == NULL) {
 			logfile = (char *) malloc (sizeof (char)
 					* (strlen (argv[0]) + 5));
@@ -158,8 +209,67 @@ main (int argc, char *argv[])
 		goto cleanup;
 	}
 
-	if (http_init () != 0) {
-		logger (LOG_ERR, "ERROR: http_init failed.\n");
+	// Before any thread starts, they all inherit the blocked signals.
+	if (event_init () != 0) {
+		logger (LOG_ERR, "ERROR: event_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (event_add ("stats", stats_interval, stats_task, NULL) != 0) {
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if ((log_fp != stdout) && (event_add ("log fsync", log_fsync_interval,
+					log_fsync_task, NULL) != 0)) {
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (log_async != 0) {
+		if ((strcmp (log_overflow, "drop") != 0) && (strcmp (
+						log_overflow, "block") != 0)) {
+			logger (LOG_ERR, "ERROR: unknown log_overflow %s.\n",
+					log_overflow);
+			retval = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		if (logger_async_init (log_buffer_size, strcmp (log_overflow,
+						"block") == 0) != 0) {
+			logger (LOG_ERR, "ERROR: logger_async_init failed.\n");
+			retval = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	if (arena_init (arena_size) != 0) {
+		logger (LOG_ERR, "ERROR: arena_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (epoch_init () != 0) {
+		logger (LOG_ERR, "ERROR: epoch_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (torrent_init (max_torrents, swarm_shards) != 0) {
+		logger (LOG_ERR, "ERROR: torrent_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (tracker_init () != 0) {
+		logger (LOG_ERR, "ERROR: tracker_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (expire_init () != 0) {
+		logger (LOG_ERR, "ERROR: expire_init failed.\n");
 		retval = EXIT_FAILURE;
 		goto cleanup;
 	}
@@ -170,11 +280,84 @@ main (int argc, char *argv[])
 		goto cleanup;
 	}
 
-	while (terminate == 0);
+	if (catalog_init () != 0) {
+		logger (LOG_ERR, "ERROR: catalog_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (acct_init () != 0) {
+		logger (LOG_ERR, "ERROR: acct_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (passkey_init () != 0) {
+		logger (LOG_ERR, "ERROR: passkey_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (trace_init () != 0) {
+		logger (LOG_ERR, "ERROR: trace_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Start serving once everything requests depend on is up.
+	if (strcmp (http_frontend, "native") == 0) {
+		if (httpd_init () != 0) {
+			logger (LOG_ERR, "ERROR: httpd_init failed.\n");
+			retval = EXIT_FAILURE;
+			goto cleanup;
+		}
+	} else if (strcmp (http_frontend, "mhd") == 0) {
+		if (http_init () != 0) {
+			logger (LOG_ERR, "ERROR: http_init failed.\n");
+			retval = EXIT_FAILURE;
+			goto cleanup;
+		}
+	} else {
+		logger (LOG_ERR, "ERROR: unknown http_frontend %s.\n",
+				http_frontend);
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (udp_init () != 0) {
+		logger (LOG_ERR, "ERROR: udp_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (metrics_init () != 0) {
+		logger (LOG_ERR, "ERROR: metrics_init failed.\n");
+		retval = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (event_loop () != 0)
+		retval = EXIT_FAILURE;
+
 cleanup:
-	// Clean up.
-	sql_fin ();
+	// Clean up, the front ends stop before the metrics they record go.
+	udp_fin ();
+	httpd_fin ();
 	http_fin ();
+	metrics_fin ();
+	trace_fin ();
+	scrape_fin ();
+	passkey_fin ();
+	acct_fin ();
+	catalog_fin ();
+	sql_fin ();
+	expire_fin ();
+	tracker_fin ();
+	arena_fin ();
+	torrent_fin ();
+	epoch_fin ();
+	event_fin ();
+	logger_async_fin ();
 
 	// Sync and close the log file.
 	fflush (log_fp);
@@ -189,6 +372,9 @@ cleanup:
 	if (conffile != NULL)
 		free (conffile);
 
+	if (db_backend != NULL)
+		free (db_backend);
+
 	if (host != NULL)
 		free (host);
 
@@ -207,9 +393,43 @@ cleanup:
 	if (port != NULL)
 		free (port);
 
+	if (udp_listen_ip != NULL)
+		free (udp_listen_ip);
+
+	if (udp_listen_port != NULL)
+		free (udp_listen_port);
+
+	if (metrics_listen_ip != NULL)
+		free (metrics_listen_ip);
+
+	if (metrics_listen_port != NULL)
+		free (metrics_listen_port);
+
+	if (http_backend != NULL)
+		free (http_backend);
+
+	if (http_frontend != NULL)
+		free (http_frontend);
+
+	if (log_overflow != NULL)
+		free (log_overflow);
+
+	if (trace_file != NULL)
+		free (trace_file);
+
 	return retval;
 }
 
+// Flushes the log file to disk every log_fsync_interval seconds.
+static void
+log_fsync_task (void *cls)
+{
+	(void) cls;
+	fsync (fileno (log_fp));
+
+	return;
+}
+
 static int
 parse_config_file (char *file)
 {
@@ -237,11 +457,135 @@ parse_config_file (char *file)
 			continue;
 		}
 
+		if (strcmp (opt, "max_torrents") == 0) {
+			max_torrents = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "swarm_shards") == 0) {
+			swarm_shards = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "announce_interval") == 0) {
+			announce_interval = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "peer_grace") == 0) {
+			peer_grace = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "arena_size") == 0) {
+			arena_size = (size_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "torrent_refresh") == 0) {
+			torrent_refresh = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "bloom_fp_rate") == 0) {
+			bloom_fp_rate = strtod ((const char *) val, NULL);
+			continue;
+		}
+
+		if (strcmp (opt, "bloom_size") == 0) {
+			bloom_size = (size_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "full_scrape_cache") == 0) {
+			full_scrape_cache = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "db_backend") == 0) {
+			db_backend = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "db_synthetic_torrents") == 0) {
+			db_synthetic_torrents = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "db_synthetic_users") == 0) {
+			db_synthetic_users = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
 		if (strcmp (opt, "db_host") == 0) {
 			host = strdup (val);
 			continue;
 		}
 
+		if (strcmp (opt, "db_connections") == 0) {
+			db_connections = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "db_statements") == 0) {
+			db_statements = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "db_reconnects") == 0) {
+			db_reconnects = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "acct_flush_interval") == 0) {
+			acct_flush_interval = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "acct_flush_rows") == 0) {
+			acct_flush_rows = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "acct_queue_size") == 0) {
+			acct_queue_size = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "passkey_refresh") == 0) {
+			passkey_refresh = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "passkey_negative_ttl") == 0) {
+			passkey_negative_ttl = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "passkey_negative_size") == 0) {
+			passkey_negative_size = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
 		if (strcmp (opt, "db_name") == 0) {
 			name = strdup (val);
 			continue;
@@ -267,11 +611,129 @@ parse_config_file (char *file)
 			continue;
 		}
 
+		if (strcmp (opt, "http_frontend") == 0) {
+			http_frontend = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "http_frontend_threads") == 0) {
+			http_frontend_threads = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "http_backend") == 0) {
+			http_backend = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "http_connection_limit") == 0) {
+			http_connection_limit = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "http_connection_timeout") == 0) {
+			http_connection_timeout = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "http_connection_memory_limit") == 0) {
+			http_connection_memory_limit = (size_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "http_per_ip_connection_limit") == 0) {
+			http_per_ip_connection_limit = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "udp_listen_ip") == 0) {
+			udp_listen_ip = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "udp_listen_port") == 0) {
+			udp_listen_port = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "metrics_listen_ip") == 0) {
+			metrics_listen_ip = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "metrics_listen_port") == 0) {
+			metrics_listen_port = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "udp_threads") == 0) {
+			udp_threads = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "udp_scrape") == 0) {
+			udp_scrape = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "stats_interval") == 0) {
+			stats_interval = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
 		if (strcmp (opt, "log_levels") == 0) {
 			levels = strdup (val);
 			continue;
 		}
 
+		if (strcmp (opt, "log_async") == 0) {
+			log_async = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "log_buffer_size") == 0) {
+			log_buffer_size = (size_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "log_overflow") == 0) {
+			log_overflow = strdup (val);
+			continue;
+		}
+
+		if (strcmp (opt, "log_fsync_interval") == 0) {
+			log_fsync_interval = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "trace_sample_rate") == 0) {
+			trace_sample_rate = (uint32_t) strtoul (
+					(const char *) val, NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "trace_buffer") == 0) {
+			trace_buffer = (uint32_t) strtoul ((const char *) val,
+					NULL, 10);
+			continue;
+		}
+
+		if (strcmp (opt, "trace_file") == 0) {
+			trace_file = strdup (val);
+			continue;
+		}
+
 		fprintf (log_fp, "INFO: conf_line: %s = %s\n", opt, val);
 		fprintf (log_fp, "WARNING: Unknown config line.\n");
 	}
@@ -279,27 +741,24 @@ parse_config_file (char *file)
 	return 0;
 }
 
+// Logs a snapshot of the counters every stats_interval seconds.
 static void
-signal_handler (int signo)
+stats_task (void *cls)
 {
-	switch (signo) {
-		case SIGHUP:
-		case SIGQUIT:
-			logger (LOG_DBG, "INFO: received %s, ignoring.\n",
-					strsignal (signo));
-			break;
-
-		case SIGINT:
-		case SIGTERM:
-			logger (LOG_DBG, "INFO: received %s, terminating.\n",
-					strsignal (signo));
-			terminate = 1;
-			break;
-
-		default:
-			logger (LOG_ERR, "ERROR: received %s, unhandled.\n",
-					strsignal (signo));
-	}
+	acct_stats_t as;
+	catalog_stats_t cs;
+
+	(void) cls;
+	acct_stats (&as);
+	catalog_stats (&cs);
+	logger (LOG_INFO, "INFO: stats: %" PRIu32 " torrents, %" PRIu64
+			" unregistered, arena high-water %zu bytes, %" PRIu64
+			" overflows, acct %" PRIu64 " deltas, %" PRIu64
+			" dropped, %" PRIu64 " rows, %" PRIu64 " errors, %"
+			PRIu64 " log lines dropped.\n", cs.torrents,
+			cs.rejected + cs.false_pos, arena_high_water (),
+			arena_overflows (), as.drained, as.dropped, as.rows,
+			as.errors, logger_dropped ());
 
 	return;
 }
@@ -322,6 +781,10 @@ usage (char *name)
 static inline int 
 check_valid_config (void)
 {
+	// The synthetic database needs no credentials.
+	if (strcmp (db_backend, "synthetic") == 0)
+		return 0;
+
 	if (name == NULL) {
 		fprintf (log_fp, "ERROR: missing database name in config "
 				"file.\n");
@@ -368,6 +831,64 @@ set_defaults (void)
 		sprintf (port, "30404");
 	}
 
+	if (db_backend == NULL) {
+		db_backend = strdup ("mysql");
+		if (db_backend == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	if (http_frontend == NULL) {
+		http_frontend = strdup ("mhd");
+		if (http_frontend == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	if (http_backend == NULL) {
+		http_backend = strdup ("select");
+		if (http_backend == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	// The udp tracker listens where the http one does unless told.
+	if (udp_listen_ip == NULL) {
+		udp_listen_ip = strdup (ip);
+		if (udp_listen_ip == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	if (udp_listen_port == NULL) {
+		udp_listen_port = strdup (port);
+		if (udp_listen_port == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	// The metrics are for the operator, keep them off the network.
+	if (metrics_listen_ip == NULL) {
+		metrics_listen_ip = strdup ("127.0.0.1");
+		if (metrics_listen_ip == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	if (metrics_listen_port == NULL) {
+		metrics_listen_port = strdup ("0");
+		if (metrics_listen_port == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
 	if (levels == NULL) {
 		levels = (char *) malloc (sizeof (char) * 8);
 		if (levels == NULL) {
@@ -379,6 +900,26 @@ set_defaults (void)
 		sprintf (levels, "LOG_ERR");
 	}
 
+	if (log_overflow == NULL) {
+		log_overflow = strdup ("drop");
+		if (log_overflow == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	if (trace_file == NULL) {
+		trace_file = strdup ("tmst.trace");
+		if (trace_file == NULL) {
+			fprintf (log_fp, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+	}
+
+	// One connection per worker plus a few for background threads.
+	if (db_connections == 0)
+		db_connections = max_thrds + 4;
+
 	if (host == NULL) {
 		host = (char *) malloc (sizeof (char) * 10);
 		if (host == NULL) {
@@ -442,13 +983,74 @@ print_config (void)
 {
 	logger (LOG_DBG, "configured parameters:\n");
 	logger (LOG_DBG, "max threads: %u\n", max_thrds);
+	logger (LOG_DBG, "max torrents: %" PRIu32 "\n", max_torrents);
+	logger (LOG_DBG, "swarm shards: %" PRIu32 "\n", swarm_shards);
+	logger (LOG_DBG, "announce interval: %" PRIu32 "\n",
+			announce_interval);
+	logger (LOG_DBG, "peer grace: %" PRIu32 "\n", peer_grace);
+	logger (LOG_DBG, "arena size: %zu\n", arena_size);
+	logger (LOG_DBG, "torrent refresh: %" PRIu32 "\n", torrent_refresh);
+	logger (LOG_DBG, "bloom false positive rate: %f\n", bloom_fp_rate);
+	logger (LOG_DBG, "bloom size: %zu\n", bloom_size);
+	logger (LOG_DBG, "full scrape cache: %" PRIu32 "\n",
+			full_scrape_cache);
 	logger (LOG_DBG, "database host: %s\n", host);
+	logger (LOG_DBG, "database backend: %s\n", db_backend);
+	logger (LOG_DBG, "database synthetic torrents: %" PRIu32 "\n",
+			db_synthetic_torrents);
+	logger (LOG_DBG, "database synthetic users: %" PRIu32 "\n",
+			db_synthetic_users);
 	logger (LOG_DBG, "database name: %s\n", name);
 	logger (LOG_DBG, "database passwd: %s\n", passwd);
 	logger (LOG_DBG, "database user: %s\n", user);
+	logger (LOG_DBG, "database connections: %" PRIu32 "\n",
+			db_connections);
+	logger (LOG_DBG, "database statements: %" PRIu32 "\n",
+			db_statements);
+	logger (LOG_DBG, "database reconnects: %" PRIu32 "\n",
+			db_reconnects);
+	logger (LOG_DBG, "accounting flush interval: %" PRIu32 "\n",
+			acct_flush_interval);
+	logger (LOG_DBG, "accounting flush rows: %" PRIu32 "\n",
+			acct_flush_rows);
+	logger (LOG_DBG, "accounting queue size: %" PRIu32 "\n",
+			acct_queue_size);
+	logger (LOG_DBG, "passkey refresh: %" PRIu32 "\n", passkey_refresh);
+	logger (LOG_DBG, "passkey negative ttl: %" PRIu32 "\n",
+			passkey_negative_ttl);
+	logger (LOG_DBG, "passkey negative size: %" PRIu32 "\n",
+			passkey_negative_size);
 	logger (LOG_DBG, "bind ip: %s\n", ip);
 	logger (LOG_DBG, "bind port: %s\n", port);
+	logger (LOG_DBG, "http frontend: %s\n", http_frontend);
+	logger (LOG_DBG, "http frontend threads: %" PRIu32 "\n",
+			http_frontend_threads);
+	logger (LOG_DBG, "http backend: %s\n", http_backend);
+	logger (LOG_DBG, "http connection limit: %" PRIu32 "\n",
+			http_connection_limit);
+	logger (LOG_DBG, "http connection timeout: %" PRIu32 "\n",
+			http_connection_timeout);
+	logger (LOG_DBG, "http connection memory limit: %zu\n",
+			http_connection_memory_limit);
+	logger (LOG_DBG, "http per ip connection limit: %" PRIu32 "\n",
+			http_per_ip_connection_limit);
+	logger (LOG_DBG, "udp bind ip: %s\n", udp_listen_ip);
+	logger (LOG_DBG, "udp bind port: %s\n", udp_listen_port);
+	logger (LOG_DBG, "udp threads: %" PRIu32 "\n", udp_threads);
+	logger (LOG_DBG, "udp scrape: %" PRIu32 "\n", udp_scrape);
+	logger (LOG_DBG, "metrics bind ip: %s\n", metrics_listen_ip);
+	logger (LOG_DBG, "metrics bind port: %s\n", metrics_listen_port);
+	logger (LOG_DBG, "stats interval: %" PRIu32 "\n", stats_interval);
 	logger (LOG_DBG, "log level: %s\n", levels);
+	logger (LOG_DBG, "log async: %" PRIu32 "\n", log_async);
+	logger (LOG_DBG, "log buffer size: %zu\n", log_buffer_size);
+	logger (LOG_DBG, "log overflow: %s\n", log_overflow);
+	logger (LOG_DBG, "log fsync interval: %" PRIu32 "\n",
+			log_fsync_interval);
+	logger (LOG_DBG, "trace sample rate: %" PRIu32 "\n",
+			trace_sample_rate);
+	logger (LOG_DBG, "trace buffer: %" PRIu32 "\n", trace_buffer);
+	logger (LOG_DBG, "trace file: %s\n", trace_file);
 
 	return;
 }
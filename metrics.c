@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "logger.h"
+#include "metrics.h"
+#include "torrent.h"
+
+#define METRICS_BACKLOG 16
+#define METRICS_REQUEST_MAX 1024
+// Four buckets to every power of two, up to 2^34 ns or about 17 seconds.
+#define METRICS_SUB_BITS 2
+#define METRICS_SUB (1U << METRICS_SUB_BITS)
+#define METRICS_NS_MAX (1ULL << 34)
+#define METRICS_BUCKETS ((34 - METRICS_SUB_BITS + 1) * METRICS_SUB)
+// Buckets below a quarter of a microsecond are not worth a line each.
+#define METRICS_LE_MIN 255
+
+typedef struct __metrics_thread_type metrics_thread_t;
+
+struct __metrics_thread_type {
+	uint64_t counters[METRICS_COUNTERS];
+	uint64_t buckets[METRICS_TIMERS][METRICS_BUCKETS];
+	uint64_t sums[METRICS_TIMERS];
+	metrics_thread_t *next;
+} __attribute__ ((aligned (64)));
+
+typedef struct __metrics_buf_type {
+	char *buf;
+	size_t len;
+	size_t size;
+	int error;
+} metrics_buf_t;
+
+static inline uint32_t bucket (uint64_t);
+static inline uint64_t bucket_upper (uint32_t);
+static void listener_stop (void);
+static void *metrics_thread (void *);
+static void out_printf (metrics_buf_t *, const char *, ...);
+static void serve (int);
+static inline metrics_thread_t *thread_get (void);
+static void write_metrics (metrics_buf_t *);
+
+static const char *events[EVENT_STOPPED + 1] = {
+	[EVENT_NONE] = "none",
+	[EVENT_COMPLETED] = "completed",
+	[EVENT_STARTED] = "started",
+	[EVENT_STOPPED] = "stopped"
+};
+static const char *reasons[TRACKER_REPLY_MAX] = {
+	[TRACKER_REPLY_BAD_REQUEST] = "bad_request",
+	[TRACKER_REPLY_MISSING_PASSKEY] = "missing_passkey",
+	[TRACKER_REPLY_UNREGISTERED] = "unregistered",
+	[TRACKER_REPLY_TRY_AGAIN] = "try_again",
+	[TRACKER_REPLY_INVALID_PASSKEY] = "invalid_passkey",
+	[TRACKER_REPLY_LEECH_DISABLED] = "leech_disabled",
+	[TRACKER_REPLY_FULL_SCRAPE_DENIED] = "full_scrape_denied"
+};
+static const char *timers[METRICS_TIMERS] = {
+	[METRICS_PARSE] = "parse",
+	[METRICS_LOOKUP] = "lookup",
+	[METRICS_ENCODE] = "encode",
+	[METRICS_TOTAL] = "total"
+};
+
+static int fd = -1;
+static int stop = 0;
+static pthread_t thrd;
+static uint8_t thrd_valid = 0;
+static metrics_thread_t *threads = NULL;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread metrics_thread_t *thread_rec = NULL;
+
+void
+metrics_add (enum METRICS_COUNTER counter, uint64_t n)
+{
+	metrics_thread_t *rec = thread_get ();
+
+	if (rec == NULL)
+		return;
+
+	// Only this thread writes the record, the store just must not tear.
+	__atomic_store_n (&rec->counters[counter], rec->counters[counter] + n,
+			__ATOMIC_RELAXED);
+
+	return;
+}
+
+// Monotonic time in nanoseconds.
+uint64_t
+metrics_clock (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void
+metrics_fin (void)
+{
+	metrics_thread_t *rec;
+
+	listener_stop ();
+	while (threads != NULL) {
+		rec = threads;
+		threads = rec->next;
+		free (rec);
+	}
+
+	return;
+}
+
+int
+metrics_init (void)
+{
+	struct sockaddr_in sock_addr;
+	struct timeval tv;
+	uint16_t tcp_port;
+	int on = 1;
+
+	tcp_port = (uint16_t) atoi ((const char *) metrics_listen_port);
+	if (tcp_port == 0) {
+		logger (LOG_INFO, "INFO: metrics listener disabled.\n");
+		return 0;
+	}
+
+	memset (&sock_addr, 0, sizeof (struct sockaddr_in));
+	sock_addr.sin_family = AF_INET;
+	sock_addr.sin_addr.s_addr = inet_addr (metrics_listen_ip);
+	sock_addr.sin_port = htons (tcp_port);
+
+	// Wake up every second to notice metrics_fin ().
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	stop = 0;
+	fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		debug (LOG_ERR, "ERROR: unable to create metrics socket: "
+				"%s.\n", strerror (errno));
+		return -1;
+	}
+
+	if ((setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on,
+					sizeof (on)) != 0)
+			|| (setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+					sizeof (tv)) != 0)) {
+		debug (LOG_ERR, "ERROR: unable to set metrics socket options: "
+				"%s.\n", strerror (errno));
+		listener_stop ();
+		return -1;
+	}
+
+	if ((bind (fd, (struct sockaddr *) &sock_addr,
+					sizeof (sock_addr)) != 0)
+			|| (listen (fd, METRICS_BACKLOG) != 0)) {
+		debug (LOG_ERR, "ERROR: unable to listen on metrics socket: "
+				"%s.\n", strerror (errno));
+		listener_stop ();
+		return -1;
+	}
+
+	if (pthread_create (&thrd, NULL, metrics_thread, NULL) != 0) {
+		debug (LOG_ERR, "ERROR: unable to start metrics thread.\n");
+		listener_stop ();
+		return -1;
+	}
+
+	thrd_valid = 1;
+
+	return 0;
+}
+
+/*
+ * Records the time since start, a metrics_clock () reading, and returns
+ * the current reading so that phases can be timed back to back.
+ */
+uint64_t
+metrics_time (enum METRICS_TIMER timer, uint64_t start)
+{
+	metrics_thread_t *rec;
+	uint64_t now, ns;
+	uint32_t b;
+
+	now = metrics_clock ();
+	rec = thread_get ();
+	if (rec == NULL)
+		return now;
+
+	ns = now - start;
+	b = bucket (ns);
+	__atomic_store_n (&rec->buckets[timer][b], rec->buckets[timer][b] + 1,
+			__ATOMIC_RELAXED);
+	__atomic_store_n (&rec->sums[timer], rec->sums[timer] + ns,
+			__ATOMIC_RELAXED);
+
+	return now;
+}
+
+/*
+ * Below METRICS_SUB every value has its own bucket, above it the top
+ * METRICS_SUB_BITS + 1 bits of the value pick one.
+ */
+static inline uint32_t
+bucket (uint64_t ns)
+{
+	uint32_t shift;
+
+	if (ns >= METRICS_NS_MAX)
+		ns = METRICS_NS_MAX - 1;
+
+	if (ns < METRICS_SUB)
+		return (uint32_t) ns;
+
+	shift = 63 - (uint32_t) __builtin_clzll (ns) - METRICS_SUB_BITS;
+
+	return shift * METRICS_SUB + (uint32_t) (ns >> shift);
+}
+
+// The largest value counted in bucket b.
+static inline uint64_t
+bucket_upper (uint32_t b)
+{
+	uint32_t shift;
+
+	if (b < METRICS_SUB)
+		return b;
+
+	shift = b / METRICS_SUB - 1;
+
+	return ((uint64_t) (b - shift * METRICS_SUB + 1) << shift) - 1;
+}
+
+/*
+ * Stops the listener only.  The per-thread records stay, front end threads
+ * may still be writing to them until they are stopped.
+ */
+static void
+listener_stop (void)
+{
+	__atomic_store_n (&stop, 1, __ATOMIC_RELEASE);
+	if (thrd_valid != 0)
+		pthread_join (thrd, NULL);
+
+	thrd_valid = 0;
+	if (fd >= 0)
+		close (fd);
+
+	fd = -1;
+
+	return;
+}
+
+static void *
+metrics_thread (void *arg)
+{
+	struct timeval tv;
+	int conn;
+
+	(void) arg;
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	while (__atomic_load_n (&stop, __ATOMIC_ACQUIRE) == 0) {
+		conn = accept4 (fd, NULL, NULL, SOCK_CLOEXEC);
+		if (conn < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)
+					&& (errno != EINTR))
+				debug (LOG_ERR, "ERROR: metrics accept failed: "
+						"%s.\n", strerror (errno));
+
+			continue;
+		}
+
+		// A stuck client must not hold up the next scrape for long.
+		setsockopt (conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+		setsockopt (conn, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+		serve (conn);
+		close (conn);
+	}
+
+	return NULL;
+}
+
+static void
+out_printf (metrics_buf_t *b, const char *format, ...)
+{
+	va_list ap;
+	size_t size;
+	char *p;
+	int n;
+
+	while (b->error == 0) {
+		va_start (ap, format);
+		n = vsnprintf (b->buf + b->len, b->size - b->len, format, ap);
+		va_end (ap);
+		if (n < 0) {
+			b->error = 1;
+			break;
+		}
+
+		if (b->len + (size_t) n < b->size) {
+			b->len += (size_t) n;
+			break;
+		}
+
+		size = (b->size == 0) ? 16384 : b->size * 2;
+		while (size <= b->len + (size_t) n)
+			size *= 2;
+
+		p = (char *) realloc (b->buf, size);
+		if (p == NULL) {
+			debug (LOG_ERR, "ERROR: out-of-memory.\n");
+			b->error = 1;
+			break;
+		}
+
+		b->buf = p;
+		b->size = size;
+	}
+
+	return;
+}
+
+// Answers a single request and leaves closing the connection to the caller.
+static void
+serve (int conn)
+{
+	char head[256], req[METRICS_REQUEST_MAX + 1];
+	metrics_buf_t body = {NULL, 0, 0, 0};
+	const char *status = "404 Not Found", *p;
+	size_t len = 0, sent;
+	ssize_t n;
+
+	while (len < METRICS_REQUEST_MAX) {
+		n = recv (conn, req + len, METRICS_REQUEST_MAX - len, 0);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+
+		if (n <= 0)
+			return;
+
+		len += (size_t) n;
+		req[len] = '\0';
+		if (strstr (req, "\r\n\r\n") != NULL)
+			break;
+	}
+
+	req[len] = '\0';
+	if ((strncmp (req, "GET /stats ", 11) == 0) || (strncmp (req,
+					"GET /metrics ", 13) == 0)) {
+		write_metrics (&body);
+		status = (body.error == 0) ? "200 OK"
+			: "500 Internal Server Error";
+	}
+
+	if (body.error != 0)
+		body.len = 0;
+
+	n = snprintf (head, sizeof (head), "HTTP/1.1 %s\r\nContent-Type: "
+			"text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", status, body.len);
+	if (send (conn, head, (size_t) n, MSG_NOSIGNAL) == n) {
+		for (sent = 0, p = body.buf; sent < body.len; sent += n) {
+			n = send (conn, p + sent, body.len - sent,
+					MSG_NOSIGNAL);
+			if ((n < 0) && (errno == EINTR)) {
+				n = 0;
+				continue;
+			}
+
+			if (n <= 0)
+				break;
+		}
+	}
+
+	free (body.buf);
+
+	return;
+}
+
+static inline metrics_thread_t *
+thread_get (void)
+{
+	metrics_thread_t *rec = thread_rec;
+	void *ptr;
+
+	if (rec != NULL)
+		return rec;
+
+	if (posix_memalign (&ptr, 64, sizeof (metrics_thread_t)) != 0)
+		return NULL;
+
+	rec = (metrics_thread_t *) ptr;
+	memset (rec, 0, sizeof (metrics_thread_t));
+	pthread_mutex_lock (&threads_lock);
+	rec->next = threads;
+	__atomic_store_n (&threads, rec, __ATOMIC_RELEASE);
+	pthread_mutex_unlock (&threads_lock);
+	thread_rec = rec;
+
+	return rec;
+}
+
+/*
+ * Sums the thread records and walks the torrent index for the swarm
+ * totals.  The records are read without stopping their threads, so the
+ * counters of one scrape need not agree with each other exactly.
+ */
+static void
+write_metrics (metrics_buf_t *b)
+{
+	uint64_t buckets[METRICS_TIMERS][METRICS_BUCKETS];
+	uint64_t counters[METRICS_COUNTERS], sums[METRICS_TIMERS];
+	uint64_t active = 0, cum, leechers = 0, seeders = 0, snatches = 0;
+	uint32_t complete, downloaded, i, incomplete, j, pos = 0;
+	metrics_thread_t *rec;
+	torrent_t *t;
+
+	memset (buckets, 0, sizeof (buckets));
+	memset (counters, 0, sizeof (counters));
+	memset (sums, 0, sizeof (sums));
+	for (rec = __atomic_load_n (&threads, __ATOMIC_ACQUIRE); rec != NULL;
+			rec = rec->next) {
+		for (i = 0; i < METRICS_COUNTERS; i++)
+			counters[i] += __atomic_load_n (&rec->counters[i],
+					__ATOMIC_RELAXED);
+
+		for (i = 0; i < METRICS_TIMERS; i++) {
+			sums[i] += __atomic_load_n (&rec->sums[i],
+					__ATOMIC_RELAXED);
+			for (j = 0; j < METRICS_BUCKETS; j++)
+				buckets[i][j] += __atomic_load_n (
+						&rec->buckets[i][j],
+						__ATOMIC_RELAXED);
+		}
+	}
+
+	while ((t = torrent_next (&pos)) != NULL) {
+		torrent_counters (t, &complete, &downloaded, &incomplete);
+		if (complete + incomplete != 0)
+			active++;
+
+		seeders += complete;
+		leechers += incomplete;
+		snatches += downloaded;
+	}
+
+	out_printf (b, "# HELP tmst_announces_total Announces answered, by "
+			"event.\n# TYPE tmst_announces_total counter\n");
+	for (i = 0; i <= EVENT_STOPPED; i++)
+		out_printf (b, "tmst_announces_total{event=\"%s\"} %"
+				PRIu64 "\n", events[i],
+				counters[METRICS_ANNOUNCES + i]);
+
+	out_printf (b, "# HELP tmst_scrapes_total Scrapes answered.\n"
+			"# TYPE tmst_scrapes_total counter\n"
+			"tmst_scrapes_total %" PRIu64 "\n"
+			"# HELP tmst_full_scrapes_total Full scrapes "
+			"answered.\n"
+			"# TYPE tmst_full_scrapes_total counter\n"
+			"tmst_full_scrapes_total %" PRIu64 "\n",
+			counters[METRICS_SCRAPES],
+			counters[METRICS_FULL_SCRAPES]);
+	out_printf (b, "# HELP tmst_failures_total Failure replies, by "
+			"reason.\n# TYPE tmst_failures_total counter\n");
+	for (i = 0; i < TRACKER_REPLY_MAX; i++)
+		out_printf (b, "tmst_failures_total{reason=\"%s\"} %"
+				PRIu64 "\n", reasons[i],
+				counters[METRICS_FAILURES + i]);
+
+	out_printf (b, "# HELP tmst_errors_total Requests left without a "
+			"reply.\n# TYPE tmst_errors_total counter\n"
+			"tmst_errors_total %" PRIu64 "\n"
+			"# HELP tmst_reply_bytes_total Reply bodies sent.\n"
+			"# TYPE tmst_reply_bytes_total counter\n"
+			"tmst_reply_bytes_total %" PRIu64 "\n",
+			counters[METRICS_ERRORS],
+			counters[METRICS_REPLY_BYTES]);
+	out_printf (b, "# HELP tmst_torrents Registered torrents.\n"
+			"# TYPE tmst_torrents gauge\ntmst_torrents %" PRIu32
+			"\n# HELP tmst_swarms Torrents with peers.\n"
+			"# TYPE tmst_swarms gauge\ntmst_swarms %" PRIu64
+			"\n# HELP tmst_peers Peers, by role.\n"
+			"# TYPE tmst_peers gauge\n"
+			"tmst_peers{role=\"seeder\"} %" PRIu64 "\n"
+			"tmst_peers{role=\"leecher\"} %" PRIu64 "\n"
+			"# HELP tmst_snatches Completed downloads of all "
+			"torrents.\n# TYPE tmst_snatches gauge\n"
+			"tmst_snatches %" PRIu64 "\n", torrent_count (),
+			active, seeders, leechers, snatches);
+	out_printf (b, "# HELP tmst_request_duration_seconds Request "
+			"latency, by phase.\n"
+			"# TYPE tmst_request_duration_seconds histogram\n");
+	for (i = 0; i < METRICS_TIMERS; i++) {
+		cum = 0;
+		for (j = 0; j < METRICS_BUCKETS; j++) {
+			cum += buckets[i][j];
+			if (bucket_upper (j) < METRICS_LE_MIN)
+				continue;
+
+			out_printf (b, "tmst_request_duration_seconds_bucket"
+					"{phase=\"%s\",le=\"%.9g\"} %" PRIu64
+					"\n", timers[i], bucket_upper (j)
+					/ 1e9, cum);
+		}
+
+		out_printf (b, "tmst_request_duration_seconds_bucket"
+				"{phase=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+				"tmst_request_duration_seconds_sum"
+				"{phase=\"%s\"} %.9f\n"
+				"tmst_request_duration_seconds_count"
+				"{phase=\"%s\"} %" PRIu64 "\n", timers[i], cum,
+				timers[i], sums[i] / 1e9, timers[i], cum);
+	}
+
+	return;
+}
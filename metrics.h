@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <inttypes.h>
+#include "tracker.h"
+
+/*
+ * Request counters and latency histograms.
+ *
+ * Every thread counts into its own cache line aligned record, registered
+ * the first time it counts anything, and the records are only summed when
+ * they are read.  Latencies are kept in nanoseconds in log-linear buckets,
+ * four to every power of two, so a bucket is at most 25% wide.
+ *
+ * Announces are counted by event and scrapes once they were answered,
+ * failures by the reason sent back and errors where no reply could be
+ * given.  Reply bytes are the bodies sent, without HTTP or UDP headers.
+ * parse is the front end decoding the request, lookup the passkey and
+ * torrent lookups and the swarm update, encode building the reply and
+ * total the whole request in the front end.
+ *
+ * They are served in the Prometheus text format, together with the swarm
+ * totals, on GET /stats or /metrics from metrics_listen_ip and
+ * metrics_listen_port, which is off if the port is 0.
+ */
+
+enum METRICS_COUNTER {
+	METRICS_ANNOUNCES = 0,
+	METRICS_SCRAPES = METRICS_ANNOUNCES + EVENT_STOPPED + 1,
+	METRICS_FULL_SCRAPES,
+	METRICS_FAILURES,
+	METRICS_ERRORS = METRICS_FAILURES + TRACKER_REPLY_MAX,
+	METRICS_REPLY_BYTES,
+	METRICS_COUNTERS
+};
+
+enum METRICS_TIMER {
+	METRICS_PARSE = 0,
+	METRICS_LOOKUP,
+	METRICS_ENCODE,
+	METRICS_TOTAL,
+	METRICS_TIMERS
+};
+
+void metrics_add (enum METRICS_COUNTER, uint64_t);
+uint64_t metrics_clock (void);
+void metrics_fin (void);
+int metrics_init (void);
+uint64_t metrics_time (enum METRICS_TIMER, uint64_t);
+
+#endif /* __METRICS_H__ */
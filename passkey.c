@@ -0,0 +1,617 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "epoch.h"
+#include "event.h"
+#include "logger.h"
+#include "passkey.h"
+#include "sql.h"
+
+#define PASSKEY_SET_MIN 1024
+#define PASSKEY_CHANGES_MIN 256
+#define PASSKEY_PENDING_MAX 256
+
+// user_id 0 marks an empty entry.
+typedef struct __passkey_entry_type {
+	char passkey[PASSKEY_LEN];
+	uint32_t user_id;
+	uint8_t perms;
+} passkey_entry_t;
+
+// One block, so a replaced set can be handed to epoch_retire ().
+typedef struct __passkey_set_type {
+	epoch_node_t node;
+	uint32_t mask;
+	uint32_t count;
+	passkey_entry_t entries[];
+} passkey_set_t;
+
+// user_id 0 marks a passkey the database does not know.
+typedef struct __passkey_cache_type {
+	char passkey[PASSKEY_LEN];
+	uint32_t user_id;
+	uint32_t expires;
+	uint8_t perms;
+} passkey_cache_t;
+
+// Rows of one refresh, filled in by fetch_row ().
+typedef struct __passkey_fetch_type {
+	MYSQL_BIND results[6];
+	char passkey[PASSKEY_LEN + 1];
+	unsigned long len;
+	uint32_t user_id;
+	int8_t can_leech;
+	int8_t can_full_scrape;
+	int8_t enabled;
+	int64_t updated;
+	passkey_entry_t *changes;
+	uint8_t *enable;
+	uint32_t count;
+	uint32_t size;
+	uint32_t unchanged;
+	int64_t last;
+	int error;
+} passkey_fetch_t;
+
+static void cache_forget (const char *);
+static int db_lookup (const char *, uint32_t *, uint8_t *);
+static int fetch_row (void *);
+static void lookup_task (void *);
+static inline uint32_t passkey_hash (const char *);
+static inline uint8_t perms_of (int8_t, int8_t);
+static int refresh (void);
+static void refresh_task (void *);
+static passkey_set_t *set_create (uint32_t);
+static void set_delete (passkey_set_t *, const char *);
+static inline passkey_entry_t *set_find (passkey_set_t *, const char *);
+static void set_insert (passkey_set_t *, const passkey_entry_t *);
+static inline uint32_t set_probe (passkey_set_t *, const char *);
+static int slow_lookup (const char *, uint32_t *, uint8_t *);
+
+static passkey_set_t *current = NULL;
+static int64_t last_sync = 0;
+
+// pending is guarded by cache_lock too.
+static passkey_cache_t *cache = NULL;
+static uint32_t cache_mask = 0;
+static char pending[PASSKEY_PENDING_MAX][PASSKEY_LEN];
+static uint32_t pending_count = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void
+passkey_fin (void)
+{
+	if (current != NULL)
+		logger (LOG_INFO, "INFO: passkey: %" PRIu32 " passkeys.\n",
+				current->count);
+
+	free (current);
+	current = NULL;
+	last_sync = 0;
+	free (cache);
+	cache = NULL;
+	pending_count = 0;
+
+	return;
+}
+
+int
+passkey_init (void)
+{
+	uint32_t size;
+
+	size = 1;
+	while (size < passkey_negative_size)
+		size <<= 1;
+
+	cache = (passkey_cache_t *) calloc (size, sizeof (passkey_cache_t));
+	if (cache == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	cache_mask = size - 1;
+
+	// The first refresh loads every enabled user.
+	if (refresh () != 0) {
+		passkey_fin ();
+		return -1;
+	}
+
+	if (current == NULL) {
+		current = set_create (0);
+		if (current == NULL) {
+			passkey_fin ();
+			return -1;
+		}
+	}
+
+	if ((event_add_worker ("passkey refresh", passkey_refresh,
+					refresh_task, NULL) != 0)
+			|| (event_add_worker ("passkey lookup", 1,
+					lookup_task, NULL) != 0)) {
+		passkey_fin ();
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Looks up the user of a passkey.  Returns 0 if the passkey is valid, -1
+ * if it is not and -2 if it could not be checked yet.
+ */
+int
+passkey_lookup (const char *pkey, size_t len, uint32_t *user_id,
+		uint8_t *perms)
+{
+	passkey_set_t *set;
+	passkey_entry_t *e;
+
+	if (len != PASSKEY_LEN)
+		return -1;
+
+	if (epoch_enter () != 0)
+		return slow_lookup (pkey, user_id, perms);
+
+	set = __atomic_load_n (&current, __ATOMIC_ACQUIRE);
+	e = set_find (set, pkey);
+	if (e != NULL) {
+		*user_id = e->user_id;
+		*perms = e->perms;
+		epoch_exit ();
+		return 0;
+	}
+
+	epoch_exit ();
+
+	return slow_lookup (pkey, user_id, perms);
+}
+
+static void
+cache_forget (const char *pkey)
+{
+	passkey_cache_t *c;
+
+	pthread_mutex_lock (&cache_lock);
+	c = &cache[passkey_hash (pkey) & cache_mask];
+	if (memcmp (c->passkey, pkey, PASSKEY_LEN) == 0)
+		memset (c, 0, sizeof (passkey_cache_t));
+
+	pthread_mutex_unlock (&cache_lock);
+
+	return;
+}
+
+/*
+ * Asks the database about one passkey, returns like passkey_lookup ().
+ * Only lookup_task () calls it, on the event worker.
+ */
+static int
+db_lookup (const char *pkey, uint32_t *user_id, uint8_t *perms)
+{
+	MYSQL_BIND param, results[3];
+	unsigned long len = PASSKEY_LEN;
+	int8_t can_full_scrape = 0, can_leech = 0;
+	int rows;
+
+	memset (&param, 0, sizeof (MYSQL_BIND));
+	param.buffer_type = MYSQL_TYPE_STRING;
+	param.buffer = (void *) pkey;
+	param.buffer_length = PASSKEY_LEN;
+	param.length = &len;
+	memset (results, 0, sizeof (results));
+	results[0].buffer_type = MYSQL_TYPE_LONG;
+	results[0].buffer = user_id;
+	results[0].is_unsigned = 1;
+	results[1].buffer_type = MYSQL_TYPE_TINY;
+	results[1].buffer = &can_leech;
+	results[2].buffer_type = MYSQL_TYPE_TINY;
+	results[2].buffer = &can_full_scrape;
+	*user_id = 0;
+	rows = sql_exec (SQL_STMT_USER_BY_PASSKEY, &param, results, NULL,
+			NULL);
+	if (rows < 0)
+		return -2;
+
+	if ((rows == 0) || (*user_id == 0))
+		return -1;
+
+	*perms = perms_of (can_leech, can_full_scrape);
+
+	return 0;
+}
+
+/*
+ * Keeps the rows that change the current set, a row the set already
+ * agrees with is only counted.  current is only replaced by refresh (), it
+ * can be read here without entering the epoch.
+ */
+static int
+fetch_row (void *cls)
+{
+	passkey_fetch_t *f = (passkey_fetch_t *) cls;
+	passkey_entry_t *e;
+	void *p;
+	uint32_t size;
+	uint8_t enable, perms;
+
+	if (f->updated > f->last)
+		f->last = f->updated;
+
+	if (f->len != PASSKEY_LEN)
+		return 0;
+
+	// The set is about to have the final word on this passkey.
+	cache_forget (f->passkey);
+	enable = ((f->enabled != 0) && (f->user_id != 0));
+	perms = perms_of (f->can_leech, f->can_full_scrape);
+	e = set_find (current, f->passkey);
+	if ((enable != 0) ? ((e != NULL) && (e->user_id == f->user_id)
+				&& (e->perms == perms)) : (e == NULL)) {
+		f->unchanged++;
+		return 0;
+	}
+
+	if (f->count == f->size) {
+		size = (f->size == 0) ? PASSKEY_CHANGES_MIN : f->size * 2;
+		p = realloc (f->changes, sizeof (passkey_entry_t) * size);
+		if (p == NULL) {
+			f->error = 1;
+			return 1;
+		}
+
+		f->changes = (passkey_entry_t *) p;
+		p = realloc (f->enable, size);
+		if (p == NULL) {
+			f->error = 1;
+			return 1;
+		}
+
+		f->enable = (uint8_t *) p;
+		f->size = size;
+	}
+
+	e = &f->changes[f->count];
+	memcpy (e->passkey, f->passkey, PASSKEY_LEN);
+	e->user_id = f->user_id;
+	e->perms = perms;
+	f->enable[f->count] = enable;
+	f->count++;
+
+	return 0;
+}
+
+/*
+ * Looks up the passkeys queued by slow_lookup () and caches the answers.
+ * The cache is direct mapped, a colliding passkey just evicts the older
+ * one.  Valid passkeys stay cached until a refresh brings their row into
+ * the set, bad ones for passkey_negative_ttl seconds.  Passkeys stay
+ * queued until they are looked up, so a request asking again meanwhile
+ * does not queue them twice.
+ */
+static void
+lookup_task (void *cls)
+{
+	char pkey[PASSKEY_LEN];
+	passkey_cache_t *c;
+	uint32_t i, n, user_id;
+	uint8_t perms = 0;
+	int rc;
+
+	(void) cls;
+	pthread_mutex_lock (&cache_lock);
+	n = pending_count;
+	pthread_mutex_unlock (&cache_lock);
+	for (i = 0; i < n; i++) {
+		// Only this task removes entries, the first n stay put.
+		pthread_mutex_lock (&cache_lock);
+		memcpy (pkey, pending[i], PASSKEY_LEN);
+		pthread_mutex_unlock (&cache_lock);
+		rc = db_lookup (pkey, &user_id, &perms);
+		if (rc == -2)
+			continue;
+
+		pthread_mutex_lock (&cache_lock);
+		c = &cache[passkey_hash (pkey) & cache_mask];
+		memcpy (c->passkey, pkey, PASSKEY_LEN);
+		if (rc == 0) {
+			c->user_id = user_id;
+			c->perms = perms;
+			c->expires = 0;
+		} else {
+			c->user_id = 0;
+			c->perms = 0;
+			c->expires = event_now () + passkey_negative_ttl;
+		}
+		pthread_mutex_unlock (&cache_lock);
+	}
+
+	if (n == 0)
+		return;
+
+	pthread_mutex_lock (&cache_lock);
+	memmove (pending, pending + n, (pending_count - n) * PASSKEY_LEN);
+	pending_count -= n;
+	pthread_mutex_unlock (&cache_lock);
+
+	return;
+}
+
+/*
+ * Passkeys are random strings, a few multiplies over all 32 bytes are
+ * enough to spread them.
+ */
+static inline uint32_t
+passkey_hash (const char *pkey)
+{
+	uint64_t h = 0, w;
+	uint32_t i;
+
+	for (i = 0; i < PASSKEY_LEN; i += sizeof (w)) {
+		memcpy (&w, pkey + i, sizeof (w));
+		h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+	}
+
+	h ^= h >> 32;
+
+	return (uint32_t) h;
+}
+
+static inline uint8_t
+perms_of (int8_t can_leech, int8_t can_full_scrape)
+{
+	uint8_t perms = 0;
+
+	if (can_leech != 0)
+		perms |= PERM_LEECH;
+
+	if (can_full_scrape != 0)
+		perms |= PERM_FULL_SCRAPE;
+
+	return perms;
+}
+
+/*
+ * Fetches the users changed since the last sync and, if any of them
+ * changes the set, installs a new set with the changes applied.  The sync
+ * point is the newest updated_at seen, rows are asked for from one second
+ * before it because updated_at only has second resolution; a row fetched
+ * twice no longer changes anything and is skipped.  The replaced set is
+ * retired through the epoch, lookups may still be reading it.
+ */
+static int
+refresh (void)
+{
+	passkey_fetch_t f;
+	passkey_set_t *old, *set;
+	MYSQL_BIND param;
+	int64_t since;
+	uint32_t i;
+	int rows;
+
+	memset (&f, 0, sizeof (passkey_fetch_t));
+	f.results[0].buffer_type = MYSQL_TYPE_LONG;
+	f.results[0].buffer = &f.user_id;
+	f.results[0].is_unsigned = 1;
+	f.results[1].buffer_type = MYSQL_TYPE_STRING;
+	f.results[1].buffer = f.passkey;
+	f.results[1].buffer_length = sizeof (f.passkey);
+	f.results[1].length = &f.len;
+	f.results[2].buffer_type = MYSQL_TYPE_TINY;
+	f.results[2].buffer = &f.can_leech;
+	f.results[3].buffer_type = MYSQL_TYPE_TINY;
+	f.results[3].buffer = &f.can_full_scrape;
+	f.results[4].buffer_type = MYSQL_TYPE_TINY;
+	f.results[4].buffer = &f.enabled;
+	f.results[5].buffer_type = MYSQL_TYPE_LONGLONG;
+	f.results[5].buffer = &f.updated;
+	f.last = last_sync;
+	since = (last_sync > 0) ? last_sync - 1 : 0;
+	memset (&param, 0, sizeof (MYSQL_BIND));
+	param.buffer_type = MYSQL_TYPE_LONGLONG;
+	param.buffer = &since;
+	rows = sql_exec (SQL_STMT_USERS_SINCE, &param, f.results, fetch_row,
+			&f);
+	if ((rows < 0) || (f.error != 0)) {
+		debug (LOG_ERR, "ERROR: unable to refresh passkeys.\n");
+		free (f.changes);
+		free (f.enable);
+		return -1;
+	}
+
+	if (f.count == 0) {
+		last_sync = f.last;
+		free (f.changes);
+		free (f.enable);
+		return 0;
+	}
+
+	old = current;
+	set = set_create (((old != NULL) ? old->count : 0) + f.count);
+	if (set == NULL) {
+		free (f.changes);
+		free (f.enable);
+		return -1;
+	}
+
+	if (old != NULL) {
+		for (i = 0; i <= old->mask; i++)
+			if (old->entries[i].user_id != 0)
+				set_insert (set, &old->entries[i]);
+	}
+
+	for (i = 0; i < f.count; i++) {
+		if (f.enable[i] != 0)
+			set_insert (set, &f.changes[i]);
+		else
+			set_delete (set, f.changes[i].passkey);
+	}
+
+	__atomic_store_n (&current, set, __ATOMIC_RELEASE);
+	if (old != NULL)
+		epoch_retire (&old->node);
+
+	last_sync = f.last;
+	debug (LOG_DBG, "passkey: %" PRIu32 " changes, %" PRIu32
+			" unchanged, %" PRIu32 " passkeys.\n", f.count,
+			f.unchanged, set->count);
+	free (f.changes);
+	free (f.enable);
+
+	return 0;
+}
+
+static void
+refresh_task (void *cls)
+{
+	(void) cls;
+	refresh ();
+
+	return;
+}
+
+static passkey_set_t *
+set_create (uint32_t count)
+{
+	passkey_set_t *set;
+	uint32_t size;
+
+	size = PASSKEY_SET_MIN;
+	while ((uint64_t) size * 3 < (uint64_t) count * 4)
+		size <<= 1;
+
+	set = (passkey_set_t *) calloc (1, sizeof (passkey_set_t) + size
+			* sizeof (passkey_entry_t));
+	if (set == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	set->mask = size - 1;
+	set->count = 0;
+
+	return set;
+}
+
+// Removes an entry with backward shift deletion.
+static void
+set_delete (passkey_set_t *set, const char *pkey)
+{
+	passkey_entry_t *e = set->entries;
+	uint32_t i, j, k;
+
+	i = set_probe (set, pkey);
+	if (e[i].user_id == 0)
+		return;
+
+	j = i;
+	while (1) {
+		j = (j + 1) & set->mask;
+		if (e[j].user_id == 0)
+			break;
+
+		k = passkey_hash (e[j].passkey) & set->mask;
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+			continue;
+
+		e[i] = e[j];
+		i = j;
+	}
+
+	e[i].user_id = 0;
+	set->count--;
+
+	return;
+}
+
+static inline passkey_entry_t *
+set_find (passkey_set_t *set, const char *pkey)
+{
+	uint32_t i;
+
+	if (set == NULL)
+		return NULL;
+
+	i = set_probe (set, pkey);
+	if (set->entries[i].user_id == 0)
+		return NULL;
+
+	return &set->entries[i];
+}
+
+// The set is sized for every entry inserted, so a free entry always exists.
+static void
+set_insert (passkey_set_t *set, const passkey_entry_t *e)
+{
+	uint32_t i;
+
+	i = set_probe (set, e->passkey);
+	if (set->entries[i].user_id == 0)
+		set->count++;
+
+	set->entries[i] = *e;
+
+	return;
+}
+
+static inline uint32_t
+set_probe (passkey_set_t *set, const char *pkey)
+{
+	uint32_t i;
+
+	i = passkey_hash (pkey) & set->mask;
+	while ((set->entries[i].user_id != 0)
+			&& (memcmp (set->entries[i].passkey, pkey, PASSKEY_LEN)
+				!= 0))
+		i = (i + 1) & set->mask;
+
+	return i;
+}
+
+/*
+ * A passkey missing from the set is answered from the cache, or else
+ * queued for lookup_task () and -2 returned, so the request thread never
+ * waits for the database.  A full queue just drops the passkey, the
+ * client asks again.
+ */
+static int
+slow_lookup (const char *pkey, uint32_t *user_id, uint8_t *perms)
+{
+	passkey_cache_t *c;
+	uint32_t i;
+
+	pthread_mutex_lock (&cache_lock);
+	c = &cache[passkey_hash (pkey) & cache_mask];
+	if (memcmp (c->passkey, pkey, PASSKEY_LEN) == 0) {
+		if (c->user_id != 0) {
+			*user_id = c->user_id;
+			*perms = c->perms;
+			pthread_mutex_unlock (&cache_lock);
+			return 0;
+		}
+
+		if (c->expires > event_now ()) {
+			pthread_mutex_unlock (&cache_lock);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < pending_count; i++) {
+		if (memcmp (pending[i], pkey, PASSKEY_LEN) == 0)
+			break;
+	}
+
+	if ((i == pending_count) && (pending_count < PASSKEY_PENDING_MAX))
+		memcpy (pending[pending_count++], pkey, PASSKEY_LEN);
+
+	pthread_mutex_unlock (&cache_lock);
+
+	return -2;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __PASSKEY_H__
+#define __PASSKEY_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define PASSKEY_LEN 32
+
+/*
+ * In-memory passkey set.
+ *
+ * Every enabled user's passkey maps to the user id and permissions.  The
+ * set is loaded from the users table at start up and a task on the event
+ * worker fetches the rows changed since its last sync every passkey_refresh
+ * seconds.  Rows that change the set are applied to a copy of it which
+ * then replaces the current one with a single pointer store, so lookups
+ * take no locks.  Lookups read the set inside an epoch section and a
+ * replaced set is retired through the epoch, see epoch.h.
+ *
+ * A passkey missing from the set may belong to a user added since the
+ * last sync, so it is looked up in the database, but never by the request
+ * thread: it may be an event loop serving many connections.  The request
+ * is answered with try again and a task on the event worker looks the
+ * passkey up about a second later.  Its answer goes into a cache of
+ * passkey_negative_size entries, where a valid passkey stays until a
+ * refresh brings its row into the set and a bad one for
+ * passkey_negative_ttl seconds, so repeated announces with it do not
+ * reach the database.
+ */
+
+enum PERM {
+	PERM_LEECH = 1,
+	PERM_FULL_SCRAPE = 1 << 1
+};
+
+void passkey_fin (void);
+int passkey_init (void);
+int passkey_lookup (const char *, size_t, uint32_t *, uint8_t *);
+
+#endif /* __PASSKEY_H__ */
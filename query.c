@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include "query.h"
+
+#define KEY_IS(k, klen, s) (((klen) == sizeof (s) - 1) \
+		&& (memcmp ((k), (s), sizeof (s) - 1) == 0))
+
+static inline int hex_val (char);
+static inline uint32_t parse_key (const char *, size_t);
+static inline int parse_int64 (const char *, size_t, int64_t *);
+static inline uint8_t parse_event (const char *, size_t);
+static inline int32_t parse_numwant (const char *, size_t);
+
+/*
+ * Fills ai from the query string of an announce, returns -1 if a known
+ * argument is malformed.
+ */
+int
+announce_parse (announce_info_t *ai, const char *query, size_t len)
+{
+	const char *end = query + len;
+	const char *key, *val;
+	size_t klen, vlen;
+
+	while (query_next (&query, end, &key, &klen, &val, &vlen) == 0)
+		if (announce_parse_arg (ai, key, klen, val, vlen) != 0)
+			return -1;
+
+	return 0;
+}
+
+/*
+ * Stores a single still percent encoded announce argument in ai, returns
+ * -1 if it is malformed.  Unknown arguments are ignored and ai->ip is only
+ * set when a valid dotted quad ip argument is given.
+ */
+int
+announce_parse_arg (announce_info_t *ai, const char *key, size_t klen,
+		const char *val, size_t vlen)
+{
+	char ip[INET_ADDRSTRLEN];
+	uint64_t u;
+	ssize_t n;
+
+	switch (klen) {
+		case 2:
+			if (KEY_IS (key, klen, "ip")) {
+				n = query_unescape ((uint8_t *) ip,
+						sizeof (ip) - 1, val,
+						vlen);
+				if (n < 0)
+					break;
+
+				ip[n] = '\0';
+				if (inet_pton (AF_INET, ip, &ai->ip)
+						== 1)
+					ai->fields |= ANNOUNCE_IP;
+			}
+
+			break;
+
+		case 3:
+			if (KEY_IS (key, klen, "key"))
+				ai->key = parse_key (val, vlen);
+
+			break;
+
+		case 4:
+			if (KEY_IS (key, klen, "left")) {
+				if (parse_int64 (val, vlen, &ai->left)
+						!= 0)
+					return -1;
+			} else if (KEY_IS (key, klen, "port")) {
+				if (query_uint (val, vlen, UINT16_MAX,
+							&u) != 0)
+					return -1;
+
+				ai->port = (uint16_t) u;
+				ai->fields |= ANNOUNCE_PORT;
+			}
+
+			break;
+
+		case 5:
+			if (KEY_IS (key, klen, "event"))
+				ai->event = parse_event (val, vlen);
+
+			break;
+
+		case 7:
+			if (KEY_IS (key, klen, "peer_id")) {
+				if (query_unescape (ai->peer_id,
+							PEER_ID_LEN,
+							val, vlen)
+						!= PEER_ID_LEN)
+					return -1;
+
+				ai->fields |= ANNOUNCE_PEER_ID;
+			} else if (KEY_IS (key, klen, "compact")) {
+				ai->compact = ((vlen == 1)
+						&& (*val == '1'));
+			} else if (KEY_IS (key, klen, "corrupt")) {
+				if (parse_int64 (val, vlen,
+							&ai->corrupt)
+						!= 0)
+					return -1;
+			} else if (KEY_IS (key, klen, "numwant")) {
+				ai->numwant = parse_numwant (val, vlen);
+			}
+
+			break;
+
+		case 8:
+			if (KEY_IS (key, klen, "uploaded")) {
+				if (parse_int64 (val, vlen,
+							&ai->uploaded)
+						!= 0)
+					return -1;
+			}
+
+			break;
+
+		case 9:
+			if (KEY_IS (key, klen, "info_hash")) {
+				if (query_unescape (ai->info_hash,
+							INFO_HASH_LEN,
+							val, vlen)
+						!= INFO_HASH_LEN)
+					return -1;
+
+				ai->fields |= ANNOUNCE_INFO_HASH;
+			}
+
+			break;
+
+		case 10:
+			if (KEY_IS (key, klen, "downloaded")) {
+				if (parse_int64 (val, vlen,
+							&ai->downloaded)
+						!= 0)
+					return -1;
+			} else if (KEY_IS (key, klen, "no_peer_id")) {
+				ai->no_peer_id = ((vlen == 1)
+						&& (*val == '1'));
+			} else if (KEY_IS (key, klen, "tracker_id")) {
+				ai->tracker_id = val;
+				ai->tracker_id_len = vlen;
+			}
+
+			break;
+
+		default:
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Splits the next key=value pair off the query string at *p, returns -1
+ * when the query string is exhausted.  A pair without '=' has an empty
+ * value.
+ */
+int
+query_next (const char **p, const char *end, const char **key, size_t *klen,
+		const char **val, size_t *vlen)
+{
+	const char *amp, *c, *eq;
+
+	c = *p;
+	while ((c < end) && (*c == '&'))
+		c++;
+
+	if (c >= end)
+		return -1;
+
+	amp = memchr (c, '&', (size_t) (end - c));
+	if (amp == NULL)
+		amp = end;
+
+	eq = memchr (c, '=', (size_t) (amp - c));
+	*key = c;
+	if (eq == NULL) {
+		*klen = (size_t) (amp - c);
+		*val = amp;
+		*vlen = 0;
+	} else {
+		*klen = (size_t) (eq - c);
+		*val = eq + 1;
+		*vlen = (size_t) (amp - eq - 1);
+	}
+
+	*p = amp;
+
+	return 0;
+}
+
+/*
+ * Percent decodes src into dst, returns the decoded length or -1 if src
+ * is malformed or does not fit in size bytes.
+ */
+ssize_t
+query_unescape (uint8_t *dst, size_t size, const char *src, size_t len)
+{
+	const char *end = src + len;
+	size_t n = 0;
+	int hi, lo;
+
+	while (src < end) {
+		if (n == size)
+			return -1;
+
+		if (*src == '%') {
+			if (end - src < 3)
+				return -1;
+
+			hi = hex_val (src[1]);
+			lo = hex_val (src[2]);
+			if ((hi < 0) || (lo < 0))
+				return -1;
+
+			dst[n++] = (uint8_t) ((hi << 4) | lo);
+			src += 3;
+		} else if (*src == '+') {
+			dst[n++] = ' ';
+			src++;
+		} else {
+			dst[n++] = (uint8_t) *src++;
+		}
+	}
+
+	return (ssize_t) n;
+}
+
+/*
+ * Parses an unsigned decimal number no larger than max, returns -1 on
+ * empty input, stray characters or overflow.
+ */
+int
+query_uint (const char *s, size_t len, uint64_t max, uint64_t *val)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	if ((len == 0) || (len > 20))
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		if ((s[i] < '0') || (s[i] > '9'))
+			return -1;
+
+		if (v > (max - (uint64_t) (s[i] - '0')) / 10)
+			return -1;
+
+		v = v * 10 + (uint64_t) (s[i] - '0');
+	}
+
+	*val = v;
+
+	return 0;
+}
+
+int
+scrape_parse (scrape_info_t *si, const char *query, size_t len)
+{
+	const char *end = query + len;
+	const char *key, *val;
+	size_t klen, vlen;
+
+	while (query_next (&query, end, &key, &klen, &val, &vlen) == 0)
+		if (scrape_parse_arg (si, key, klen, val, vlen) != 0)
+			return -1;
+
+	return 0;
+}
+
+/*
+ * Adds a still percent encoded info_hash argument to si, returns -1 if it
+ * is malformed.  Other arguments and info_hashes beyond si->size are
+ * ignored.
+ */
+int
+scrape_parse_arg (scrape_info_t *si, const char *key, size_t klen,
+		const char *val, size_t vlen)
+{
+	if (!KEY_IS (key, klen, "info_hash") || (si->count == si->size))
+		return 0;
+
+	if (query_unescape (si->info_hash[si->count], INFO_HASH_LEN, val,
+				vlen) != INFO_HASH_LEN)
+		return -1;
+
+	si->count++;
+
+	return 0;
+}
+
+static inline int
+hex_val (char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/*
+ * Clients send the key as up to 8 hex digits, anything else is folded
+ * down to 32 bits with FNV-1a.  Zero means no key.
+ */
+static inline uint32_t
+parse_key (const char *s, size_t len)
+{
+	uint32_t h = 0;
+	size_t i;
+	int v;
+
+	if (len <= 8) {
+		for (i = 0; i < len; i++) {
+			v = hex_val (s[i]);
+			if (v < 0)
+				break;
+
+			h = (h << 4) | (uint32_t) v;
+		}
+
+		if (i == len)
+			return h;
+	}
+
+	h = 2166136261U;
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t) s[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static inline int
+parse_int64 (const char *s, size_t len, int64_t *val)
+{
+	uint64_t u;
+
+	if (query_uint (s, len, INT64_MAX, &u) != 0)
+		return -1;
+
+	*val = (int64_t) u;
+
+	return 0;
+}
+
+static inline uint8_t
+parse_event (const char *event, size_t len)
+{
+	if (KEY_IS (event, len, "completed"))
+		return EVENT_COMPLETED;
+
+	if (KEY_IS (event, len, "started"))
+		return EVENT_STARTED;
+
+	if (KEY_IS (event, len, "stopped"))
+		return EVENT_STOPPED;
+
+	return EVENT_NONE;
+}
+
+/*
+ * numwant never fails an announce.  A number too large is clamped, a
+ * negative or malformed one is -1 and gets the default.
+ */
+static inline int32_t
+parse_numwant (const char *s, size_t len)
+{
+	uint64_t u;
+	size_t i;
+
+	if (query_uint (s, len, INT32_MAX, &u) == 0)
+		return (int32_t) u;
+
+	for (i = 0; i < len; i++) {
+		if ((s[i] < '0') || (s[i] > '9'))
+			return -1;
+	}
+
+	return (len == 0) ? -1 : INT32_MAX;
+}
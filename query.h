@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "tracker.h"
+
+/*
+ * Raw query string handling.
+ *
+ * The query string is walked once, keys are matched by length and value
+ * and nothing is copied or NUL terminated.  Binary values are percent
+ * decoded straight into their destination.
+ */
+
+int announce_parse (announce_info_t *, const char *, size_t);
+int announce_parse_arg (announce_info_t *, const char *, size_t,
+		const char *, size_t);
+int query_next (const char **, const char *, const char **, size_t *,
+		const char **, size_t *);
+ssize_t query_unescape (uint8_t *, size_t, const char *, size_t);
+int query_uint (const char *, size_t, uint64_t, uint64_t *);
+int scrape_parse (scrape_info_t *, const char *, size_t);
+int scrape_parse_arg (scrape_info_t *, const char *, size_t, const char *,
+		size_t);
+
+#endif /* __QUERY_H__ */
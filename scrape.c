@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "logger.h"
+#include "scrape.h"
+
+enum CURSOR_STATE {
+	CURSOR_HEAD = 0,
+	CURSOR_FILES,
+	CURSOR_TAIL
+};
+
+typedef struct __scrape_snapshot_type {
+	char *buf;
+	size_t len;
+	time_t made;
+	uint32_t refs;
+} scrape_snapshot_t;
+
+typedef struct __scrape_file_type {
+	uint8_t info_hash[INFO_HASH_LEN];
+	uint32_t complete;
+	uint32_t downloaded;
+	uint32_t incomplete;
+} scrape_file_t;
+
+/*
+ * A cursor reads either from a snapshot or straight from the torrents,
+ * which it walks through index, the torrents sorted by info_hash when the
+ * cursor was opened.  The encoded file that did not fit in the last read
+ * waits in pend.
+ */
+struct __scrape_full_type {
+	scrape_snapshot_t *snap;
+	torrent_t **index;
+	uint32_t count;
+	uint32_t pos;
+	uint8_t state;
+	char pend[SCRAPE_FILE_MAX];
+	size_t pend_len;
+	size_t pend_off;
+};
+
+static inline int file_cmp (const void *, const void *);
+static int index_build (scrape_full_t *);
+static int index_cmp (const void *, const void *);
+static scrape_snapshot_t *snapshot_build (void);
+static scrape_snapshot_t *snapshot_get (void);
+static void snapshot_put (scrape_snapshot_t *);
+
+static scrape_snapshot_t *snapshot = NULL;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t build_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void
+scrape_fin (void)
+{
+	scrape_snapshot_t *s;
+
+	pthread_mutex_lock (&snapshot_lock);
+	s = snapshot;
+	snapshot = NULL;
+	pthread_mutex_unlock (&snapshot_lock);
+	if (s != NULL)
+		snapshot_put (s);
+
+	return;
+}
+
+void
+scrape_full_close (scrape_full_t *fs)
+{
+	if (fs->snap != NULL)
+		snapshot_put (fs->snap);
+
+	free (fs->index);
+	free (fs);
+
+	return;
+}
+
+scrape_full_t *
+scrape_full_open (void)
+{
+	scrape_full_t *fs;
+
+	fs = (scrape_full_t *) malloc (sizeof (scrape_full_t));
+	if (fs == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	memset (fs, 0, sizeof (scrape_full_t));
+
+	// Fall back to the torrents if no snapshot can be had.
+	if (full_scrape_cache != 0)
+		fs->snap = snapshot_get ();
+
+	if ((fs->snap == NULL) && (index_build (fs) != 0)) {
+		free (fs);
+		return NULL;
+	}
+
+	return fs;
+}
+
+/*
+ * Copies the next at most max bytes of the reply starting at offset pos to
+ * buf, returns the number of bytes copied or -1 at the end of the reply.
+ * Reads from the torrents must be sequential.
+ */
+ssize_t
+scrape_full_read (scrape_full_t *fs, uint64_t pos, char *buf, size_t max)
+{
+	benc_writer_t w;
+	size_t len, n = 0;
+
+	if (fs->snap != NULL) {
+		if (pos >= fs->snap->len)
+			return -1;
+
+		len = fs->snap->len - (size_t) pos;
+		if (len > max)
+			len = max;
+
+		memcpy (buf, fs->snap->buf + pos, len);
+
+		return (ssize_t) len;
+	}
+
+	while (n < max) {
+		if (fs->pend_off < fs->pend_len) {
+			len = fs->pend_len - fs->pend_off;
+			if (len > max - n)
+				len = max - n;
+
+			memcpy (buf + n, fs->pend + fs->pend_off, len);
+			fs->pend_off += len;
+			n += len;
+			continue;
+		}
+
+		benc_writer_init (&w, fs->pend, sizeof (fs->pend));
+		if (fs->state == CURSOR_HEAD) {
+			benc_write_dict (&w);
+			benc_write_str (&w, "files", 5);
+			benc_write_dict (&w);
+			fs->state = CURSOR_FILES;
+		} else if (fs->state == CURSOR_FILES) {
+			if (fs->pos < fs->count) {
+				scrape_torrent (&w, fs->index[fs->pos++]);
+			} else {
+				benc_write_end (&w);
+				benc_write_end (&w);
+				fs->state = CURSOR_TAIL;
+			}
+		} else {
+			break;
+		}
+
+		fs->pend_len = w.len;
+		fs->pend_off = 0;
+	}
+
+	if ((n == 0) && (fs->state == CURSOR_TAIL))
+		return -1;
+
+	return (ssize_t) n;
+}
+
+// Returns the length of the reply, or UINT64_MAX if it is not known.
+uint64_t
+scrape_full_size (scrape_full_t *fs)
+{
+	if (fs->snap != NULL)
+		return fs->snap->len;
+
+	return UINT64_MAX;
+}
+
+void
+scrape_torrent (benc_writer_t *w, torrent_t *t)
+{
+	uint32_t complete, downloaded, incomplete;
+
+	torrent_counters (t, &complete, &downloaded, &incomplete);
+	scrape_write (w, t->info_hash, complete, downloaded, incomplete);
+
+	return;
+}
+
+// Writes one entry of a scrape's files dictionary.
+void
+scrape_write (benc_writer_t *w, const uint8_t *info_hash, uint32_t complete,
+		uint32_t downloaded, uint32_t incomplete)
+{
+	benc_write_str (w, info_hash, INFO_HASH_LEN);
+	benc_write_dict (w);
+	benc_write_str (w, "complete", 8);
+	benc_write_int (w, complete);
+	benc_write_str (w, "downloaded", 10);
+	benc_write_int (w, downloaded);
+	benc_write_str (w, "incomplete", 10);
+	benc_write_int (w, incomplete);
+	benc_write_end (w);
+
+	return;
+}
+
+static inline int
+file_cmp (const void *a, const void *b)
+{
+	return memcmp (a, b, INFO_HASH_LEN);
+}
+
+/*
+ * Sorts the torrents by info_hash into the cursor's index, bencode
+ * dictionaries must have their keys sorted.  Torrents stay in memory until
+ * torrent_fin (), so the cursor can keep the pointers.
+ */
+static int
+index_build (scrape_full_t *fs)
+{
+	torrent_t *t;
+	uint32_t n = 0, pos = 0, size;
+
+	// Leave room for torrents added during the walk.
+	size = torrent_count () + 1024;
+	fs->index = (torrent_t **) malloc (sizeof (torrent_t *) * size);
+	if (fs->index == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	while ((n < size) && ((t = torrent_next (&pos)) != NULL))
+		fs->index[n++] = t;
+
+	qsort (fs->index, n, sizeof (torrent_t *), index_cmp);
+	fs->count = n;
+
+	return 0;
+}
+
+static int
+index_cmp (const void *a, const void *b)
+{
+	return memcmp ((*(torrent_t * const *) a)->info_hash,
+			(*(torrent_t * const *) b)->info_hash, INFO_HASH_LEN);
+}
+
+/*
+ * Copies the counters of every torrent, sorts them by info_hash and
+ * encodes the whole reply.
+ */
+static scrape_snapshot_t *
+snapshot_build (void)
+{
+	scrape_snapshot_t *s;
+	scrape_file_t *files;
+	benc_writer_t w;
+	torrent_t *t;
+	uint32_t i, n, pos = 0, size;
+
+	// Leave room for torrents added during the walk.
+	size = torrent_count () + 1024;
+	files = (scrape_file_t *) malloc (sizeof (scrape_file_t) * size);
+	s = (scrape_snapshot_t *) malloc (sizeof (scrape_snapshot_t));
+	if ((files == NULL) || (s == NULL)) {
+		free (files);
+		free (s);
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	n = 0;
+	while ((n < size) && ((t = torrent_next (&pos)) != NULL)) {
+		memcpy (files[n].info_hash, t->info_hash, INFO_HASH_LEN);
+		torrent_counters (t, &files[n].complete, &files[n].downloaded,
+				&files[n].incomplete);
+		n++;
+	}
+
+	qsort (files, n, sizeof (scrape_file_t), file_cmp);
+	benc_writer_init (&w, NULL, 0);
+	benc_reserve (&w, SCRAPE_HEAD_MAX + (size_t) n * SCRAPE_FILE_MAX);
+	benc_write_dict (&w);
+	benc_write_str (&w, "files", 5);
+	benc_write_dict (&w);
+	for (i = 0; i < n; i++)
+		scrape_write (&w, files[i].info_hash, files[i].complete,
+				files[i].downloaded, files[i].incomplete);
+
+	benc_write_end (&w);
+	benc_write_end (&w);
+	free (files);
+	if (benc_writer_error (&w) != 0) {
+		benc_writer_fin (&w);
+		free (s);
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	s->buf = w.buf;
+	s->len = w.len;
+	s->made = time (NULL);
+	s->refs = 1;
+	debug (LOG_DBG, "full scrape snapshot: %" PRIu32 " torrents, %zu "
+			"bytes.\n", n, s->len);
+
+	return s;
+}
+
+/*
+ * Returns a reference to a snapshot no older than full_scrape_cache
+ * seconds.  Only one thread encodes a new snapshot, the others keep using
+ * the previous one meanwhile if there is one.
+ */
+static scrape_snapshot_t *
+snapshot_get (void)
+{
+	scrape_snapshot_t *old, *s;
+	time_t now;
+
+	now = time (NULL);
+	pthread_mutex_lock (&snapshot_lock);
+	s = snapshot;
+	if ((s != NULL) && ((now - s->made < (time_t) full_scrape_cache)
+			|| (pthread_mutex_trylock (&build_lock) != 0))) {
+		s->refs++;
+		pthread_mutex_unlock (&snapshot_lock);
+		return s;
+	}
+
+	pthread_mutex_unlock (&snapshot_lock);
+
+	// The first snapshot, wait for whoever is encoding it.
+	if (s == NULL)
+		pthread_mutex_lock (&build_lock);
+
+	pthread_mutex_lock (&snapshot_lock);
+	s = snapshot;
+	if ((s != NULL) && (now - s->made < (time_t) full_scrape_cache)) {
+		s->refs++;
+		pthread_mutex_unlock (&snapshot_lock);
+		pthread_mutex_unlock (&build_lock);
+		return s;
+	}
+
+	pthread_mutex_unlock (&snapshot_lock);
+	s = snapshot_build ();
+	if (s != NULL) {
+		// One reference for the cache, one for the caller.
+		s->refs++;
+		pthread_mutex_lock (&snapshot_lock);
+		old = snapshot;
+		snapshot = s;
+		pthread_mutex_unlock (&snapshot_lock);
+		if (old != NULL)
+			snapshot_put (old);
+	}
+
+	pthread_mutex_unlock (&build_lock);
+
+	return s;
+}
+
+static void
+snapshot_put (scrape_snapshot_t *s)
+{
+	uint32_t refs;
+
+	pthread_mutex_lock (&snapshot_lock);
+	refs = --s->refs;
+	pthread_mutex_unlock (&snapshot_lock);
+	if (refs == 0) {
+		free (s->buf);
+		free (s);
+	}
+
+	return;
+}
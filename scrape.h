@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __SCRAPE_H__
+#define __SCRAPE_H__
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include "bencode.h"
+#include "torrent.h"
+
+// Longest encoding of a single file of a scrape.
+#define SCRAPE_FILE_MAX (sizeof ("20:d8:completei4294967295e10:downloaded"\
+			"i4294967295e10:incompletei4294967295ee") - 1 \
+		+ INFO_HASH_LEN)
+#define SCRAPE_HEAD_MAX (sizeof ("d5:filesdee") - 1)
+
+/*
+ * Full scrape.
+ *
+ * A full scrape is read in pieces through a cursor so the reply never has
+ * to exist in memory at once.  Opening the cursor sorts pointers to the
+ * torrents by info_hash, as bencode wants dictionary keys sorted, and
+ * reads then encode one file at a time with the counters of that moment.
+ *
+ * With full_scrape_cache set the reply is instead encoded once, sorted,
+ * into a snapshot that is shared by every full scrape for that many
+ * seconds.  The first full scrape after the snapshot expires encodes a new
+ * one while concurrent ones keep reading the old.
+ */
+
+typedef struct __scrape_full_type scrape_full_t;
+
+void scrape_fin (void);
+void scrape_full_close (scrape_full_t *);
+scrape_full_t *scrape_full_open (void);
+ssize_t scrape_full_read (scrape_full_t *, uint64_t, char *, size_t);
+uint64_t scrape_full_size (scrape_full_t *);
+void scrape_torrent (benc_writer_t *, torrent_t *);
+void scrape_write (benc_writer_t *, const uint8_t *, uint32_t, uint32_t,
+		uint32_t);
+
+#endif /* __SCRAPE_H__ */
@@ -3,39 +3,601 @@
  * All rights reserved.
  */
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <mysql.h>
+#include <errmsg.h>
 #include "config.h"
 #include "logger.h"
 #include "sql.h"
+#include "synth.h"
 
-static MYSQL *sql_conn = NULL;
+#define SQL_CONNECT_TIMEOUT 5
+// Bounds every read and write of a query, the client retries each twice.
+#define SQL_IO_TIMEOUT 30
+
+// Plain statements first, then SQL_BATCH_BITS + 1 sizes of every batch.
+#define SQL_STMT_SLOTS (SQL_STMT_MAX + SQL_BATCH_MAX * (SQL_BATCH_BITS + 1))
+
+typedef struct __sql_batch_type {
+	const char *head;
+	const char *row;
+	const char *tail;
+} sql_batch_t;
+
+typedef struct __sql_conn_type sql_conn_t;
+
+struct __sql_conn_type {
+	MYSQL *mysql;
+	MYSQL_STMT *stmts[SQL_STMT_SLOTS];
+	sql_conn_t *next;
+	sql_conn_t *prev;
+};
+
+static char *batch_query (uint32_t);
+static void conn_destroy (void *);
+static sql_conn_t *conn_get (void);
+static int sql_connect (sql_conn_t *);
+static void sql_disconnect (sql_conn_t *);
+static int sql_exec_slot (uint32_t, MYSQL_BIND *, MYSQL_BIND *, sql_row_cb,
+		void *);
+static int sql_run (MYSQL_STMT *, MYSQL_BIND *, MYSQL_BIND *, sql_row_cb,
+		void *);
+static MYSQL_STMT *stmt_get (sql_conn_t *, uint32_t);
+static int synth_exec (uint32_t, MYSQL_BIND *, MYSQL_BIND *, sql_row_cb,
+		void *);
+static inline void synth_put (MYSQL_BIND *, const void *, unsigned long);
+static inline uint32_t synth_user (const MYSQL_BIND *);
+
+static const char *queries[SQL_STMT_MAX] = {
+	[SQL_STMT_USER_BY_PASSKEY] = "SELECT id, can_leech, can_full_scrape "
+		"FROM users WHERE passkey = ? AND enabled = 1",
+	[SQL_STMT_TORRENTS_SINCE] = "SELECT id, info_hash FROM torrents "
+		"WHERE id > ? ORDER BY id",
+	[SQL_STMT_USERS_SINCE] = "SELECT id, passkey, can_leech, "
+		"can_full_scrape, enabled, UNIX_TIMESTAMP(updated_at) "
+		"FROM users "
+		"WHERE updated_at > FROM_UNIXTIME(?)"
+};
+static const sql_batch_t batches[SQL_BATCH_MAX] = {
+	[SQL_BATCH_TRANSFER] = {
+		.head = "INSERT INTO transfers (user_id, torrent_id, uploaded, "
+			"downloaded) VALUES ",
+		.row = "(?, ?, ?, ?)",
+		.tail = " ON DUPLICATE KEY UPDATE uploaded = uploaded + "
+			"VALUES (uploaded), downloaded = downloaded + "
+			"VALUES (downloaded)"
+	}
+};
+
+static pthread_key_t conn_key;
+static uint8_t conn_key_valid = 0;
+static sql_conn_t *conns = NULL;
+static pthread_mutex_t conns_lock = PTHREAD_MUTEX_INITIALIZER;
+static sql_stats_t stats;
+static uint8_t synthetic = 0;
+static int64_t synth_updated = 0;
+
+/*
+ * Runs a prepared statement on the calling thread's connection and returns
+ * the number of rows fetched, or -1 on error.  params and results may be
+ * NULL for statements without parameters or result columns.
+ */
+int
+sql_exec (enum SQL_STMT id, MYSQL_BIND *params, MYSQL_BIND *results,
+		sql_row_cb row, void *cls)
+{
+	return sql_exec_slot ((uint32_t) id, params, results, row, cls);
+}
+
+/*
+ * Runs the n row statement of a batch, n must be a power of two no larger
+ * than SQL_BATCH_ROWS.  params holds the parameters of every row one after
+ * the other.  Returns the affected row count or -1 on error.
+ */
+int
+sql_exec_batch (enum SQL_BATCH id, uint32_t n, MYSQL_BIND *params)
+{
+	if ((n == 0) || (n > SQL_BATCH_ROWS)
+			|| ((n & (n - 1)) != 0)) {
+		debug (LOG_ERR, "ERROR: bad batch size %" PRIu32 ".\n", n);
+		return -1;
+	}
+
+	return sql_exec_slot (SQL_STMT_MAX + (uint32_t) id
+			* (SQL_BATCH_BITS + 1) + (uint32_t) __builtin_ctz (n),
+			params, NULL, NULL, NULL);
+}
 
 void
 sql_fin (void)
 {
-	if (sql_conn != NULL)
-		mysql_close (sql_conn);
+	sql_stats_t st;
 
-	sql_conn = NULL;
+	if (synthetic != 0) {
+		logger (LOG_INFO, "INFO: sql: %" PRIu64 " synthetic queries.\n",
+				stats.queries);
+		synthetic = 0;
+		return;
+	}
+
+	if (conn_key_valid == 0)
+		return;
+
+	sql_stats (&st);
+	logger (LOG_INFO, "INFO: sql: %" PRIu64 " queries, %" PRIu64
+			" errors, %" PRIu64 " reconnects.\n", st.queries,
+			st.errors, st.reconnects);
+	while (conns != NULL)
+		conn_destroy (conns);
+
+	pthread_key_delete (conn_key);
+	conn_key_valid = 0;
+	mysql_library_end ();
 
 	return;
 }
 
+/*
+ * With db_backend synthetic no database is used at all, the queries are
+ * answered from the tables described in synth.h.
+ */
 int
 sql_init (void)
 {
-	sql_conn = mysql_init (NULL);
-	if (sql_conn == NULL) {
+	if (strcmp (db_backend, "synthetic") == 0) {
+		synthetic = 1;
+		synth_updated = (int64_t) time (NULL);
+		logger (LOG_INFO, "INFO: sql: synthetic database, %" PRIu32
+				" torrents, %" PRIu32 " users.\n",
+				db_synthetic_torrents, db_synthetic_users);
+		return 0;
+	}
+
+	if (strcmp (db_backend, "mysql") != 0) {
+		debug (LOG_ERR, "ERROR: unknown db_backend %s.\n", db_backend);
+		return -1;
+	}
+
+	if (mysql_library_init (0, NULL, NULL) != 0) {
+		debug (LOG_ERR, "ERROR: unable to initialize MySQL library.\n");
+		return -1;
+	}
+
+	if (pthread_key_create (&conn_key, conn_destroy) != 0) {
+		debug (LOG_ERR, "ERROR: unable to create thread key.\n");
+		mysql_library_end ();
+		return -1;
+	}
+
+	conn_key_valid = 1;
+
+	// Connect the main thread right away to catch bad credentials.
+	if (conn_get () == NULL)
+		return -1;
+
+	return 0;
+}
+
+void
+sql_stats (sql_stats_t *st)
+{
+	st->conns = __atomic_load_n (&stats.conns, __ATOMIC_RELAXED);
+	st->stmts = __atomic_load_n (&stats.stmts, __ATOMIC_RELAXED);
+	st->queries = __atomic_load_n (&stats.queries, __ATOMIC_RELAXED);
+	st->reconnects = __atomic_load_n (&stats.reconnects,
+			__ATOMIC_RELAXED);
+	st->errors = __atomic_load_n (&stats.errors, __ATOMIC_RELAXED);
+
+	return;
+}
+
+/*
+ * Builds the text of a batch statement slot, the head followed by the row
+ * repeated once per row and the tail.
+ */
+static char *
+batch_query (uint32_t id)
+{
+	const sql_batch_t *b;
+	char *p, *query;
+	size_t head, row, tail;
+	uint32_t i, rows;
+
+	id -= SQL_STMT_MAX;
+	b = &batches[id / (SQL_BATCH_BITS + 1)];
+	rows = 1U << (id % (SQL_BATCH_BITS + 1));
+	head = strlen (b->head);
+	row = strlen (b->row);
+	tail = strlen (b->tail);
+	query = (char *) malloc (head + rows * (row + 2) + tail + 1);
+	if (query == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	p = query;
+	memcpy (p, b->head, head);
+	p += head;
+	for (i = 0; i < rows; i++) {
+		if (i != 0) {
+			memcpy (p, ", ", 2);
+			p += 2;
+		}
+
+		memcpy (p, b->row, row);
+		p += row;
+	}
+
+	memcpy (p, b->tail, tail + 1);
+
+	return query;
+}
+
+/*
+ * Thread exit destructor, also used by sql_fin () for connections whose
+ * threads are still around.
+ */
+static void
+conn_destroy (void *ptr)
+{
+	sql_conn_t *conn = (sql_conn_t *) ptr;
+
+	pthread_mutex_lock (&conns_lock);
+	if (conn->prev != NULL)
+		conn->prev->next = conn->next;
+	else
+		conns = conn->next;
+
+	if (conn->next != NULL)
+		conn->next->prev = conn->prev;
+
+	stats.conns--;
+	pthread_mutex_unlock (&conns_lock);
+	sql_disconnect (conn);
+	free (conn);
+	mysql_thread_end ();
+
+	return;
+}
+
+static sql_conn_t *
+conn_get (void)
+{
+	sql_conn_t *conn;
+
+	conn = (sql_conn_t *) pthread_getspecific (conn_key);
+	if (conn != NULL)
+		return conn;
+
+	pthread_mutex_lock (&conns_lock);
+	if (stats.conns >= db_connections) {
+		pthread_mutex_unlock (&conns_lock);
+		debug (LOG_ERR, "ERROR: db_connections %" PRIu32 " reached.\n",
+				db_connections);
+		return NULL;
+	}
+
+	conn = (sql_conn_t *) malloc (sizeof (sql_conn_t));
+	if (conn == NULL) {
+		pthread_mutex_unlock (&conns_lock);
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	memset (conn, 0, sizeof (sql_conn_t));
+	conn->next = conns;
+	if (conns != NULL)
+		conns->prev = conn;
+
+	conns = conn;
+	stats.conns++;
+	pthread_mutex_unlock (&conns_lock);
+	mysql_thread_init ();
+	pthread_setspecific (conn_key, conn);
+	if (sql_connect (conn) != 0)
+		return NULL;
+
+	return conn;
+}
+
+static int
+sql_connect (sql_conn_t *conn)
+{
+	unsigned int io_timeout = SQL_IO_TIMEOUT;
+	unsigned int timeout = SQL_CONNECT_TIMEOUT;
+
+	conn->mysql = mysql_init (NULL);
+	if (conn->mysql == NULL) {
 		debug (LOG_ERR, "ERROR: out-of-memory.\n");
 		return -1;
 	}
 
-	if (mysql_real_connect (sql_conn, host, user, passwd, name, 0, NULL, 0)
-			== NULL) {
+	mysql_options (conn->mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+	mysql_options (conn->mysql, MYSQL_OPT_READ_TIMEOUT, &io_timeout);
+	mysql_options (conn->mysql, MYSQL_OPT_WRITE_TIMEOUT, &io_timeout);
+	if (mysql_real_connect (conn->mysql, host, user, passwd, name, 0, NULL,
+				0) == NULL) {
 		debug (LOG_ERR, "ERROR: faild to connect to database, error: "
-				"%s\n", mysql_error (sql_conn));
+				"%s\n", mysql_error (conn->mysql));
+		mysql_close (conn->mysql);
+		conn->mysql = NULL;
 		return -1;
 	}
 
 	return 0;
 }
+
+static void
+sql_disconnect (sql_conn_t *conn)
+{
+	uint32_t i;
+
+	for (i = 0; i < SQL_STMT_SLOTS; i++) {
+		if (conn->stmts[i] == NULL)
+			continue;
+
+		mysql_stmt_close (conn->stmts[i]);
+		conn->stmts[i] = NULL;
+		__atomic_sub_fetch (&stats.stmts, 1, __ATOMIC_RELAXED);
+	}
+
+	if (conn->mysql != NULL)
+		mysql_close (conn->mysql);
+
+	conn->mysql = NULL;
+
+	return;
+}
+
+static int
+sql_exec_slot (uint32_t id, MYSQL_BIND *params, MYSQL_BIND *results,
+		sql_row_cb row, void *cls)
+{
+	sql_conn_t *conn;
+	MYSQL_STMT *stmt;
+	unsigned int err;
+	uint32_t tries;
+	int rows;
+
+	if (synthetic != 0)
+		return synth_exec (id, params, results, row, cls);
+
+	conn = conn_get ();
+	if (conn == NULL) {
+		__atomic_add_fetch (&stats.errors, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	__atomic_add_fetch (&stats.queries, 1, __ATOMIC_RELAXED);
+	for (tries = 0; ; tries++) {
+		err = CR_SERVER_GONE_ERROR;
+		stmt = NULL;
+		if (conn->mysql != NULL) {
+			stmt = stmt_get (conn, id);
+			err = mysql_errno (conn->mysql);
+		}
+
+		if (stmt != NULL) {
+			rows = sql_run (stmt, params, results, row, cls);
+			if (rows >= 0)
+				return rows;
+
+			err = mysql_stmt_errno (stmt);
+			debug (LOG_ERR, "ERROR: query %" PRIu32 " failed, "
+					"error: %s\n", id,
+					mysql_stmt_error (stmt));
+		}
+
+		if (((err != CR_SERVER_GONE_ERROR) && (err != CR_SERVER_LOST))
+				|| (tries >= db_reconnects))
+			break;
+
+		__atomic_add_fetch (&stats.reconnects, 1, __ATOMIC_RELAXED);
+		sql_disconnect (conn);
+		sql_connect (conn);
+	}
+
+	__atomic_add_fetch (&stats.errors, 1, __ATOMIC_RELAXED);
+
+	return -1;
+}
+
+static int
+sql_run (MYSQL_STMT *stmt, MYSQL_BIND *params, MYSQL_BIND *results,
+		sql_row_cb row, void *cls)
+{
+	int rc, rows = 0;
+
+	if ((params != NULL) && (mysql_stmt_bind_param (stmt, params) != 0))
+		return -1;
+
+	if (mysql_stmt_execute (stmt) != 0)
+		return -1;
+
+	if (results == NULL)
+		return (int) mysql_stmt_affected_rows (stmt);
+
+	if (mysql_stmt_bind_result (stmt, results) != 0)
+		return -1;
+
+	if (mysql_stmt_store_result (stmt) != 0)
+		return -1;
+
+	while (((rc = mysql_stmt_fetch (stmt)) == 0)
+			|| (rc == MYSQL_DATA_TRUNCATED)) {
+		rows++;
+		if ((row != NULL) && (row (cls) != 0))
+			break;
+	}
+
+	mysql_stmt_free_result (stmt);
+	if (rc == 1)
+		return -1;
+
+	return rows;
+}
+
+static MYSQL_STMT *
+stmt_get (sql_conn_t *conn, uint32_t id)
+{
+	MYSQL_STMT *stmt;
+	char *query;
+	int rc;
+
+	if (conn->stmts[id] != NULL)
+		return conn->stmts[id];
+
+	if (__atomic_add_fetch (&stats.stmts, 1, __ATOMIC_RELAXED)
+			> db_statements) {
+		__atomic_sub_fetch (&stats.stmts, 1, __ATOMIC_RELAXED);
+		debug (LOG_ERR, "ERROR: db_statements %" PRIu32 " reached.\n",
+				db_statements);
+		return NULL;
+	}
+
+	stmt = mysql_stmt_init (conn->mysql);
+	if (stmt == NULL) {
+		__atomic_sub_fetch (&stats.stmts, 1, __ATOMIC_RELAXED);
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	if (id < SQL_STMT_MAX) {
+		rc = mysql_stmt_prepare (stmt, queries[id],
+				strlen (queries[id]));
+	} else {
+		query = batch_query (id);
+		rc = -1;
+		if (query != NULL)
+			rc = mysql_stmt_prepare (stmt, query, strlen (query));
+
+		free (query);
+	}
+
+	if (rc != 0) {
+		debug (LOG_ERR, "ERROR: unable to prepare query %" PRIu32
+				", error: %s\n", id, mysql_stmt_error (stmt));
+		mysql_stmt_close (stmt);
+		__atomic_sub_fetch (&stats.stmts, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	conn->stmts[id] = stmt;
+
+	return stmt;
+}
+
+/*
+ * Answers a statement from the synthetic tables the way MySQL would.
+ * Batches are thrown away.
+ */
+static int
+synth_exec (uint32_t id, MYSQL_BIND *params, MYSQL_BIND *results,
+		sql_row_cb row, void *cls)
+{
+	uint8_t info_hash[INFO_HASH_LEN];
+	char passkey[PASSKEY_LEN + 1];
+	int64_t since, updated;
+	uint32_t first, i;
+	int8_t yes = 1;
+	int rows = 0;
+
+	__atomic_add_fetch (&stats.queries, 1, __ATOMIC_RELAXED);
+	if (id >= SQL_STMT_MAX)
+		return 1 << ((id - SQL_STMT_MAX) % (SQL_BATCH_BITS + 1));
+
+	switch (id) {
+		case SQL_STMT_USER_BY_PASSKEY:
+			i = synth_user (&params[0]);
+			if (i == 0)
+				return 0;
+
+			synth_put (&results[0], &i, sizeof (i));
+			synth_put (&results[1], &yes, sizeof (yes));
+			synth_put (&results[2], &yes, sizeof (yes));
+			return 1;
+
+		case SQL_STMT_TORRENTS_SINCE:
+			memcpy (&first, params[0].buffer, sizeof (first));
+			for (i = first + 1; i <= db_synthetic_torrents; i++) {
+				synth_info_hash (i, info_hash);
+				synth_put (&results[0], &i, sizeof (i));
+				synth_put (&results[1], info_hash,
+						INFO_HASH_LEN);
+				rows++;
+				if ((row != NULL) && (row (cls) != 0))
+					break;
+			}
+
+			return rows;
+
+		case SQL_STMT_USERS_SINCE:
+			// User i was updated at synth_updated - users + i.
+			memcpy (&since, params[0].buffer, sizeof (since));
+			since -= synth_updated - db_synthetic_users;
+			if (since >= db_synthetic_users)
+				return 0;
+
+			for (i = (since < 0) ? 1 : (uint32_t) since + 1;
+					i <= db_synthetic_users; i++) {
+				updated = synth_updated - db_synthetic_users
+					+ i;
+				synth_passkey (i, passkey);
+				synth_put (&results[0], &i, sizeof (i));
+				synth_put (&results[1], passkey, PASSKEY_LEN);
+				synth_put (&results[2], &yes, sizeof (yes));
+				synth_put (&results[3], &yes, sizeof (yes));
+				synth_put (&results[4], &yes, sizeof (yes));
+				synth_put (&results[5], &updated,
+						sizeof (updated));
+				rows++;
+				if ((row != NULL) && (row (cls) != 0))
+					break;
+			}
+
+			return rows;
+	}
+
+	return 0;
+}
+
+// Strings are cut to the buffer and report their full length.
+static inline void
+synth_put (MYSQL_BIND *b, const void *val, unsigned long len)
+{
+	if ((b->buffer_type == MYSQL_TYPE_STRING)
+			|| (b->buffer_type == MYSQL_TYPE_BLOB)) {
+		if (b->length != NULL)
+			*b->length = len;
+
+		if (len > b->buffer_length)
+			len = b->buffer_length;
+	}
+
+	memcpy (b->buffer, val, len);
+
+	return;
+}
+
+// Returns the user of a synthetic passkey, 0 for none.
+static inline uint32_t
+synth_user (const MYSQL_BIND *b)
+{
+	char passkey[PASSKEY_LEN + 1];
+	unsigned long id;
+	char *end;
+
+	if ((b->length == NULL) || (*b->length != PASSKEY_LEN))
+		return 0;
+
+	memcpy (passkey, b->buffer, PASSKEY_LEN);
+	passkey[PASSKEY_LEN] = '\0';
+	id = strtoul (passkey, &end, 16);
+	if ((*end != '\0') || (id == 0) || (id > db_synthetic_users))
+		return 0;
+
+	return (uint32_t) id;
+}
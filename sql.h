@@ -6,7 +6,60 @@
 #ifndef __SQL_H__
 #define __SQL_H__
 
+#include <inttypes.h>
+#include <mysql.h>
+
+/*
+ * Database access.
+ *
+ * Every thread that talks to MySQL gets its own connection, opened the
+ * first time it runs a query and closed when the thread exits.  Queries
+ * are prepared statements run over the binary protocol, each connection
+ * prepares a statement the first time it runs it.  A query that fails
+ * because the server went away reconnects, prepares the statement again
+ * and is retried up to db_reconnects times.  A read or write that stalls
+ * for SQL_IO_TIMEOUT seconds fails the query, so a hung server holds no
+ * caller for long.
+ *
+ * Batch statements insert many rows at once.  A batch of n rows, n a power
+ * of two up to SQL_BATCH_ROWS, is its own prepared statement, so writing
+ * any number of rows as power of two chunks needs at most
+ * SQL_BATCH_BITS + 1 statements per batch and connection.
+ */
+
+enum SQL_STMT {
+	SQL_STMT_USER_BY_PASSKEY,
+	SQL_STMT_TORRENTS_SINCE,
+	SQL_STMT_USERS_SINCE,
+	SQL_STMT_MAX
+};
+
+enum SQL_BATCH {
+	SQL_BATCH_TRANSFER,
+	SQL_BATCH_MAX
+};
+
+#define SQL_BATCH_BITS 8
+#define SQL_BATCH_ROWS (1 << SQL_BATCH_BITS)
+
+// Parameters bound per row of a batch.
+#define SQL_TRANSFER_PARAMS 4
+
+typedef struct __sql_stats_type {
+	uint32_t conns;
+	uint32_t stmts;
+	uint64_t queries;
+	uint64_t reconnects;
+	uint64_t errors;
+} sql_stats_t;
+
+// Called for every fetched row, a non-zero return stops fetching.
+typedef int (*sql_row_cb) (void *);
+
+int sql_exec (enum SQL_STMT, MYSQL_BIND *, MYSQL_BIND *, sql_row_cb, void *);
+int sql_exec_batch (enum SQL_BATCH, uint32_t, MYSQL_BIND *);
 void sql_fin (void);
 int sql_init (void);
+void sql_stats (sql_stats_t *);
 
 #endif /* __SQL_H__ */
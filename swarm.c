@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logger.h"
+#include "swarm.h"
+
+#define SWARM_MIN 8
+
+#define SWARM_GROW(s, field, n) do { \
+	void *__p = realloc ((s)->field, sizeof (*(s)->field) * (n)); \
+	if (__p == NULL) \
+		return -1; \
+	(s)->field = __p; \
+} while (0)
+
+// A failed shrink keeps the larger array.
+#define SWARM_SHRINK(s, field, n) do { \
+	void *__p = realloc ((s)->field, sizeof (*(s)->field) * (n)); \
+	if (__p != NULL) \
+		(s)->field = __p; \
+} while (0)
+
+static inline int64_t counter_delta (int64_t, int64_t);
+static inline void idx_delete (swarm_t *, uint32_t);
+static inline uint32_t idx_probe (swarm_t *, const uint8_t *);
+static inline uint32_t peer_hash (const uint8_t *);
+static inline swarm_peers_t *peers_alloc (uint32_t);
+static int swarm_resize (swarm_t *, uint32_t);
+
+/*
+ * Works out the bytes the announcing peer transferred since its previous
+ * announce, slot is its current slot or -1 if it is not in the swarm.  A
+ * peer new to the swarm only counts when it announces started, otherwise
+ * its totals are taken as the baseline.  Counters that went backwards mean
+ * the client restarted and are counted from zero.
+ */
+void
+swarm_delta (swarm_t *s, int32_t slot, announce_info_t *ai, int64_t *up,
+		int64_t *down)
+{
+	if ((slot < 0) || ((uint32_t) slot >= s->count)) {
+		*up = 0;
+		*down = 0;
+		if (ai->event == EVENT_STARTED) {
+			*up = counter_delta (0, ai->uploaded);
+			*down = counter_delta (0, ai->downloaded);
+		}
+
+		return;
+	}
+
+	*up = counter_delta (s->uploaded[slot], ai->uploaded);
+	*down = counter_delta (s->downloaded[slot], ai->downloaded);
+
+	return;
+}
+
+void
+swarm_fin (swarm_t *s)
+{
+	free (s->peers);
+	free (s->key);
+	free (s->last_seen);
+	free (s->left);
+	free (s->uploaded);
+	free (s->downloaded);
+	free (s->timer);
+	free (s->idx);
+	swarm_init (s);
+
+	return;
+}
+
+int32_t
+swarm_find (swarm_t *s, const uint8_t *peer_id)
+{
+	uint32_t pos;
+
+	if (s->count == 0)
+		return -1;
+
+	pos = idx_probe (s, peer_id);
+	if (s->idx[pos] == 0)
+		return -1;
+
+	return (int32_t) (s->idx[pos] - 1);
+}
+
+void
+swarm_init (swarm_t *s)
+{
+	memset (s, 0, sizeof (swarm_t));
+
+	return;
+}
+
+void
+swarm_remove (swarm_t *s, uint32_t slot)
+{
+	uint32_t last, pos;
+
+	if (slot >= s->count)
+		return;
+
+	idx_delete (s, idx_probe (s, s->peers->peer_id[slot]));
+	if (s->left[slot] == 0)
+		s->seeders--;
+
+	last = --s->count;
+	if (slot != last) {
+		memcpy (s->peers->addr[slot], s->peers->addr[last],
+				PEER_ADDR_LEN);
+		memcpy (s->peers->peer_id[slot], s->peers->peer_id[last],
+				PEER_ID_LEN);
+		s->key[slot] = s->key[last];
+		s->last_seen[slot] = s->last_seen[last];
+		s->left[slot] = s->left[last];
+		s->uploaded[slot] = s->uploaded[last];
+		s->downloaded[slot] = s->downloaded[last];
+		s->timer[slot] = s->timer[last];
+		if (s->timer[slot] != NULL)
+			s->timer[slot]->slot = slot;
+
+		pos = idx_probe (s, s->peers->peer_id[slot]);
+		s->idx[pos] = slot + 1;
+	}
+
+	if ((s->size > SWARM_MIN) && (s->count <= s->size / 4))
+		swarm_resize (s, s->size / 2);
+
+	return;
+}
+
+/*
+ * Adds the announcing peer to the swarm or refreshes its entry, returns the
+ * peer's slot or -1 if the announce can not be stored.  The bytes moved
+ * since the peer's previous announce are returned in up and down, see
+ * swarm_delta ().
+ */
+int32_t
+swarm_update (swarm_t *s, announce_info_t *ai, uint32_t now, int64_t *up,
+		int64_t *down)
+{
+	uint32_t pos, slot;
+	uint16_t port;
+
+	*up = 0;
+	*down = 0;
+
+	if ((s->idx == NULL) && (swarm_resize (s, SWARM_MIN) != 0)) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	pos = idx_probe (s, ai->peer_id);
+	if (s->idx[pos] == 0) {
+		if (s->count == s->size) {
+			if (swarm_resize (s, s->size * 2) != 0) {
+				debug (LOG_ERR, "ERROR: out-of-memory.\n");
+				return -1;
+			}
+
+			pos = idx_probe (s, ai->peer_id);
+		}
+
+		swarm_delta (s, -1, ai, up, down);
+		if (ai->event == EVENT_COMPLETED)
+			s->completed++;
+
+		if (ai->left == 0)
+			s->seeders++;
+
+		slot = s->count++;
+		memcpy (s->peers->peer_id[slot], ai->peer_id, PEER_ID_LEN);
+		s->timer[slot] = NULL;
+		s->idx[pos] = slot + 1;
+	} else {
+		slot = s->idx[pos] - 1;
+
+		// A peer may only move to a new address if it knows its key.
+		if ((memcmp (s->peers->addr[slot], &ai->ip, sizeof (ai->ip))
+					!= 0)
+				&& (s->key[slot] != 0)
+				&& (s->key[slot] != ai->key))
+			return -1;
+
+		swarm_delta (s, (int32_t) slot, ai, up, down);
+		if ((s->left[slot] != 0) && (ai->left == 0)) {
+			s->seeders++;
+			if (ai->event == EVENT_COMPLETED)
+				s->completed++;
+		} else if ((s->left[slot] == 0) && (ai->left != 0)) {
+			s->seeders--;
+		}
+	}
+
+	port = htons (ai->port);
+	memcpy (s->peers->addr[slot], &ai->ip, sizeof (ai->ip));
+	memcpy (s->peers->addr[slot] + sizeof (ai->ip), &port, sizeof (port));
+	s->key[slot] = ai->key;
+	s->last_seen[slot] = now;
+	s->left[slot] = ai->left;
+	s->uploaded[slot] = ai->uploaded;
+	s->downloaded[slot] = ai->downloaded;
+
+	return (int32_t) slot;
+}
+
+/*
+ * Takes the swarm's peer list as it is now.  Without the lock the result
+ * is only good if the torrent's seq did not move while it was used, but
+ * it never points outside the block it was taken from.
+ */
+void
+swarm_view (swarm_t *s, swarm_view_t *v)
+{
+	swarm_peers_t *peers;
+
+	peers = __atomic_load_n (&s->peers, __ATOMIC_ACQUIRE);
+	v->count = 0;
+	v->seeders = 0;
+	v->addr = NULL;
+	v->peer_id = NULL;
+	if (peers == NULL)
+		return;
+
+	v->addr = (const uint8_t (*)[PEER_ADDR_LEN]) peers->addr;
+	v->peer_id = (const uint8_t (*)[PEER_ID_LEN]) peers->peer_id;
+	v->count = __atomic_load_n (&s->count, __ATOMIC_RELAXED);
+	v->seeders = __atomic_load_n (&s->seeders, __ATOMIC_RELAXED);
+	if (v->count > peers->size)
+		v->count = peers->size;
+
+	if (v->seeders > v->count)
+		v->seeders = v->count;
+
+	return;
+}
+
+static inline int64_t
+counter_delta (int64_t prev, int64_t cur)
+{
+	if (cur < 0)
+		return 0;
+
+	if (cur < prev)
+		return cur;
+
+	return cur - prev;
+}
+
+static inline void
+idx_delete (swarm_t *s, uint32_t pos)
+{
+	uint32_t i, j, k;
+
+	i = pos;
+	j = pos;
+	while (1) {
+		j = (j + 1) & s->idx_mask;
+		if (s->idx[j] == 0)
+			break;
+
+		// Leave entries whose home slot lies cyclically in (i, j].
+		k = peer_hash (s->peers->peer_id[s->idx[j] - 1])
+			& s->idx_mask;
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+			continue;
+
+		s->idx[i] = s->idx[j];
+		i = j;
+	}
+
+	s->idx[i] = 0;
+
+	return;
+}
+
+static inline uint32_t
+idx_probe (swarm_t *s, const uint8_t *peer_id)
+{
+	uint32_t i;
+
+	i = peer_hash (peer_id) & s->idx_mask;
+	while (s->idx[i] != 0) {
+		if (memcmp (s->peers->peer_id[s->idx[i] - 1], peer_id,
+					PEER_ID_LEN) == 0)
+			break;
+
+		i = (i + 1) & s->idx_mask;
+	}
+
+	return i;
+}
+
+/*
+ * Peer ids usually start with a fixed client prefix, so all 20 bytes are
+ * mixed down rather than using any part of the id directly.
+ */
+static inline uint32_t
+peer_hash (const uint8_t *peer_id)
+{
+	uint64_t a, b, c;
+
+	memcpy (&a, peer_id, sizeof (a));
+	memcpy (&b, peer_id + 8, sizeof (b));
+	memcpy (&c, peer_id + 12, sizeof (c));
+	a ^= b * 0x9e3779b97f4a7c15ULL;
+	a ^= c * 0xc2b2ae3d27d4eb4fULL;
+	a ^= a >> 29;
+	a *= 0xbf58476d1ce4e5b9ULL;
+	a ^= a >> 32;
+
+	return (uint32_t) a;
+}
+
+// The block holds the header followed by both arrays.
+static inline swarm_peers_t *
+peers_alloc (uint32_t size)
+{
+	swarm_peers_t *peers;
+
+	peers = (swarm_peers_t *) malloc (sizeof (swarm_peers_t) + (size_t)
+			size * (PEER_ADDR_LEN + PEER_ID_LEN));
+	if (peers == NULL)
+		return NULL;
+
+	peers->size = size;
+	peers->addr = (uint8_t (*)[PEER_ADDR_LEN]) (peers + 1);
+	peers->peer_id = (uint8_t (*)[PEER_ID_LEN]) (peers->addr + size);
+
+	return peers;
+}
+
+static int
+swarm_resize (swarm_t *s, uint32_t size)
+{
+	swarm_peers_t *peers;
+	uint32_t i, idx_size, pos;
+	uint32_t *idx;
+
+	if (size > s->size) {
+		SWARM_GROW (s, key, size);
+		SWARM_GROW (s, last_seen, size);
+		SWARM_GROW (s, left, size);
+		SWARM_GROW (s, uploaded, size);
+		SWARM_GROW (s, downloaded, size);
+		SWARM_GROW (s, timer, size);
+	}
+
+	peers = peers_alloc (size);
+	if (peers == NULL)
+		return -1;
+
+	idx_size = SWARM_MIN;
+	while (idx_size < size * 2)
+		idx_size <<= 1;
+
+	idx = (uint32_t *) calloc (idx_size, sizeof (uint32_t));
+	if (idx == NULL) {
+		free (peers);
+		return -1;
+	}
+
+	// Readers may still be walking the old block.
+	if (s->peers != NULL) {
+		memcpy (peers->addr, s->peers->addr, (size_t) s->count
+				* PEER_ADDR_LEN);
+		memcpy (peers->peer_id, s->peers->peer_id, (size_t) s->count
+				* PEER_ID_LEN);
+		epoch_retire (&s->peers->node);
+	}
+
+	__atomic_store_n (&s->peers, peers, __ATOMIC_RELEASE);
+	free (s->idx);
+	s->idx = idx;
+	s->idx_mask = idx_size - 1;
+	for (i = 0; i < s->count; i++) {
+		pos = idx_probe (s, s->peers->peer_id[i]);
+		s->idx[pos] = i + 1;
+	}
+
+	if (size < s->size) {
+		SWARM_SHRINK (s, key, size);
+		SWARM_SHRINK (s, last_seen, size);
+		SWARM_SHRINK (s, left, size);
+		SWARM_SHRINK (s, uploaded, size);
+		SWARM_SHRINK (s, downloaded, size);
+		SWARM_SHRINK (s, timer, size);
+	}
+
+	s->size = size;
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __SWARM_H__
+#define __SWARM_H__
+
+#include <inttypes.h>
+#include "epoch.h"
+#include "tracker.h"
+#include "wheel.h"
+
+#define PEER_ADDR_LEN 6
+
+/*
+ * Per-torrent peer set.
+ *
+ * Peers are kept as a struct of arrays so that building a peer list only
+ * walks the packed addr array: addr[i] is the 4-byte IPv4 address followed
+ * by the 2-byte port, both in network byte order, exactly as they appear in
+ * a compact peer list.  The remaining per-peer fields live in parallel
+ * arrays indexed by the same slot.
+ *
+ * Slots are dense, a removed peer is replaced by the last one.  The idx
+ * table maps a peer_id to its slot (stored as slot + 1, 0 is empty) using
+ * open addressing with linear probing and backward shift deletion, so
+ * insert, update and remove are all O(1).
+ *
+ * seeders counts the peers with nothing left to download and completed
+ * the peers that announced completed after having something left.
+ *
+ * The last uploaded and downloaded totals a peer reported are kept so each
+ * announce can be turned into the bytes transferred since the previous one.
+ *
+ * timer[i] is the peer's expiry handle, owned by the expiry module and
+ * NULL until the peer is first scheduled.  The handle's slot follows the
+ * peer when it is moved.
+ *
+ * A swarm is changed only with the owning torrent's lock held.  addr and
+ * peer_id, all a peer list needs, live in one block that is replaced
+ * rather than reallocated when the swarm is resized and the old block is
+ * handed to epoch_retire (), so swarm_view () may be taken without the
+ * lock inside an epoch as long as the torrent's seq is checked afterwards.
+ */
+
+typedef struct __peer_timer_type {
+	wheel_node_t node;
+	struct __torrent_type *torrent;
+	uint32_t slot;
+} peer_timer_t;
+
+typedef struct __swarm_peers_type {
+	epoch_node_t node;
+	uint32_t size;
+	uint8_t (*addr)[PEER_ADDR_LEN];
+	uint8_t (*peer_id)[PEER_ID_LEN];
+} swarm_peers_t;
+
+// What a peer list is built from, count never exceeds the arrays.
+typedef struct __swarm_view_type {
+	const uint8_t (*addr)[PEER_ADDR_LEN];
+	const uint8_t (*peer_id)[PEER_ID_LEN];
+	uint32_t count;
+	uint32_t seeders;
+} swarm_view_t;
+
+typedef struct __swarm_type {
+	swarm_peers_t *peers;
+	uint32_t *key;
+	uint32_t *last_seen;
+	int64_t *left;
+	int64_t *uploaded;
+	int64_t *downloaded;
+	peer_timer_t **timer;
+	uint32_t *idx;
+	uint32_t idx_mask;
+	uint32_t count;
+	uint32_t size;
+	uint32_t seeders;
+	uint32_t completed;
+} swarm_t;
+
+void swarm_delta (swarm_t *, int32_t, announce_info_t *, int64_t *,
+		int64_t *);
+void swarm_fin (swarm_t *);
+int32_t swarm_find (swarm_t *, const uint8_t *);
+void swarm_init (swarm_t *);
+void swarm_remove (swarm_t *, uint32_t);
+int32_t swarm_update (swarm_t *, announce_info_t *, uint32_t, int64_t *,
+		int64_t *);
+void swarm_view (swarm_t *, swarm_view_t *);
+
+#endif /* __SWARM_H__ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __SYNTH_H__
+#define __SYNTH_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "passkey.h"
+#include "tracker.h"
+
+/*
+ * The synthetic database of db_backend synthetic, see sql.c.  Torrents
+ * 1 to db_synthetic_torrents and users 1 to db_synthetic_users exist,
+ * every user may leech and full scrape.  Load generators build the same
+ * info_hashes and passkeys from the ids with these.
+ */
+
+// splitmix64, info_hashes must look random to the index and the filter.
+static inline uint64_t
+synth_mix (uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+	return x ^ (x >> 31);
+}
+
+static inline void
+synth_info_hash (uint32_t id, uint8_t *info_hash)
+{
+	uint64_t h;
+	uint32_t i, n;
+
+	for (i = 0; i < INFO_HASH_LEN; i += n) {
+		h = synth_mix ((uint64_t) id << 8 | i);
+		n = (INFO_HASH_LEN - i < sizeof (h)) ? INFO_HASH_LEN - i
+			: sizeof (h);
+		memcpy (info_hash + i, &h, n);
+	}
+
+	return;
+}
+
+// The passkey is the id in 32 hex digits, passkey holds PASSKEY_LEN + 1.
+static inline void
+synth_passkey (uint32_t id, char *passkey)
+{
+	snprintf (passkey, PASSKEY_LEN + 1, "%032" PRIx32, id);
+
+	return;
+}
+
+#endif /* __SYNTH_H__ */
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+/*
+ * Reads a trace dump, see trace.h, and prints the percentiles of every
+ * stage and of the whole request followed by the slowest requests.  A
+ * stage lasts from the end of the last stage the request reached before it
+ * and is left out of the requests that never reached it.
+ *
+ *   trace_report [-n <slowest>] <trace file>
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../trace.h"
+
+#define SLOWEST_DEFAULT 20
+
+static int cmp_total (const void *, const void *);
+static int cmp_u32 (const void *, const void *);
+static inline uint32_t duration (const trace_record_t *, uint32_t);
+static void print_percentiles (const char *, uint32_t *, uint64_t);
+static void print_slowest (trace_record_t *, uint64_t, uint64_t);
+static trace_record_t *read_dump (const char *, trace_header_t *);
+
+static const char *fronts[] = {"mhd", "native"};
+static const char *kinds[] = {"other", "announce", "scrape"};
+// Indexed by reply + 3, see enum TRACKER_REPLY.
+static const char *replies[] = {"full_scrape", "error", "ok", "bad_request",
+	"missing_passkey", "unregistered", "try_again", "invalid_passkey",
+	"leech_disabled", "full_scrape_denied"};
+static const char *stages[TRACE_STAGES] = {
+	[TRACE_SPLIT] = "split",
+	[TRACE_PARSE] = "parse",
+	[TRACE_PASSKEY] = "passkey",
+	[TRACE_LOOKUP] = "lookup",
+	[TRACE_ENCODE] = "encode",
+	[TRACE_QUEUE] = "queue"
+};
+
+int
+main (int argc, char *argv[])
+{
+	trace_header_t h;
+	trace_record_t *recs;
+	uint32_t *ns;
+	uint64_t i, n, slowest = SLOWEST_DEFAULT;
+	uint32_t s;
+	int c;
+
+	while ((c = getopt (argc, argv, "n:")) != -1) {
+		if (c != 'n')
+			goto usage;
+
+		slowest = strtoull (optarg, NULL, 10);
+	}
+
+	if (optind != argc - 1)
+		goto usage;
+
+	recs = read_dump (argv[optind], &h);
+	if (recs == NULL)
+		return EXIT_FAILURE;
+
+	ns = (uint32_t *) malloc ((h.count + 1) * sizeof (uint32_t));
+	if (ns == NULL) {
+		fprintf (stderr, "ERROR: out-of-memory.\n");
+		free (recs);
+		return EXIT_FAILURE;
+	}
+
+	printf ("%" PRIu64 " requests, 1 in %" PRIu32 " traced.\n\n", h.count,
+			h.rate);
+	printf ("%-10s %10s %10s %10s %10s %10s %10s\n", "stage (us)", "count",
+			"p50", "p90", "p99", "p99.9", "max");
+	for (s = 0; s < TRACE_STAGES; s++) {
+		n = 0;
+		for (i = 0; i < h.count; i++) {
+			if ((recs[i].stages & (1 << s)) != 0)
+				ns[n++] = duration (&recs[i], s);
+		}
+
+		print_percentiles (stages[s], ns, n);
+	}
+
+	for (i = 0; i < h.count; i++)
+		ns[i] = recs[i].total;
+
+	print_percentiles ("total", ns, h.count);
+	print_slowest (recs, h.count, slowest);
+	free (ns);
+	free (recs);
+
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf (stderr, "usage: %s [-n <slowest>] <trace file>\n", argv[0]);
+
+	return EXIT_FAILURE;
+}
+
+// Slowest first.
+static int
+cmp_total (const void *a, const void *b)
+{
+	const trace_record_t *x = a, *y = b;
+
+	return (x->total < y->total) - (x->total > y->total);
+}
+
+static int
+cmp_u32 (const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static inline uint32_t
+duration (const trace_record_t *r, uint32_t stage)
+{
+	uint32_t s;
+
+	for (s = stage; s > 0; s--) {
+		if ((r->stages & (1 << (s - 1))) != 0)
+			return r->stage[stage] - r->stage[s - 1];
+	}
+
+	return r->stage[stage];
+}
+
+static void
+print_percentiles (const char *name, uint32_t *ns, uint64_t n)
+{
+	double p[] = {0.5, 0.9, 0.99, 0.999};
+	uint64_t k;
+	uint32_t i;
+
+	printf ("%-10s %10" PRIu64, name, n);
+	if (n == 0) {
+		printf ("\n");
+		return;
+	}
+
+	qsort (ns, n, sizeof (uint32_t), cmp_u32);
+	for (i = 0; i < 4; i++) {
+		k = (uint64_t) (p[i] * n + 0.999999);
+		printf (" %10.1f", ns[(k > 0) ? k - 1 : 0] / 1e3);
+	}
+
+	printf (" %10.1f\n", ns[n - 1] / 1e3);
+
+	return;
+}
+
+static void
+print_slowest (trace_record_t *recs, uint64_t count, uint64_t slowest)
+{
+	trace_record_t *r;
+	const char *front, *kind, *reply;
+	char when[32];
+	struct tm tm;
+	time_t sec;
+	uint64_t i;
+	uint32_t j, s;
+
+	if ((slowest == 0) || (count == 0))
+		return;
+
+	if (slowest > count)
+		slowest = count;
+
+	qsort (recs, count, sizeof (trace_record_t), cmp_total);
+	printf ("\nslowest %" PRIu64 " requests, stages in us, - where not "
+			"reached:\n%-23s %7s %-6s %-8s %-18s %9s", slowest,
+			"time", "tid", "front", "kind", "reply", "total");
+	for (s = 0; s < TRACE_STAGES; s++)
+		printf (" %8s", stages[s]);
+
+	printf (" %8s %6s %s\n", "swarm", "peers", "info_hash");
+	for (i = 0; i < slowest; i++) {
+		r = &recs[i];
+		front = (r->front <= TRACE_NATIVE) ? fronts[r->front] : "?";
+		kind = (r->kind <= TRACE_SCRAPE) ? kinds[r->kind] : "?";
+		reply = ((r->reply >= -3) && (r->reply < 7))
+			? replies[r->reply + 3] : "?";
+		sec = (time_t) (r->when / 1000000000ULL);
+		localtime_r (&sec, &tm);
+		strftime (when, sizeof (when), "%Y-%m-%d %H:%M:%S", &tm);
+		printf ("%s.%03u %7" PRIu32 " %-6s %-8s %-18s %9.1f", when,
+				(unsigned int) (r->when / 1000000 % 1000),
+				r->tid, front, kind, reply, r->total / 1e3);
+		for (s = 0; s < TRACE_STAGES; s++) {
+			if ((r->stages & (1 << s)) != 0)
+				printf (" %8.1f", duration (r, s) / 1e3);
+			else
+				printf (" %8s", "-");
+		}
+
+		printf (" %8" PRIu32 " %6" PRIu32 " ", r->swarm, r->peers);
+		if (r->kind == TRACE_ANNOUNCE) {
+			for (j = 0; j < sizeof (r->info_hash); j++)
+				printf ("%02x", r->info_hash[j]);
+		}
+
+		printf ("\n");
+	}
+
+	return;
+}
+
+static trace_record_t *
+read_dump (const char *path, trace_header_t *h)
+{
+	trace_record_t *recs;
+	FILE *fp;
+
+	fp = fopen (path, "r");
+	if (fp == NULL) {
+		perror (path);
+		return NULL;
+	}
+
+	if ((fread (h, sizeof (trace_header_t), 1, fp) != 1)
+			|| (memcmp (h->magic, TRACE_MAGIC, sizeof (h->magic))
+				!= 0)
+			|| (h->record_size != sizeof (trace_record_t))) {
+		fprintf (stderr, "ERROR: %s is not a trace dump of this "
+				"version.\n", path);
+		fclose (fp);
+		return NULL;
+	}
+
+	recs = (trace_record_t *) malloc ((h->count + 1)
+			* sizeof (trace_record_t));
+	if (recs == NULL) {
+		fprintf (stderr, "ERROR: out-of-memory.\n");
+		fclose (fp);
+		return NULL;
+	}
+
+	if (fread (recs, sizeof (trace_record_t), h->count, fp) != h->count) {
+		fprintf (stderr, "ERROR: %s is cut short.\n", path);
+		free (recs);
+		fclose (fp);
+		return NULL;
+	}
+
+	fclose (fp);
+
+	return recs;
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logger.h"
+#include "torrent.h"
+
+#define TORRENT_TBL_MIN 1024
+#define TORRENT_SHARDS_MAX 65536
+
+enum SLOT_STATE {
+	SLOT_EMPTY = 0,
+	SLOT_BUSY,
+	SLOT_FULL
+};
+
+// A shard's lock, alone on its cache line.
+typedef struct __torrent_shard_type {
+	pthread_mutex_t lock;
+} __attribute__ ((aligned (64))) torrent_shard_t;
+
+typedef struct __torrent_slot_type {
+	uint8_t info_hash[INFO_HASH_LEN];
+	uint32_t state;
+	torrent_t *torrent;
+} torrent_slot_t;
+
+static inline uint32_t shard_index (const uint8_t *);
+static inline uint32_t slot_index (const uint8_t *);
+static inline uint32_t slot_wait (torrent_slot_t *);
+static inline torrent_t *new_torrent (const uint8_t *);
+
+static torrent_shard_t *shards = NULL;
+static uint32_t shards_mask = 0;
+static torrent_slot_t *tbl = NULL;
+static uint32_t tbl_mask = 0;
+static uint32_t tbl_max = 0;
+static uint32_t tbl_count = 0;
+
+// Reads the torrent's counters as of one point in time.
+void
+torrent_counters (torrent_t *t, uint32_t *complete, uint32_t *downloaded,
+		uint32_t *incomplete)
+{
+	uint32_t seq;
+
+	do {
+		seq = torrent_read_begin (t);
+		*complete = __atomic_load_n (&t->complete, __ATOMIC_RELAXED);
+		*downloaded = __atomic_load_n (&t->downloaded,
+				__ATOMIC_RELAXED);
+		*incomplete = __atomic_load_n (&t->incomplete,
+				__ATOMIC_RELAXED);
+	} while (torrent_read_retry (t, seq) != 0);
+
+	return;
+}
+
+void
+torrent_fin (void)
+{
+	uint32_t i;
+
+	if (tbl == NULL)
+		return;
+
+	for (i = 0; i <= tbl_mask; i++) {
+		if (tbl[i].state != SLOT_FULL)
+			continue;
+
+		swarm_fin (&tbl[i].torrent->swarm);
+		free (tbl[i].torrent);
+	}
+
+	for (i = 0; i <= shards_mask; i++)
+		pthread_mutex_destroy (&shards[i].lock);
+
+	free (shards);
+	shards = NULL;
+	shards_mask = 0;
+	free (tbl);
+	tbl = NULL;
+	tbl_mask = 0;
+	tbl_max = 0;
+	tbl_count = 0;
+
+	return;
+}
+
+int
+torrent_init (uint32_t max_torrents, uint32_t max_shards)
+{
+	uint64_t size = TORRENT_TBL_MIN;
+	uint32_t i, n = 1;
+	void *ptr;
+
+	while (size * 3 < (uint64_t) max_torrents * 4)
+		size <<= 1;
+
+	if (size > ((uint64_t) 1 << 31)) {
+		debug (LOG_ERR, "ERROR: max_torrents %" PRIu32 " is too large."
+				"\n", max_torrents);
+		return -1;
+	}
+
+	if (posix_memalign (&ptr, 64, sizeof (torrent_slot_t) * size) != 0) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	tbl = (torrent_slot_t *) ptr;
+	while ((n < max_shards) && (n < TORRENT_SHARDS_MAX))
+		n <<= 1;
+
+	if (posix_memalign (&ptr, 64, sizeof (torrent_shard_t) * n) != 0) {
+		free (tbl);
+		tbl = NULL;
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	shards = (torrent_shard_t *) ptr;
+	for (i = 0; i < n; i++)
+		pthread_mutex_init (&shards[i].lock, NULL);
+
+	shards_mask = n - 1;
+	memset (tbl, 0, sizeof (torrent_slot_t) * size);
+	tbl_mask = (uint32_t) (size - 1);
+	tbl_max = max_torrents;
+	tbl_count = 0;
+	debug (LOG_DBG, "torrent index: %" PRIu64 " slots, %" PRIu64
+			" bytes, %" PRIu32 " shards.\n", size,
+			sizeof (torrent_slot_t) * size, n);
+
+	return 0;
+}
+
+torrent_t *
+torrent_insert (const uint8_t *info_hash)
+{
+	torrent_slot_t *slot;
+	torrent_t *t = NULL;
+	uint32_t i, n, state;
+
+	i = slot_index (info_hash);
+	for (n = 0; n <= tbl_mask; ) {
+		slot = &tbl[i];
+		state = slot_wait (slot);
+		if (state == SLOT_FULL) {
+			if (memcmp (slot->info_hash, info_hash, INFO_HASH_LEN)
+					== 0) {
+				free (t);
+
+				return slot->torrent;
+			}
+
+			i = (i + 1) & tbl_mask;
+			n++;
+			continue;
+		}
+
+		// Empty slot, the torrent is not in the index.
+		if (t == NULL) {
+			t = new_torrent (info_hash);
+			if (t == NULL)
+				return NULL;
+		}
+
+		/*
+		 * The limit is checked before claiming a slot, concurrent
+		 * inserts can overshoot it by a few entries which the spare
+		 * slots of the table absorb.
+		 */
+		if (__atomic_load_n (&tbl_count, __ATOMIC_RELAXED) >= tbl_max) {
+			// Another thread may have just filled this slot.
+			if (slot_wait (slot) != SLOT_EMPTY)
+				continue;
+
+			debug (LOG_ERR, "ERROR: torrent index is full.\n");
+			break;
+		}
+
+		state = SLOT_EMPTY;
+		if (__atomic_compare_exchange_n (&slot->state, &state,
+					SLOT_BUSY, 0, __ATOMIC_ACQUIRE,
+					__ATOMIC_RELAXED) == 0) {
+			// Lost the race for this slot, look at it again.
+			continue;
+		}
+
+		__atomic_add_fetch (&tbl_count, 1, __ATOMIC_RELAXED);
+		memcpy (slot->info_hash, info_hash, INFO_HASH_LEN);
+		slot->torrent = t;
+		__atomic_store_n (&slot->state, SLOT_FULL, __ATOMIC_RELEASE);
+
+		return t;
+	}
+
+	free (t);
+
+	return NULL;
+}
+
+torrent_t *
+torrent_lookup (const uint8_t *info_hash)
+{
+	torrent_slot_t *slot;
+	uint32_t i, n;
+
+	i = slot_index (info_hash);
+	for (n = 0; n <= tbl_mask; n++) {
+		slot = &tbl[i];
+		if (slot_wait (slot) == SLOT_EMPTY)
+			return NULL;
+
+		if (memcmp (slot->info_hash, info_hash, INFO_HASH_LEN) == 0)
+			return slot->torrent;
+
+		i = (i + 1) & tbl_mask;
+	}
+
+	return NULL;
+}
+
+/*
+ * Iterates over the index, *pos starts at 0 and the next torrent at or
+ * after it is returned.  Returns NULL once the whole index was walked.
+ * Torrents inserted during the walk may or may not be seen.
+ */
+torrent_t *
+torrent_next (uint32_t *pos)
+{
+	torrent_slot_t *slot;
+
+	while (*pos <= tbl_mask) {
+		slot = &tbl[(*pos)++];
+		if (__atomic_load_n (&slot->state, __ATOMIC_ACQUIRE)
+				== SLOT_FULL)
+			return slot->torrent;
+	}
+
+	return NULL;
+}
+
+uint32_t
+torrent_count (void)
+{
+	return __atomic_load_n (&tbl_count, __ATOMIC_RELAXED);
+}
+
+/*
+ * The slot index uses the first eight bytes of the info_hash, the shard
+ * takes four others so that neighbouring slots do not share a lock.
+ */
+static inline uint32_t
+shard_index (const uint8_t *info_hash)
+{
+	uint32_t h;
+
+	memcpy (&h, info_hash + 12, sizeof (h));
+
+	return h & shards_mask;
+}
+
+static inline uint32_t
+slot_index (const uint8_t *info_hash)
+{
+	uint64_t h;
+
+	memcpy (&h, info_hash, sizeof (h));
+
+	return (uint32_t) (h ^ (h >> 32)) & tbl_mask;
+}
+
+/*
+ * Returns the state of a slot, waiting out the short window in which an
+ * inserting thread has claimed the slot but not yet published its key.
+ */
+static inline uint32_t
+slot_wait (torrent_slot_t *slot)
+{
+	uint32_t state;
+
+	while ((state = __atomic_load_n (&slot->state, __ATOMIC_ACQUIRE))
+			== SLOT_BUSY)
+		sched_yield ();
+
+	return state;
+}
+
+static inline torrent_t *
+new_torrent (const uint8_t *info_hash)
+{
+	torrent_t *t;
+
+	t = (torrent_t *) malloc (sizeof (torrent_t));
+	if (t == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return NULL;
+	}
+
+	memset (t, 0, sizeof (torrent_t));
+	memcpy (t->info_hash, info_hash, INFO_HASH_LEN);
+	t->lock = &shards[shard_index (info_hash)].lock;
+	swarm_init (&t->swarm);
+
+	return t;
+}
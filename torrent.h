@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __TORRENT_H__
+#define __TORRENT_H__
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include "swarm.h"
+
+/*
+ * In-memory torrent index.
+ *
+ * The index is an open-addressing hash table with linear probing keyed on
+ * the raw 20-byte info_hash.  An info_hash is a SHA-1 digest, so its first
+ * eight bytes are used directly as the hash value and no mixing function
+ * is needed.
+ *
+ * Every slot is 32 bytes: the 20-byte info_hash, a 4-byte state word and a
+ * pointer to the torrent.  The table is sized once at start up to the next
+ * power of two holding max_torrents at a load factor of at most 3/4, so
+ * the fixed overhead is between 43 and 86 bytes per torrent (about 64MB for
+ * one million torrents) plus the torrent_t itself.  The table never grows;
+ * once max_torrents torrents are indexed further inserts fail.
+ *
+ * Lookups take no locks.  Inserts claim an empty slot with a compare and
+ * swap, fill it in and then publish it, so any number of threads can look
+ * up and insert concurrently.  Torrents are never removed from the index
+ * while the tracker is running, so a pointer returned by torrent_lookup ()
+ * stays valid until torrent_fin ().  id is the torrent's database id, 0
+ * while unknown.
+ *
+ * Torrents are spread by info_hash over a power of two number of shards,
+ * each with its own lock, and the swarm of a torrent is changed only with
+ * its shard's lock held.  Every change is also bracketed by
+ * torrent_write_begin () and torrent_write_end (), which make seq odd for
+ * the duration, so readers never take the lock: they note seq with
+ * torrent_read_begin (), read, and start over if torrent_read_retry ()
+ * says a writer got in between.  Readers that follow pointers out of the
+ * swarm rely on epoch_retire () to keep the blocks they may still see.
+ *
+ * complete, incomplete and downloaded are copies of the swarm's counters
+ * stored after every change to it, torrent_counters () reads them as one.
+ */
+
+typedef struct __torrent_type torrent_t;
+
+struct __torrent_type {
+	uint8_t info_hash[INFO_HASH_LEN];
+	uint32_t id;
+	uint32_t complete;
+	uint32_t incomplete;
+	uint32_t downloaded;
+	uint32_t seq;
+	pthread_mutex_t *lock;
+	swarm_t swarm;
+};
+
+void torrent_counters (torrent_t *, uint32_t *, uint32_t *, uint32_t *);
+void torrent_fin (void);
+int torrent_init (uint32_t, uint32_t);
+torrent_t *torrent_insert (const uint8_t *);
+torrent_t *torrent_lookup (const uint8_t *);
+torrent_t *torrent_next (uint32_t *);
+uint32_t torrent_count (void);
+
+static inline uint32_t
+torrent_read_begin (torrent_t *t)
+{
+	uint32_t seq;
+
+	while (((seq = __atomic_load_n (&t->seq, __ATOMIC_ACQUIRE)) & 1) != 0)
+		sched_yield ();
+
+	return seq;
+}
+
+static inline int
+torrent_read_retry (torrent_t *t, uint32_t seq)
+{
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n (&t->seq, __ATOMIC_RELAXED) != seq;
+}
+
+// Called with the torrent's lock held after every change to its swarm.
+static inline void
+torrent_update_counters (torrent_t *t)
+{
+	swarm_t *s = &t->swarm;
+
+	__atomic_store_n (&t->complete, s->seeders, __ATOMIC_RELAXED);
+	__atomic_store_n (&t->incomplete, s->count - s->seeders,
+			__ATOMIC_RELAXED);
+	__atomic_store_n (&t->downloaded, s->completed, __ATOMIC_RELAXED);
+
+	return;
+}
+
+static inline void
+torrent_write_begin (torrent_t *t)
+{
+	__atomic_store_n (&t->seq, t->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+
+	return;
+}
+
+static inline void
+torrent_write_end (torrent_t *t)
+{
+	__atomic_store_n (&t->seq, t->seq + 1, __ATOMIC_RELEASE);
+
+	return;
+}
+
+#endif /* __TORRENT_H__ */
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "event.h"
+#include "logger.h"
+#include "trace.h"
+
+#define TRACE_RING_MIN 64
+
+/*
+ * A thread's ring of finished records.  Only the dump reads it, the lock
+ * is all but uncontended and only taken for sampled requests.
+ */
+typedef struct __trace_ring_type trace_ring_t;
+
+struct __trace_ring_type {
+	pthread_mutex_t lock;
+	uint64_t head;
+	uint32_t tid;
+	trace_record_t *records;
+	trace_ring_t *next;
+} __attribute__ ((aligned (64)));
+
+static inline uint64_t clock_ns (clockid_t);
+static void dump (void *);
+static trace_ring_t *ring_new (void);
+
+__thread trace_record_t *trace_current = NULL;
+
+static __thread uint32_t countdown = 0;
+static __thread trace_record_t current;
+static trace_record_t *out = NULL;
+static uint32_t ring_size = 0;
+static trace_ring_t *rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint64_t started;
+static __thread trace_ring_t *thread_ring = NULL;
+
+void
+trace_fin (void)
+{
+	trace_ring_t *r;
+
+	while (rings != NULL) {
+		r = rings;
+		rings = r->next;
+		pthread_mutex_destroy (&r->lock);
+		free (r->records);
+		free (r);
+	}
+
+	if (out != NULL)
+		free (out);
+
+	out = NULL;
+
+	return;
+}
+
+/*
+ * Every thread gets a ring of trace_buffer records, rounded up to a power
+ * of two, the first time it stores one.
+ */
+int
+trace_init (void)
+{
+	if (trace_sample_rate == 0)
+		return 0;
+
+	ring_size = TRACE_RING_MIN;
+	while (ring_size < trace_buffer)
+		ring_size <<= 1;
+
+	out = (trace_record_t *) malloc (ring_size * sizeof (trace_record_t));
+	if (out == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	if (event_signal (SIGUSR1, dump, NULL) != 0) {
+		trace_fin ();
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+trace_sample (enum TRACE_FRONT front)
+{
+	if (countdown > 1) {
+		countdown--;
+		return;
+	}
+
+	countdown = trace_sample_rate;
+	memset (&current, 0, sizeof (trace_record_t));
+	current.when = clock_ns (CLOCK_REALTIME);
+	current.front = (uint8_t) front;
+	started = clock_ns (CLOCK_MONOTONIC);
+	trace_current = &current;
+
+	return;
+}
+
+void
+trace_set (enum TRACE_KIND kind, const uint8_t *info_hash, uint32_t swarm,
+		uint32_t peers)
+{
+	current.kind = (uint8_t) kind;
+	if (info_hash != NULL)
+		memcpy (current.info_hash, info_hash,
+				sizeof (current.info_hash));
+
+	current.swarm = swarm;
+	current.peers = peers;
+
+	return;
+}
+
+void
+trace_stamp (enum TRACE_STAGE stage)
+{
+	uint64_t ns;
+
+	ns = clock_ns (CLOCK_MONOTONIC) - started;
+	current.stage[stage] = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t) ns;
+	current.stages |= (uint8_t) (1 << stage);
+
+	return;
+}
+
+void
+trace_store (int reply)
+{
+	trace_ring_t *r = thread_ring;
+	uint64_t ns;
+
+	ns = clock_ns (CLOCK_MONOTONIC) - started;
+	current.total = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t) ns;
+	current.reply = (int8_t) reply;
+	trace_current = NULL;
+	if (r == NULL) {
+		r = ring_new ();
+		if (r == NULL)
+			return;
+
+		thread_ring = r;
+	}
+
+	pthread_mutex_lock (&r->lock);
+	current.tid = r->tid;
+	r->records[r->head & (ring_size - 1)] = current;
+	r->head++;
+	pthread_mutex_unlock (&r->lock);
+
+	return;
+}
+
+static inline uint64_t
+clock_ns (clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime (clock, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * Writes every ring to trace_file, by way of a temporary file so that a
+ * dump is never seen half written.  Each ring is copied under its lock and
+ * written out after.
+ */
+static void
+dump (void *cls)
+{
+	trace_header_t h;
+	trace_ring_t *r;
+	FILE *fp;
+	char *tmp;
+	uint64_t first, head;
+	uint32_t n;
+	int rc;
+
+	(void) cls;
+	tmp = (char *) malloc (strlen (trace_file) + 5);
+	if (tmp == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return;
+	}
+
+	sprintf (tmp, "%s.tmp", trace_file);
+	fp = fopen (tmp, "w");
+	if (fp == NULL) {
+		debug (LOG_ERR, "ERROR: unable to open %s: %s.\n", tmp,
+				strerror (errno));
+		free (tmp);
+		return;
+	}
+
+	memset (&h, 0, sizeof (trace_header_t));
+	memcpy (h.magic, TRACE_MAGIC, sizeof (h.magic));
+	h.record_size = sizeof (trace_record_t);
+	h.rate = trace_sample_rate;
+	fwrite (&h, sizeof (trace_header_t), 1, fp);
+	pthread_mutex_lock (&rings_lock);
+	for (r = rings; r != NULL; r = r->next) {
+		pthread_mutex_lock (&r->lock);
+		head = r->head;
+		first = (head > ring_size) ? head - ring_size : 0;
+		for (n = 0; first + n < head; n++)
+			out[n] = r->records[(first + n) & (ring_size - 1)];
+
+		pthread_mutex_unlock (&r->lock);
+		fwrite (out, sizeof (trace_record_t), n, fp);
+		h.count += n;
+	}
+
+	pthread_mutex_unlock (&rings_lock);
+	rewind (fp);
+	fwrite (&h, sizeof (trace_header_t), 1, fp);
+	rc = ferror (fp);
+	if (fclose (fp) != 0)
+		rc = -1;
+
+	if (rc != 0) {
+		debug (LOG_ERR, "ERROR: unable to write %s.\n", tmp);
+		unlink (tmp);
+	} else if (rename (tmp, trace_file) != 0) {
+		debug (LOG_ERR, "ERROR: unable to rename %s: %s.\n", tmp,
+				strerror (errno));
+		unlink (tmp);
+	} else {
+		logger (LOG_INFO, "INFO: trace: %" PRIu64 " records dumped to "
+				"%s.\n", h.count, trace_file);
+	}
+
+	free (tmp);
+
+	return;
+}
+
+static trace_ring_t *
+ring_new (void)
+{
+	trace_ring_t *r;
+	void *ptr;
+
+	if (posix_memalign (&ptr, 64, sizeof (trace_ring_t)) != 0)
+		return NULL;
+
+	r = (trace_ring_t *) ptr;
+	r->records = (trace_record_t *) malloc (ring_size
+			* sizeof (trace_record_t));
+	if (r->records == NULL) {
+		free (r);
+		return NULL;
+	}
+
+	pthread_mutex_init (&r->lock, NULL);
+	r->head = 0;
+	r->tid = (uint32_t) syscall (SYS_gettid);
+	pthread_mutex_lock (&rings_lock);
+	r->next = rings;
+	rings = r;
+	pthread_mutex_unlock (&rings_lock);
+
+	return r;
+}
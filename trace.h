@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <inttypes.h>
+
+/*
+ * Sampled tracing of HTTP requests.
+ *
+ * One request in trace_sample_rate of every thread is traced, 0 turns
+ * tracing off.  A traced request notes how many nanoseconds after it
+ * started each stage ended, stages it never reached are left out of
+ * stages.  The record goes into a ring of the thread that served it, the
+ * oldest records are overwritten.  SIGUSR1 dumps every ring to
+ * trace_file, trace_report in tools/ reads the dump.
+ *
+ * Peers are picked while the reply is written, so picking them is part of
+ * TRACE_ENCODE.
+ *
+ * A dump is a trace_header_t followed by count records, in the byte order
+ * of the tracker.
+ */
+
+enum TRACE_STAGE {
+	TRACE_SPLIT = 0,
+	TRACE_PARSE,
+	TRACE_PASSKEY,
+	TRACE_LOOKUP,
+	TRACE_ENCODE,
+	TRACE_QUEUE,
+	TRACE_STAGES
+};
+
+enum TRACE_FRONT {
+	TRACE_MHD = 0,
+	TRACE_NATIVE
+};
+
+enum TRACE_KIND {
+	TRACE_OTHER = 0,
+	TRACE_ANNOUNCE,
+	TRACE_SCRAPE
+};
+
+#define TRACE_MAGIC "TMSTTRC2"
+
+typedef struct __trace_header_type {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t rate;
+	uint64_t count;
+} trace_header_t;
+
+/*
+ * when is the wall clock in nanoseconds.  For an announce swarm is the
+ * peers in the swarm and peers the most asked for, for a scrape swarm is
+ * the info_hashes asked for.  info_hash holds the first bytes of an
+ * announce's info_hash.  reply is the tracker's reply, see enum
+ * TRACKER_REPLY.
+ */
+typedef struct __trace_record_type {
+	uint64_t when;
+	uint32_t stage[TRACE_STAGES];
+	uint32_t total;
+	uint32_t tid;
+	uint32_t swarm;
+	uint32_t peers;
+	uint8_t info_hash[8];
+	int8_t reply;
+	uint8_t front;
+	uint8_t kind;
+	uint8_t stages;
+} trace_record_t;
+
+extern uint32_t trace_sample_rate;
+extern __thread trace_record_t *trace_current;
+
+void trace_fin (void);
+int trace_init (void);
+void trace_sample (enum TRACE_FRONT);
+void trace_set (enum TRACE_KIND, const uint8_t *, uint32_t, uint32_t);
+void trace_stamp (enum TRACE_STAGE);
+void trace_store (int);
+
+// Starts tracing the request if it is its thread's turn.
+static inline void
+trace_begin (enum TRACE_FRONT front)
+{
+	if (__builtin_expect (trace_sample_rate != 0, 0))
+		trace_sample (front);
+
+	return;
+}
+
+// Ends the traced request, if any, with its reply.
+static inline void
+trace_end (int reply)
+{
+	if (__builtin_expect (trace_current != NULL, 0))
+		trace_store (reply);
+
+	return;
+}
+
+// Notes the end of stage.
+static inline void
+trace_mark (enum TRACE_STAGE stage)
+{
+	if (__builtin_expect (trace_current != NULL, 0))
+		trace_stamp (stage);
+
+	return;
+}
+
+// Notes what the traced request, if any, asked for.
+static inline void
+trace_note (enum TRACE_KIND kind, const uint8_t *info_hash, uint32_t swarm,
+		uint32_t peers)
+{
+	if (__builtin_expect (trace_current != NULL, 0))
+		trace_set (kind, info_hash, swarm, peers);
+
+	return;
+}
+
+#endif /* __TRACE_H__ */
@@ -3,112 +3,390 @@
  * All rights reserved.
  */
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "acct.h"
+#include "announce.h"
+#include "arena.h"
 #include "bencode.h"
+#include "catalog.h"
+#include "config.h"
+#include "epoch.h"
+#include "event.h"
+#include "expire.h"
 #include "logger.h"
+#include "metrics.h"
+#include "passkey.h"
+#include "scrape.h"
+#include "torrent.h"
+#include "trace.h"
 #include "tracker.h"
 
-static inline char *
-bad_request (void)
+#define NUMWANT_DEFAULT 50
+#define NUMWANT_MAX 200
+// Lock-free attempts at a peer list before taking the torrent's lock.
+#define SAMPLE_TRIES 4
+
+#define ANNOUNCE_REQUIRED (ANNOUNCE_INFO_HASH | ANNOUNCE_PEER_ID \
+		| ANNOUNCE_PORT)
+
+typedef struct __reply_type {
+	char *str;
+	size_t len;
+} reply_t;
+
+static int announce (announce_info_t *, uint32_t, uint8_t, char **,
+		size_t *, uint64_t);
+static inline int info_hash_cmp (const void *, const void *);
+static inline uint32_t rand_start (uint32_t);
+static size_t sample_peers (torrent_t *, announce_info_t *, char *,
+		uint32_t, int32_t);
+static int scrape (scrape_info_t *, uint8_t, char **, size_t *, uint64_t);
+static inline size_t write_peers (torrent_t *, announce_info_t *, char *,
+		uint32_t, int32_t);
+
+static const char *reasons[TRACKER_REPLY_MAX] = {
+	[TRACKER_REPLY_BAD_REQUEST] = "Bad request, unsupported request "
+		"from client.",
+	[TRACKER_REPLY_MISSING_PASSKEY] = "Missing passkey, re-download "
+		"torrent from forum.",
+	[TRACKER_REPLY_UNREGISTERED] = "Unregistered torrent.",
+	[TRACKER_REPLY_TRY_AGAIN] = "Tracker is busy, try again later.",
+	[TRACKER_REPLY_INVALID_PASSKEY] = "Invalid passkey, re-download "
+		"torrent from forum.",
+	[TRACKER_REPLY_LEECH_DISABLED] = "Your download privileges are "
+		"disabled.",
+	[TRACKER_REPLY_FULL_SCRAPE_DENIED] = "Full scrape is not permitted."
+};
+static reply_t replies[TRACKER_REPLY_MAX];
+static __thread uint32_t rand_state = 0;
+
+void
+tracker_fin (void)
 {
-	benc_data_t *bd = NULL;
-	benc_dict_t *dict = NULL;
-	char *str = NULL;
-
-	dict = (benc_dict_t *) malloc (sizeof (benc_dict_t) * 2);
-	if (dict == NULL)
-		return NULL;
-
-	dict[1].val = NULL;
-	dict[0].key = strdup ("failure reason");
-	bd = new_benc_data (BENC_TYPE_STR);
-	if (bd == NULL) {
-		free (dict[0].key);
-		free (dict);
-		return NULL;
-	}
+	uint32_t i;
+
+	for (i = 0; i < TRACKER_REPLY_MAX; i++) {
+		if (replies[i].str != NULL)
+			free (replies[i].str);
 
-	bd->data.s = strdup ("Bad request, unsupported request from client.");
-	if (bd->data.s == NULL) {
-		free (bd);
-		free (dict[0].key);
-		free (dict);
-		return NULL;
+		replies[i].str = NULL;
+		replies[i].len = 0;
 	}
 
-	dict[0].val = bd;
-	bd = new_benc_data (BENC_TYPE_DCT);
-	if (bd == NULL) {
-		free_benc_data (dict[0].val);
-		free (dict[0].key);
-		free (dict);
-		return NULL;
+	return;
+}
+
+int
+tracker_handle_request (char *pkey, char *req, announce_info_t *ai,
+		scrape_info_t *si, char **ret, size_t *len)
+{
+	uint64_t start;
+	uint32_t user_id;
+	uint8_t perms;
+	int rc;
+
+	start = metrics_clock ();
+	if ((pkey == NULL) || (strcmp (pkey, "announce") == 0)
+			|| (strcmp (pkey, "scrape") == 0))
+		return TRACKER_REPLY_MISSING_PASSKEY;
+
+	if ((req == NULL) || ((strcmp (req, "announce") != 0)
+				&& (strcmp (req, "scrape") != 0)))
+		return TRACKER_REPLY_BAD_REQUEST;
+
+	rc = passkey_lookup (pkey, strlen (pkey), &user_id, &perms);
+	if (rc == -2)
+		return TRACKER_REPLY_TRY_AGAIN;
+
+	if (rc != 0)
+		return TRACKER_REPLY_INVALID_PASSKEY;
+
+	trace_mark (TRACE_PASSKEY);
+	if (strcmp (req, "announce") == 0)
+		return announce (ai, user_id, perms, ret, len, start);
+
+	return scrape (si, perms, ret, len, start);
+}
+
+/*
+ * Encodes the fixed failure replies once, the HTTP front end serves them
+ * from shared responses.
+ */
+int
+tracker_init (void)
+{
+	benc_writer_t w;
+	uint32_t i;
+
+	for (i = 0; i < TRACKER_REPLY_MAX; i++) {
+		benc_writer_init (&w, NULL, 0);
+		benc_write_dict (&w);
+		benc_write_str (&w, "failure reason", 14);
+		benc_write_str (&w, reasons[i], strlen (reasons[i]));
+		benc_write_end (&w);
+		if (benc_writer_error (&w) != 0) {
+			benc_writer_fin (&w);
+			tracker_fin ();
+			debug (LOG_ERR, "ERROR: out-of-memory.\n");
+			return -1;
+		}
+
+		replies[i].str = w.buf;
+		replies[i].len = w.len;
 	}
 
-	bd->data.d = dict;
-	str = benc_encode (bd);
-	free_benc_data (bd);
+	return 0;
+}
+
+const char *
+tracker_reason (enum TRACKER_REPLY reply)
+{
+	return reasons[reply];
+}
+
+const char *
+tracker_reply (enum TRACKER_REPLY reply, size_t *len)
+{
+	*len = replies[reply].len;
 
-	return str;
+	return replies[reply].str;
 }
 
-static inline char *
-missing_pass_key (void)
+/*
+ * Everything up to the reply counts as lookup, start is when the request
+ * reached the tracker.
+ */
+static int
+announce (announce_info_t *ai, uint32_t user_id, uint8_t perms, char **ret,
+		size_t *len, uint64_t start)
 {
-	benc_data_t *bd = NULL;
-	benc_dict_t *dict = NULL;
-	char *str = NULL;
-
-	dict = (benc_dict_t *) malloc (sizeof (benc_dict_t) * 2);
-	if (dict == NULL)
-		return NULL;
-
-	dict[1].val = NULL;
-	dict[0].key = strdup ("failure reason");
-	bd = new_benc_data (BENC_TYPE_STR);
-	if (bd == NULL) {
-		free (dict[0].key);
-		free (dict);
-		return NULL;
+	torrent_t *t;
+	swarm_t *s;
+	char *str;
+	int64_t down, up;
+	uint32_t n, now;
+	int32_t slot;
+
+	if ((ai == NULL) || ((ai->fields & ANNOUNCE_REQUIRED)
+				!= ANNOUNCE_REQUIRED))
+		return TRACKER_REPLY_BAD_REQUEST;
+
+	if (((perms & PERM_LEECH) == 0) && (ai->left != 0)
+			&& (ai->event != EVENT_STOPPED))
+		return TRACKER_REPLY_LEECH_DISABLED;
+
+	ai->user_id = user_id;
+	t = catalog_lookup (ai->info_hash);
+	if (t == NULL)
+		return TRACKER_REPLY_UNREGISTERED;
+
+	now = event_now ();
+	s = &t->swarm;
+	pthread_mutex_lock (t->lock);
+	torrent_write_begin (t);
+	if (ai->event == EVENT_STOPPED) {
+		slot = swarm_find (s, ai->peer_id);
+		swarm_delta (s, slot, ai, &up, &down);
+		if (slot >= 0)
+			expire_remove (t, (uint32_t) slot);
+
+		torrent_update_counters (t);
+		slot = -1;
+		n = 0;
+	} else {
+		slot = swarm_update (s, ai, now, &up, &down);
+		if (slot < 0) {
+			// Not stored, the client must not think it is.
+			torrent_write_end (t);
+			pthread_mutex_unlock (t->lock);
+			return TRACKER_REPLY_TRY_AGAIN;
+		}
+
+		expire_touch (t, (uint32_t) slot);
+		torrent_update_counters (t);
+		n = (ai->numwant < 0) ? NUMWANT_DEFAULT : (uint32_t) ai->numwant;
+		if (n > NUMWANT_MAX)
+			n = NUMWANT_MAX;
 	}
 
-	bd->data.s = strdup ("Missing passkey, re-download torrent from "
-			"forum.");
-	if (bd->data.s == NULL) {
-		free (bd);
-		free (dict[0].key);
-		free (dict);
-		return NULL;
+	torrent_write_end (t);
+	pthread_mutex_unlock (t->lock);
+	acct_push (ai->user_id, __atomic_load_n (&t->id, __ATOMIC_RELAXED),
+			up, down);
+	start = metrics_time (METRICS_LOOKUP, start);
+	trace_mark (TRACE_LOOKUP);
+	str = (char *) arena_alloc (arena_get (), announce_size (n,
+				ai->compact, ai->no_peer_id));
+	if (str == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return TRACKER_REPLY_TRY_AGAIN;
 	}
 
-	dict[0].val = bd;
-	bd = new_benc_data (BENC_TYPE_DCT);
-	if (bd == NULL) {
-		free_benc_data (dict[0].val);
-		free (dict[0].key);
-		free (dict);
-		return NULL;
+	*len = sample_peers (t, ai, str, n, slot);
+	*ret = str;
+	metrics_time (METRICS_ENCODE, start);
+	trace_mark (TRACE_ENCODE);
+	metrics_add (METRICS_ANNOUNCES + ai->event, 1);
+
+	return TRACKER_REPLY_OK;
+}
+
+static inline int
+info_hash_cmp (const void *a, const void *b)
+{
+	return memcmp (a, b, INFO_HASH_LEN);
+}
+
+/*
+ * Picks where in the swarm the returned peer window starts, a per-thread
+ * xorshift keeps this off any shared state.
+ */
+static inline uint32_t
+rand_start (uint32_t count)
+{
+	uint32_t x;
+
+	if (count == 0)
+		return 0;
+
+	x = rand_state;
+	if (x == 0)
+		x = (uint32_t) time (NULL) ^ (uint32_t) (uintptr_t) &rand_state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	rand_state = x;
+
+	return x % count;
+}
+
+/*
+ * Writes the peer list without the torrent's lock: the list is built from
+ * a view of the swarm and built again if an announce changed the swarm in
+ * the meantime.  The announcing peer's slot may have moved by then, it is
+ * only skipped while it still holds the peer.  A torrent busy enough to
+ * beat SAMPLE_TRIES attempts is read under its lock.
+ */
+static size_t
+sample_peers (torrent_t *t, announce_info_t *ai, char *str, uint32_t n,
+		int32_t slot)
+{
+	size_t len = 0;
+	uint32_t seq, tries = SAMPLE_TRIES;
+
+	if (epoch_enter () == 0) {
+		for (tries = 0; tries < SAMPLE_TRIES; tries++) {
+			seq = torrent_read_begin (t);
+			len = write_peers (t, ai, str, n, slot);
+			if (torrent_read_retry (t, seq) == 0)
+				break;
+		}
+
+		epoch_exit ();
 	}
 
-	bd->data.d = dict;
-	str = benc_encode (bd);
-	free_benc_data (bd);
+	if (tries == SAMPLE_TRIES) {
+		pthread_mutex_lock (t->lock);
+		len = write_peers (t, ai, str, n, slot);
+		pthread_mutex_unlock (t->lock);
+	}
 
-	return str;
+	return len;
 }
 
-char *
-tracker_handle_request (char *pkey, char *req, announce_info_t *ai,
-		char *info_hash)
+/*
+ * Answers every requested info_hash from the torrents' counters.  Files
+ * are dictionary keys so the info_hashes are sorted and duplicates
+ * dropped, unregistered torrents are left out.  A scrape without any
+ * info_hash is a full scrape which the front end streams.  The torrent
+ * lookups are timed as part of encoding the reply.
+ */
+static int
+scrape (scrape_info_t *si, uint8_t perms, char **ret, size_t *len,
+		uint64_t start)
 {
-	if ((strcmp (pkey, "announce") == 0)
-			|| (strcmp (pkey, "scrape") == 0)) {
-		return missing_pass_key ();
+	benc_writer_t w;
+	torrent_t *t;
+	char *str;
+	size_t size;
+	uint32_t i;
+
+	if (si == NULL)
+		return TRACKER_REPLY_BAD_REQUEST;
+
+	if (si->count == 0) {
+		if ((perms & PERM_FULL_SCRAPE) == 0)
+			return TRACKER_REPLY_FULL_SCRAPE_DENIED;
+
+		metrics_add (METRICS_FULL_SCRAPES, 1);
+
+		return TRACKER_REPLY_FULL_SCRAPE;
+	}
+
+	start = metrics_time (METRICS_LOOKUP, start);
+	trace_note (TRACE_SCRAPE, NULL, si->count, 0);
+	qsort (si->info_hash, si->count, INFO_HASH_LEN, info_hash_cmp);
+	size = SCRAPE_HEAD_MAX + (size_t) si->count * SCRAPE_FILE_MAX;
+	str = (char *) arena_alloc (arena_get (), size);
+	if (str == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return TRACKER_REPLY_TRY_AGAIN;
 	}
 
-	if ((strcmp (req, "announce") != 0) && (strcmp (req, "scrape") != 0)) {
-		return bad_request ();
+	benc_writer_init (&w, str, size);
+	benc_write_dict (&w);
+	benc_write_str (&w, "files", 5);
+	benc_write_dict (&w);
+	for (i = 0; i < si->count; i++) {
+		if ((i > 0) && (memcmp (si->info_hash[i - 1], si->info_hash[i],
+						INFO_HASH_LEN) == 0))
+			continue;
+
+		t = catalog_lookup (si->info_hash[i]);
+		if (t == NULL)
+			continue;
+
+		scrape_torrent (&w, t);
 	}
 
-	debug_unimplemented ();
-	return NULL;
+	benc_write_end (&w);
+	benc_write_end (&w);
+	if (benc_writer_error (&w) != 0) {
+		debug (LOG_ERR, "ERROR: scrape reply overflow.\n");
+		return TRACKER_REPLY_TRY_AGAIN;
+	}
+
+	*ret = w.buf;
+	*len = w.len;
+	metrics_time (METRICS_ENCODE, start);
+	trace_mark (TRACE_ENCODE);
+	metrics_add (METRICS_SCRAPES, 1);
+
+	return TRACKER_REPLY_OK;
+}
+
+static inline size_t
+write_peers (torrent_t *t, announce_info_t *ai, char *str, uint32_t n,
+		int32_t slot)
+{
+	swarm_view_t v;
+	int32_t skip = -1;
+
+	swarm_view (&t->swarm, &v);
+	if ((slot >= 0) && ((uint32_t) slot < v.count) && (memcmp
+				(v.peer_id[slot], ai->peer_id, PEER_ID_LEN)
+				== 0))
+		skip = slot;
+
+	trace_note (TRACE_ANNOUNCE, ai->info_hash, v.count, n);
+	if (ai->udp != 0)
+		return announce_write_udp (str, &v, announce_interval,
+				rand_start (v.count), n, skip);
+
+	return announce_write (str, &v, announce_interval,
+			rand_start (v.count), n, skip, ai->compact,
+			ai->no_peer_id);
 }
@@ -7,11 +7,57 @@
 #define __TRACKER_H__
 
 #include <inttypes.h>
+#include <stddef.h>
+#include <netinet/in.h>
 
+#define INFO_HASH_LEN 20
+#define PEER_ID_LEN 20
+
+enum EVENT {
+	EVENT_NONE = 0,
+	EVENT_COMPLETED,
+	EVENT_STARTED,
+	EVENT_STOPPED
+};
+
+/*
+ * Replies of tracker_handle_request ().  TRACKER_REPLY_OK is a reply built
+ * in the request arena, TRACKER_REPLY_FULL_SCRAPE asks the front end to
+ * stream a full scrape, TRACKER_REPLY_ERROR means no reply can be given
+ * and the others are fixed failure replies encoded once by tracker_init ().
+ */
+enum TRACKER_REPLY {
+	TRACKER_REPLY_FULL_SCRAPE = -3,
+	TRACKER_REPLY_ERROR = -2,
+	TRACKER_REPLY_OK = -1,
+	TRACKER_REPLY_BAD_REQUEST = 0,
+	TRACKER_REPLY_MISSING_PASSKEY,
+	TRACKER_REPLY_UNREGISTERED,
+	TRACKER_REPLY_TRY_AGAIN,
+	TRACKER_REPLY_INVALID_PASSKEY,
+	TRACKER_REPLY_LEECH_DISABLED,
+	TRACKER_REPLY_FULL_SCRAPE_DENIED,
+	TRACKER_REPLY_MAX
+};
+
+enum ANNOUNCE_FIELD {
+	ANNOUNCE_INFO_HASH = 1,
+	ANNOUNCE_PEER_ID = 1 << 1,
+	ANNOUNCE_PORT = 1 << 2,
+	ANNOUNCE_IP = 1 << 3
+};
+
+/*
+ * Announce arguments in binary form.  fields records which of the
+ * ANNOUNCE_* arguments were present, tracker_id points into the request's
+ * copy of the query string and is not NUL terminated.  user_id is the
+ * passkey's user, 0 while unknown.  udp asks for the binary reply of a UDP
+ * announce instead of a bencoded one.
+ */
 typedef struct __announce_info_type {
-	char *info_hash;
-	char *peer_id;
-	char *ip;
+	uint8_t info_hash[INFO_HASH_LEN];
+	uint8_t peer_id[PEER_ID_LEN];
+	struct in_addr ip;
 	uint16_t port;
 	int64_t uploaded;
 	int64_t downloaded;
@@ -20,10 +66,31 @@ typedef struct __announce_info_type {
 	uint8_t compact;
 	uint8_t no_peer_id;
 	uint8_t event;
+	uint8_t fields;
+	uint8_t udp;
 	int32_t numwant;
-	char *key;
-	char *tracker_id;
+	uint32_t key;
+	uint32_t user_id;
+	const char *tracker_id;
+	size_t tracker_id_len;
 } announce_info_t;
 
-char *tracker_handle_request (char *, char *, announce_info_t *, char *);
+/*
+ * Info_hashes of a scrape, at most SCRAPE_MAX of them are answered.  No
+ * info_hash at all asks for every torrent.
+ */
+#define SCRAPE_MAX 256
+
+typedef struct __scrape_info_type {
+	uint8_t (*info_hash)[INFO_HASH_LEN];
+	uint32_t count;
+	uint32_t size;
+} scrape_info_t;
+
+void tracker_fin (void);
+int tracker_handle_request (char *, char *, announce_info_t *,
+		scrape_info_t *, char **, size_t *);
+int tracker_init (void);
+const char *tracker_reason (enum TRACKER_REPLY);
+const char *tracker_reply (enum TRACKER_REPLY, size_t *);
 #endif /* __TRACKER_H__ */
@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "catalog.h"
+#include "config.h"
+#include "event.h"
+#include "logger.h"
+#include "metrics.h"
+#include "torrent.h"
+#include "tracker.h"
+#include "udp.h"
+
+#define UDP_BATCH 64
+#define UDP_PACKET_MAX 2048
+#define UDP_PROTOCOL_ID 0x41727101980ULL
+// A connection_id is valid for the minute it was issued in and the next.
+#define UDP_CONNECT_TTL 60
+
+// Offsets of the fields of a request and of a reply.
+#define UDP_HEAD_LEN 16
+#define UDP_REPLY_HEAD_LEN 8
+#define UDP_ANNOUNCE_LEN 98
+#define UDP_SCRAPE_FILE_LEN 12
+// Scrapes longer than this do not fit a reply in one Ethernet frame.
+#define UDP_SCRAPE_MAX 74
+
+enum UDP_ACTION {
+	UDP_ACTION_CONNECT = 0,
+	UDP_ACTION_ANNOUNCE,
+	UDP_ACTION_SCRAPE,
+	UDP_ACTION_ERROR
+};
+
+// BEP 41 announce options.
+enum UDP_OPTION {
+	UDP_OPTION_END = 0,
+	UDP_OPTION_NOP,
+	UDP_OPTION_URL_DATA
+};
+
+typedef struct __udp_worker_type {
+	struct mmsghdr in_msgs[UDP_BATCH];
+	struct mmsghdr out_msgs[UDP_BATCH];
+	struct iovec in_iov[UDP_BATCH];
+	struct iovec out_iov[UDP_BATCH];
+	struct sockaddr_in addr[UDP_BATCH];
+	uint8_t in[UDP_BATCH][UDP_PACKET_MAX];
+	uint8_t out[UDP_BATCH][UDP_PACKET_MAX];
+	pthread_t thrd;
+	uint8_t thrd_valid;
+	int fd;
+} udp_worker_t;
+
+static size_t announce (arena_t *, const uint8_t *, size_t,
+		const struct sockaddr_in *, uint8_t *);
+static inline uint64_t connection_id (const struct sockaddr_in *, uint64_t);
+static inline size_t error_reply (uint8_t *, enum TRACKER_REPLY);
+static inline uint32_t get_be32 (const uint8_t *);
+static inline uint64_t get_be64 (const uint8_t *);
+static size_t handle_packet (arena_t *, const uint8_t *, size_t,
+		const struct sockaddr_in *, uint8_t *);
+static inline void put_be32 (uint8_t *, uint32_t);
+static inline void put_be64 (uint8_t *, uint64_t);
+static size_t scrape (const uint8_t *, size_t, uint8_t *);
+static inline uint64_t siphash (uint64_t, uint64_t);
+static inline void sip_round (uint64_t *);
+static void *udp_thread (void *);
+static inline char *url_data (arena_t *, const uint8_t *, size_t);
+static inline int valid_connection (const uint8_t *,
+		const struct sockaddr_in *);
+
+static udp_worker_t *workers = NULL;
+static uint32_t worker_count = 0;
+static uint64_t secret[2];
+static int stop = 0;
+
+void
+udp_fin (void)
+{
+	uint32_t i;
+
+	__atomic_store_n (&stop, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < worker_count; i++) {
+		if (workers[i].thrd_valid != 0)
+			pthread_join (workers[i].thrd, NULL);
+
+		if (workers[i].fd >= 0)
+			close (workers[i].fd);
+	}
+
+	free (workers);
+	workers = NULL;
+	worker_count = 0;
+
+	return;
+}
+
+int
+udp_init (void)
+{
+	struct sockaddr_in sock_addr;
+	struct timeval tv;
+	uint16_t udp_port;
+	uint32_t i;
+	int on = 1;
+
+	udp_port = (uint16_t) atoi ((const char *) udp_listen_port);
+	if (udp_port == 0) {
+		logger (LOG_INFO, "INFO: udp tracker disabled.\n");
+		return 0;
+	}
+
+	if (getrandom (secret, sizeof (secret), 0) != sizeof (secret)) {
+		debug (LOG_ERR, "ERROR: unable to seed connection ids.\n");
+		return -1;
+	}
+
+	if (udp_threads == 0)
+		udp_threads = 1;
+
+	workers = (udp_worker_t *) calloc (udp_threads, sizeof (udp_worker_t));
+	if (workers == NULL) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return -1;
+	}
+
+	for (i = 0; i < udp_threads; i++)
+		workers[i].fd = -1;
+
+	worker_count = udp_threads;
+	stop = 0;
+	memset (&sock_addr, 0, sizeof (struct sockaddr_in));
+	sock_addr.sin_family = AF_INET;
+	sock_addr.sin_addr.s_addr = inet_addr (udp_listen_ip);
+	sock_addr.sin_port = htons (udp_port);
+
+	// Wake up every second to notice udp_fin ().
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	for (i = 0; i < worker_count; i++) {
+		workers[i].fd = socket (AF_INET, SOCK_DGRAM, 0);
+		if (workers[i].fd < 0) {
+			debug (LOG_ERR, "ERROR: unable to create udp socket: "
+					"%s.\n", strerror (errno));
+			udp_fin ();
+			return -1;
+		}
+
+		if ((setsockopt (workers[i].fd, SOL_SOCKET, SO_REUSEPORT, &on,
+						sizeof (on)) != 0)
+				|| (setsockopt (workers[i].fd, SOL_SOCKET,
+						SO_RCVTIMEO, &tv,
+						sizeof (tv)) != 0)) {
+			debug (LOG_ERR, "ERROR: unable to set udp socket "
+					"options: %s.\n", strerror (errno));
+			udp_fin ();
+			return -1;
+		}
+
+		if (bind (workers[i].fd, (struct sockaddr *) &sock_addr,
+					sizeof (sock_addr)) != 0) {
+			debug (LOG_ERR, "ERROR: unable to bind udp socket: "
+					"%s.\n", strerror (errno));
+			udp_fin ();
+			return -1;
+		}
+	}
+
+	for (i = 0; i < worker_count; i++) {
+		if (pthread_create (&workers[i].thrd, NULL, udp_thread,
+					&workers[i]) != 0) {
+			debug (LOG_ERR, "ERROR: unable to start udp thread.\n");
+			udp_fin ();
+			return -1;
+		}
+
+		workers[i].thrd_valid = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Turns an announce into announce_info_t and hands it to the tracker, the
+ * action decides the request and only the passkey is taken from the URL.
+ */
+static size_t
+announce (arena_t *arena, const uint8_t *buf, size_t len,
+		const struct sockaddr_in *addr, uint8_t *out)
+{
+	announce_info_t *ai;
+	char *pkey, *ret, *save, *str;
+	size_t ret_len = 0;
+	uint64_t t;
+	uint32_t event;
+	int reply;
+
+	if (len < UDP_ANNOUNCE_LEN)
+		return error_reply (out, TRACKER_REPLY_BAD_REQUEST);
+
+	t = metrics_clock ();
+	ai = (announce_info_t *) arena_alloc (arena, sizeof (announce_info_t));
+	str = url_data (arena, buf + UDP_ANNOUNCE_LEN,
+			len - UDP_ANNOUNCE_LEN);
+	if ((ai == NULL) || (str == NULL)) {
+		debug (LOG_ERR, "ERROR: out-of-memory.\n");
+		return error_reply (out, TRACKER_REPLY_TRY_AGAIN);
+	}
+
+	memset (ai, 0, sizeof (announce_info_t));
+	memcpy (ai->info_hash, buf + 16, INFO_HASH_LEN);
+	memcpy (ai->peer_id, buf + 36, PEER_ID_LEN);
+	ai->downloaded = (int64_t) get_be64 (buf + 56);
+	ai->left = (int64_t) get_be64 (buf + 64);
+	ai->uploaded = (int64_t) get_be64 (buf + 72);
+	event = get_be32 (buf + 80);
+	ai->event = (event <= EVENT_STOPPED) ? (uint8_t) event : EVENT_NONE;
+	ai->fields = ANNOUNCE_INFO_HASH | ANNOUNCE_PEER_ID | ANNOUNCE_PORT;
+	memcpy (&ai->ip, buf + 84, sizeof (ai->ip));
+	if (ai->ip.s_addr != 0)
+		ai->fields |= ANNOUNCE_IP;
+	else
+		ai->ip = addr->sin_addr;
+
+	ai->key = get_be32 (buf + 88);
+	ai->numwant = (int32_t) get_be32 (buf + 92);
+	ai->port = (uint16_t) (buf[96] << 8 | buf[97]);
+	ai->compact = 1;
+	ai->udp = 1;
+
+	// The URL is the announce URL's path, /<passkey>/announce.
+	str[strcspn (str, "?")] = '\0';
+	pkey = strtok_r (str, "/", &save);
+	metrics_time (METRICS_PARSE, t);
+	reply = tracker_handle_request (pkey, "announce", ai, NULL, &ret,
+			&ret_len);
+	if (reply == TRACKER_REPLY_ERROR) {
+		metrics_add (METRICS_ERRORS, 1);
+		return 0;
+	}
+
+	if (reply >= 0)
+		return error_reply (out, (enum TRACKER_REPLY) reply);
+
+	if (ret_len > UDP_PACKET_MAX - UDP_REPLY_HEAD_LEN) {
+		debug (LOG_ERR, "ERROR: udp announce reply overflow.\n");
+		return error_reply (out, TRACKER_REPLY_TRY_AGAIN);
+	}
+
+	put_be32 (out, UDP_ACTION_ANNOUNCE);
+	memcpy (out + UDP_REPLY_HEAD_LEN, ret, ret_len);
+
+	return UDP_REPLY_HEAD_LEN + ret_len;
+}
+
+static inline uint64_t
+connection_id (const struct sockaddr_in *addr, uint64_t epoch)
+{
+	return siphash ((uint64_t) addr->sin_addr.s_addr << 16
+			| addr->sin_port, epoch);
+}
+
+// The transaction_id is already in place.
+static inline size_t
+error_reply (uint8_t *out, enum TRACKER_REPLY reply)
+{
+	const char *reason;
+	size_t len;
+
+	reason = tracker_reason (reply);
+	len = strlen (reason);
+	metrics_add (METRICS_FAILURES + reply, 1);
+	put_be32 (out, UDP_ACTION_ERROR);
+	memcpy (out + UDP_REPLY_HEAD_LEN, reason, len);
+
+	return UDP_REPLY_HEAD_LEN + len;
+}
+
+static inline uint32_t
+get_be32 (const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy (&v, p, sizeof (v));
+
+	return ntohl (v);
+}
+
+static inline uint64_t
+get_be64 (const uint8_t *p)
+{
+	return (uint64_t) get_be32 (p) << 32 | get_be32 (p + 4);
+}
+
+/*
+ * Answers one packet into out and returns the length of the reply, 0 for
+ * none.  Packets that are too short or carry a stale connection_id are
+ * dropped without a reply, so spoofed sources get nothing back.
+ */
+static size_t
+handle_packet (arena_t *arena, const uint8_t *buf, size_t len,
+		const struct sockaddr_in *addr, uint8_t *out)
+{
+	uint64_t start;
+	size_t ret;
+	uint32_t action;
+
+	if (len < UDP_HEAD_LEN)
+		return 0;
+
+	action = get_be32 (buf + 8);
+	memcpy (out + 4, buf + 12, 4);
+	if (action == UDP_ACTION_CONNECT) {
+		if (get_be64 (buf) != UDP_PROTOCOL_ID)
+			return 0;
+
+		put_be32 (out, UDP_ACTION_CONNECT);
+		put_be64 (out + UDP_REPLY_HEAD_LEN, connection_id (addr,
+					event_now () / UDP_CONNECT_TTL));
+
+		return UDP_REPLY_HEAD_LEN + 8;
+	}
+
+	if (valid_connection (buf, addr) == 0)
+		return 0;
+
+	if ((action == UDP_ACTION_ANNOUNCE) || (action == UDP_ACTION_SCRAPE)) {
+		start = metrics_clock ();
+		if (action == UDP_ACTION_ANNOUNCE)
+			ret = announce (arena, buf, len, addr, out);
+		else
+			ret = scrape (buf, len, out);
+
+		metrics_time (METRICS_TOTAL, start);
+
+		return ret;
+	}
+
+	return error_reply (out, TRACKER_REPLY_BAD_REQUEST);
+}
+
+static inline void
+put_be32 (uint8_t *p, uint32_t v)
+{
+	v = htonl (v);
+	memcpy (p, &v, sizeof (v));
+
+	return;
+}
+
+static inline void
+put_be64 (uint8_t *p, uint64_t v)
+{
+	put_be32 (p, (uint32_t) (v >> 32));
+	put_be32 (p + 4, (uint32_t) v);
+
+	return;
+}
+
+/*
+ * Answers every info_hash in the order asked, unregistered torrents get
+ * zeros.  Without udp_scrape the missing passkey error is sent instead.
+ */
+static size_t
+scrape (const uint8_t *buf, size_t len, uint8_t *out)
+{
+	torrent_t *t;
+	uint8_t *p;
+	uint32_t complete, downloaded, i, incomplete, n;
+
+	if (udp_scrape == 0)
+		return error_reply (out, TRACKER_REPLY_MISSING_PASSKEY);
+
+	n = (uint32_t) ((len - UDP_HEAD_LEN) / INFO_HASH_LEN);
+	if (n == 0)
+		return error_reply (out, TRACKER_REPLY_BAD_REQUEST);
+
+	if (n > UDP_SCRAPE_MAX)
+		n = UDP_SCRAPE_MAX;
+
+	put_be32 (out, UDP_ACTION_SCRAPE);
+	p = out + UDP_REPLY_HEAD_LEN;
+	for (i = 0; i < n; i++) {
+		complete = 0;
+		downloaded = 0;
+		incomplete = 0;
+		t = catalog_lookup (buf + UDP_HEAD_LEN + i * INFO_HASH_LEN);
+		if (t != NULL)
+			torrent_counters (t, &complete, &downloaded,
+					&incomplete);
+
+		put_be32 (p, complete);
+		put_be32 (p + 4, downloaded);
+		put_be32 (p + 8, incomplete);
+		p += UDP_SCRAPE_FILE_LEN;
+	}
+
+	metrics_add (METRICS_SCRAPES, 1);
+
+	return (size_t) (p - out);
+}
+
+// SipHash-2-4 of a two word message keyed with secret.
+static inline uint64_t
+siphash (uint64_t m0, uint64_t m1)
+{
+	uint64_t v[4];
+
+	v[0] = secret[0] ^ 0x736f6d6570736575ULL;
+	v[1] = secret[1] ^ 0x646f72616e646f6dULL;
+	v[2] = secret[0] ^ 0x6c7967656e657261ULL;
+	v[3] = secret[1] ^ 0x7465646279746573ULL;
+	v[3] ^= m0;
+	sip_round (v);
+	sip_round (v);
+	v[0] ^= m0;
+	v[3] ^= m1;
+	sip_round (v);
+	sip_round (v);
+	v[0] ^= m1;
+	v[3] ^= 16ULL << 56;
+	sip_round (v);
+	sip_round (v);
+	v[0] ^= 16ULL << 56;
+	v[2] ^= 0xff;
+	sip_round (v);
+	sip_round (v);
+	sip_round (v);
+	sip_round (v);
+
+	return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+static inline void
+sip_round (uint64_t *v)
+{
+	v[0] += v[1];
+	v[1] = ROTL (v[1], 13);
+	v[1] ^= v[0];
+	v[0] = ROTL (v[0], 32);
+	v[2] += v[3];
+	v[3] = ROTL (v[3], 16);
+	v[3] ^= v[2];
+	v[0] += v[3];
+	v[3] = ROTL (v[3], 21);
+	v[3] ^= v[0];
+	v[2] += v[1];
+	v[1] = ROTL (v[1], 17);
+	v[1] ^= v[2];
+	v[2] = ROTL (v[2], 32);
+
+	return;
+}
+
+static void *
+udp_thread (void *arg)
+{
+	udp_worker_t *w = (udp_worker_t *) arg;
+	struct mmsghdr *msg;
+	arena_t *arena;
+	size_t len;
+	uint32_t i, m, sent;
+	int n, r;
+
+	arena = arena_get ();
+	if (arena == NULL)
+		return NULL;
+
+	for (i = 0; i < UDP_BATCH; i++) {
+		w->in_iov[i].iov_base = w->in[i];
+		w->in_iov[i].iov_len = UDP_PACKET_MAX;
+		w->out_iov[i].iov_base = w->out[i];
+	}
+
+	while (__atomic_load_n (&stop, __ATOMIC_ACQUIRE) == 0) {
+		for (i = 0; i < UDP_BATCH; i++) {
+			msg = &w->in_msgs[i];
+			memset (&msg->msg_hdr, 0, sizeof (struct msghdr));
+			msg->msg_hdr.msg_name = &w->addr[i];
+			msg->msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+			msg->msg_hdr.msg_iov = &w->in_iov[i];
+			msg->msg_hdr.msg_iovlen = 1;
+		}
+
+		// Block for the first packet, take whatever else is queued.
+		n = recvmmsg (w->fd, w->in_msgs, UDP_BATCH, MSG_WAITFORONE,
+				NULL);
+		if (n < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)
+					&& (errno != EINTR))
+				debug (LOG_ERR, "ERROR: udp receive failed: "
+						"%s.\n", strerror (errno));
+
+			continue;
+		}
+
+		m = 0;
+		for (i = 0; i < (uint32_t) n; i++) {
+			len = handle_packet (arena, w->in[i],
+					w->in_msgs[i].msg_len, &w->addr[i],
+					w->out[m]);
+			arena_reset (arena);
+			if (len == 0)
+				continue;
+
+			metrics_add (METRICS_REPLY_BYTES, len);
+			w->out_iov[m].iov_len = len;
+			msg = &w->out_msgs[m];
+			memset (&msg->msg_hdr, 0, sizeof (struct msghdr));
+			msg->msg_hdr.msg_name = &w->addr[i];
+			msg->msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+			msg->msg_hdr.msg_iov = &w->out_iov[m];
+			msg->msg_hdr.msg_iovlen = 1;
+			m++;
+		}
+
+		sent = 0;
+		while (sent < m) {
+			r = sendmmsg (w->fd, w->out_msgs + sent, m - sent, 0);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+
+				// Give up on the rest of this batch.
+				debug (LOG_ERR, "ERROR: udp send failed: "
+						"%s.\n", strerror (errno));
+				break;
+			}
+
+			sent += (uint32_t) r;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Joins the URLData options (BEP 41) following an announce into a NUL
+ * terminated string allocated from the arena.
+ */
+static inline char *
+url_data (arena_t *arena, const uint8_t *p, size_t len)
+{
+	char *str;
+	size_t n = 0, olen;
+	uint8_t type;
+
+	str = (char *) arena_alloc (arena, len + 1);
+	if (str == NULL)
+		return NULL;
+
+	while (len > 0) {
+		type = *p++;
+		len--;
+		if (type == UDP_OPTION_END)
+			break;
+
+		if (type == UDP_OPTION_NOP)
+			continue;
+
+		if (len == 0)
+			break;
+
+		olen = *p++;
+		len--;
+		if (olen > len)
+			break;
+
+		if (type == UDP_OPTION_URL_DATA) {
+			memcpy (str + n, p, olen);
+			n += olen;
+		}
+
+		p += olen;
+		len -= olen;
+	}
+
+	str[n] = '\0';
+
+	return str;
+}
+
+static inline int
+valid_connection (const uint8_t *buf, const struct sockaddr_in *addr)
+{
+	uint64_t epoch, id;
+
+	id = get_be64 (buf);
+	epoch = event_now () / UDP_CONNECT_TTL;
+
+	return (id == connection_id (addr, epoch))
+		|| (id == connection_id (addr, epoch - 1));
+}
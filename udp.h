@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __UDP_H__
+#define __UDP_H__
+
+/*
+ * UDP tracker protocol (BEP 15).
+ *
+ * udp_threads sockets are bound to the same address with SO_REUSEPORT so
+ * the kernel spreads the clients over them, each served by its own thread
+ * which receives and answers packets in batches with recvmmsg () and
+ * sendmmsg ().
+ *
+ * No state is kept per connection: a connection_id is a keyed hash of the
+ * client's address and the current minute, checked by hashing again.  An
+ * id is accepted for at most two minutes.
+ *
+ * The passkey travels in the announce URL (BEP 41).  Scrapes carry no URL
+ * and so no passkey, they are refused unless udp_scrape is set and then
+ * answered for any client holding a valid connection_id.
+ */
+
+void udp_fin (void);
+int udp_init (void);
+
+#endif /* __UDP_H__ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#include "wheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+static inline void cascade (wheel_t *, wheel_node_t *);
+static inline void link_node (wheel_t *, wheel_node_t *);
+static inline void unlink_node (wheel_node_t *);
+
+/*
+ * Schedules the node to expire at tick expires, or reschedules it if it
+ * is already scheduled.  Expiries that are not in the future fire on the
+ * next tick.
+ */
+void
+wheel_add (wheel_t *w, wheel_node_t *n, uint32_t expires)
+{
+	if (n->next != NULL)
+		unlink_node (n);
+
+	if ((int32_t) (expires - w->now) <= 0)
+		expires = w->now + 1;
+
+	n->expires = expires;
+	link_node (w, n);
+
+	return;
+}
+
+/*
+ * Moves the wheel forward to tick now and appends every node that came
+ * due on the way to the list headed by due.  The nodes stay linked on due
+ * until they are removed or added again.
+ */
+void
+wheel_advance (wheel_t *w, uint32_t now, wheel_node_t *due)
+{
+	wheel_node_t *head;
+	uint32_t level, shift;
+
+	while ((int32_t) (now - w->now) > 0) {
+		w->now++;
+		for (level = 1; level < WHEEL_LEVELS; level++) {
+			shift = WHEEL_BITS * level;
+			if ((w->now & ((1U << shift) - 1)) != 0)
+				break;
+
+			cascade (w, &w->slots[level][(w->now >> shift)
+					& WHEEL_MASK]);
+		}
+
+		head = &w->slots[0][w->now & WHEEL_MASK];
+		if (head->next == head)
+			continue;
+
+		head->next->prev = due->prev;
+		due->prev->next = head->next;
+		head->prev->next = due;
+		due->prev = head->prev;
+		wheel_list_init (head);
+	}
+
+	return;
+}
+
+void
+wheel_del (wheel_node_t *n)
+{
+	if (n->next != NULL)
+		unlink_node (n);
+
+	return;
+}
+
+void
+wheel_init (wheel_t *w, uint32_t now)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < WHEEL_LEVELS; i++)
+		for (j = 0; j < WHEEL_SLOTS; j++)
+			wheel_list_init (&w->slots[i][j]);
+
+	w->now = now;
+
+	return;
+}
+
+void
+wheel_list_init (wheel_node_t *head)
+{
+	head->next = head;
+	head->prev = head;
+
+	return;
+}
+
+// Spreads the nodes of a higher level slot over the levels below.
+static inline void
+cascade (wheel_t *w, wheel_node_t *head)
+{
+	wheel_node_t *n;
+
+	while (head->next != head) {
+		n = head->next;
+		unlink_node (n);
+		link_node (w, n);
+	}
+
+	return;
+}
+
+static inline void
+link_node (wheel_t *w, wheel_node_t *n)
+{
+	wheel_node_t *head;
+	uint32_t delta, level = 0;
+
+	delta = n->expires - w->now;
+	while ((level < WHEEL_LEVELS - 1) && (delta >= 1U << (WHEEL_BITS
+					* (level + 1))))
+		level++;
+
+	head = &w->slots[level][(n->expires >> (WHEEL_BITS * level))
+		& WHEEL_MASK];
+	n->next = head;
+	n->prev = head->prev;
+	head->prev->next = n;
+	head->prev = n;
+
+	return;
+}
+
+static inline void
+unlink_node (wheel_node_t *n)
+{
+	n->prev->next = n->next;
+	n->next->prev = n->prev;
+	n->next = NULL;
+	n->prev = NULL;
+
+	return;
+}
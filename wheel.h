@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2010 Kross Windz <krosswindz@gmail.com>
+ * All rights reserved.
+ */
+
+#ifndef __WHEEL_H__
+#define __WHEEL_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/*
+ * Hierarchical timing wheel.
+ *
+ * Four levels of 256 slots each.  Level 0 holds the nodes due within the
+ * next 256 ticks, one slot per tick, every further level covers 256 times
+ * the span of the one below, so any expiry within 2^32 ticks is scheduled
+ * by linking the node into one slot.  Whenever the level 0 index wraps,
+ * the next slot of level 1 is cascaded, its nodes spread over level 0 and
+ * so on up.  Adding, rescheduling and removing a node are O(1), advancing
+ * one tick hands over everything due in a single splice.
+ *
+ * Nodes are embedded in the caller's objects, next is NULL while a node
+ * is not scheduled.  A wheel is not thread safe.
+ */
+
+typedef struct __wheel_node_type wheel_node_t;
+
+struct __wheel_node_type {
+	wheel_node_t *next;
+	wheel_node_t *prev;
+	uint32_t expires;
+};
+
+typedef struct __wheel_type {
+	wheel_node_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	uint32_t now;
+} wheel_t;
+
+void wheel_add (wheel_t *, wheel_node_t *, uint32_t);
+void wheel_advance (wheel_t *, uint32_t, wheel_node_t *);
+void wheel_del (wheel_node_t *);
+void wheel_init (wheel_t *, uint32_t);
+void wheel_list_init (wheel_node_t *);
+
+#endif /* __WHEEL_H__ */